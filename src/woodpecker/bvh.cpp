@@ -0,0 +1,254 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <woodpecker/util/cast.hpp>
+
+namespace wdp {
+  namespace {
+    Vec3 sub(const Vec3& a, const Vec3& b) noexcept { return {a[0] - b[0], a[1] - b[1], a[2] - b[2]}; }
+
+    Vec3 cross(const Vec3& a, const Vec3& b) noexcept {
+      return {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+    }
+
+    float dot(const Vec3& a, const Vec3& b) noexcept { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+  }
+
+  float ray_triangle_distance(const Ray& ray, const Vec3& a, const Vec3& b, const Vec3& c) noexcept {
+    const auto edge_ab = sub(b, a);
+    const auto edge_ac = sub(c, a);
+    const auto p = cross(ray.direction, edge_ac);
+    const auto det = dot(edge_ab, p);
+    if (std::abs(det) < std::numeric_limits<float>::min()) {
+      return -1;  // parallel to the triangle plane, or degenerate
+    }
+    const auto inv_det = 1 / det;
+    const auto origin_rel = sub(ray.origin, a);
+    const auto u = dot(origin_rel, p) * inv_det;
+    if (u < 0 || u > 1) {
+      return -1;
+    }
+    const auto q = cross(origin_rel, edge_ab);
+    const auto v = dot(ray.direction, q) * inv_det;
+    if (v < 0 || u + v > 1) {
+      return -1;
+    }
+    return dot(edge_ac, q) * inv_det;
+  }
+
+  Frustum Frustum::from_matrix(std::span<const float, 16> view_projection) noexcept {
+    // each plane is the last row of the matrix plus or minus one of the others, see Gribb and Hartmann
+    const auto row = [&](int i) {
+      return std::array{view_projection[i], view_projection[4 + i], view_projection[8 + i], view_projection[12 + i]};
+    };
+    const auto w_row = row(3);
+    auto frustum = Frustum{};
+    for (auto axis = 0; axis < 3; ++axis) {
+      const auto axis_row = row(axis);
+      for (auto coeff = 0; coeff < 4; ++coeff) {
+        frustum.planes[2 * axis][coeff] = w_row[coeff] + axis_row[coeff];
+        frustum.planes[2 * axis + 1][coeff] = w_row[coeff] - axis_row[coeff];
+      }
+    }
+    return frustum;
+  }
+
+  bool Frustum::overlaps(const Aabb& box) const noexcept {
+    // a box is outside of a plane if its corner farthest along the normal is
+    return std::ranges::all_of(planes, [&](const std::array<float, 4>& plane) {
+      const auto x = plane[0] >= 0 ? box.max[0] : box.min[0];
+      const auto y = plane[1] >= 0 ? box.max[1] : box.min[1];
+      const auto z = plane[2] >= 0 ? box.max[2] : box.min[2];
+      return plane[0] * x + plane[1] * y + plane[2] * z + plane[3] >= 0;
+    });
+  }
+
+  bool Frustum::contains(const Aabb& box) const noexcept {
+    // a box is inside of a plane if its corner farthest against the normal is
+    return std::ranges::all_of(planes, [&](const std::array<float, 4>& plane) {
+      const auto x = plane[0] >= 0 ? box.min[0] : box.max[0];
+      const auto y = plane[1] >= 0 ? box.min[1] : box.max[1];
+      const auto z = plane[2] >= 0 ? box.min[2] : box.max[2];
+      return plane[0] * x + plane[1] * y + plane[2] * z + plane[3] >= 0;
+    });
+  }
+
+  Bvh::Bvh(std::span<const Aabb> boxes) {
+    if (boxes.empty()) {
+      return;
+    }
+    const auto primitive_count = narrow<std::uint32_t>(boxes.size());
+    primitive_indices_.resize(primitive_count);
+    for (auto i = std::uint32_t{0}; i < primitive_count; ++i) {
+      primitive_indices_[i] = i;
+    }
+    auto centers = std::vector<Vec3>{};
+    centers.reserve(boxes.size());
+    for (const auto& box : boxes) {
+      // the center of an empty box, such as of a part with an empty mesh, is NaN,
+      // but the box overlaps nothing, so any finite center will do
+      centers.push_back(box.empty() ? Vec3{} : box.center());
+    }
+    // a binary tree with at least one primitive per leaf has less than twice as many nodes as primitives
+    nodes_.reserve(2 * boxes.size());
+    node_parents_.reserve(2 * boxes.size());
+    nodes_.push_back({{}, 0, primitive_count});
+    node_parents_.push_back(0);
+    build_node(0, boxes, centers, 0);
+
+    primitive_leaves_.resize(primitive_count);
+    for (auto node_idx = std::uint32_t{0}; node_idx < nodes_.size(); ++node_idx) {
+      const auto& node = nodes_[node_idx];
+      for (auto i = node.first; node.count != 0 && i < node.first + node.count; ++i) {
+        primitive_leaves_[primitive_indices_[i]] = node_idx;
+      }
+    }
+  }
+
+  void Bvh::refit(std::span<const Aabb> boxes, std::span<const std::uint32_t> changed) {
+    for (const auto prim_idx : changed) {
+      auto node_idx = primitive_leaves_[prim_idx];
+      auto bounds = Aabb{};
+      const auto& leaf = nodes_[node_idx];
+      for (auto i = leaf.first; i < leaf.first + leaf.count; ++i) {
+        bounds.extend(boxes[primitive_indices_[i]]);
+      }
+      // up to the root, or to the first node whose bounds stay the same
+      while (bounds.min != nodes_[node_idx].bounds.min || bounds.max != nodes_[node_idx].bounds.max) {
+        nodes_[node_idx].bounds = bounds;
+        if (node_idx == 0) {
+          break;
+        }
+        node_idx = node_parents_[node_idx];
+        const auto& node = nodes_[node_idx];
+        bounds = nodes_[node.first].bounds;
+        bounds.extend(nodes_[node.first + 1].bounds);
+      }
+    }
+  }
+
+  void Bvh::build_node(std::uint32_t node_idx, std::span<const Aabb> boxes, std::span<const Vec3> centers,
+                       int depth) {
+    const auto first = nodes_[node_idx].first;
+    const auto count = nodes_[node_idx].count;
+    const auto node_primitives = std::span{primitive_indices_}.subspan(first, count);
+
+    auto bounds = Aabb{};
+    auto center_bounds = Aabb{};
+    for (const auto prim_idx : node_primitives) {
+      bounds.extend(boxes[prim_idx]);
+      center_bounds.extend(centers[prim_idx]);
+    }
+    nodes_[node_idx].bounds = bounds;
+    if (count <= max_leaf_size || depth == max_depth) {
+      return;
+    }
+
+    // split along the longest axis of the centers
+    auto axis = 0;
+    for (auto other_axis = 1; other_axis < 3; ++other_axis) {
+      if (center_bounds.max[other_axis] - center_bounds.min[other_axis] >
+          center_bounds.max[axis] - center_bounds.min[axis]) {
+        axis = other_axis;
+      }
+    }
+    const auto axis_min = center_bounds.min[axis];
+    const auto axis_extent = center_bounds.max[axis] - axis_min;
+    if (!(axis_extent > 0)) {
+      return;  // all centers coincide, no split separates them
+    }
+
+    // bin the primitives by center, then find the split between bins with the lowest surface area cost
+    struct Bin {
+      Aabb bounds;
+      std::uint32_t count{};
+    };
+    auto bins = std::array<Bin, bin_count>{};
+    const auto bin_of = [&](std::uint32_t prim_idx) {
+      // clamped before the conversion, which is undefined for NaN and values out of range
+      const auto bin = (centers[prim_idx][axis] - axis_min) / axis_extent * bin_count;
+      return bin >= 1 ? static_cast<int>(std::min(bin, static_cast<float>(bin_count - 1))) : 0;
+    };
+    for (const auto prim_idx : node_primitives) {
+      auto& bin = bins[static_cast<std::size_t>(bin_of(prim_idx))];
+      bin.bounds.extend(boxes[prim_idx]);
+      ++bin.count;
+    }
+    // costs of the primitives right of each split, swept from the right
+    auto right_costs = std::array<float, bin_count>{};
+    auto right_bounds = Aabb{};
+    auto right_count = 0U;
+    for (auto split = bin_count - 1; split > 0; --split) {
+      right_bounds.extend(bins[static_cast<std::size_t>(split)].bounds);
+      right_count += bins[static_cast<std::size_t>(split)].count;
+      right_costs[static_cast<std::size_t>(split)] = right_bounds.half_area() * static_cast<float>(right_count);
+    }
+    auto best_split = 0;
+    auto best_cost = std::numeric_limits<float>::infinity();
+    auto left_bounds = Aabb{};
+    auto left_count = 0U;
+    for (auto split = 1; split < bin_count; ++split) {
+      left_bounds.extend(bins[static_cast<std::size_t>(split - 1)].bounds);
+      left_count += bins[static_cast<std::size_t>(split - 1)].count;
+      const auto cost =
+          left_bounds.half_area() * static_cast<float>(left_count) + right_costs[static_cast<std::size_t>(split)];
+      if (left_count > 0 && left_count < count && cost < best_cost) {
+        best_split = split;
+        best_cost = cost;
+      }
+    }
+    if (best_split == 0) {
+      return;
+    }
+
+    const auto middle = std::partition(node_primitives.begin(), node_primitives.end(),
+                                       [&](std::uint32_t prim_idx) { return bin_of(prim_idx) < best_split; });
+    const auto left_size = narrow_cast<std::uint32_t>(middle - node_primitives.begin());
+
+    // children are appended next to each other, the node becomes an inner node
+    const auto left_idx = narrow_cast<std::uint32_t>(nodes_.size());
+    nodes_.push_back({{}, first, left_size});
+    nodes_.push_back({{}, first + left_size, count - left_size});
+    node_parents_.insert(node_parents_.end(), 2, node_idx);
+    nodes_[node_idx].first = left_idx;
+    nodes_[node_idx].count = 0;
+    build_node(left_idx, boxes, centers, depth + 1);
+    build_node(left_idx + 1, boxes, centers, depth + 1);
+  }
+
+  float Bvh::ray_box_entry(const Aabb& box, const Vec3& origin, const Vec3& inv_direction,
+                           float max_distance) noexcept {
+    // slab test, the comparisons are ordered so that NaN from a zero direction component does not clip
+    auto entry = 0.F;
+    auto exit = max_distance;
+    for (auto axis = 0; axis < 3; ++axis) {
+      auto near = (box.min[axis] - origin[axis]) * inv_direction[axis];
+      auto far = (box.max[axis] - origin[axis]) * inv_direction[axis];
+      if (near > far) {
+        std::swap(near, far);
+      }
+      entry = near > entry ? near : entry;
+      exit = far < exit ? far : exit;
+    }
+    return entry <= exit ? entry : std::numeric_limits<float>::infinity();
+  }
+}
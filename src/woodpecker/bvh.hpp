@@ -0,0 +1,275 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace wdp {
+  /// A position or direction in 3D euclidean space, indexable by axis.
+  using Vec3 = std::array<float, 3>;
+
+  /// An axis-aligned bounding box, empty by default.
+  struct Aabb {
+    Vec3 min{std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity(),
+             std::numeric_limits<float>::infinity()};
+    Vec3 max{-std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(),
+             -std::numeric_limits<float>::infinity()};
+
+    bool empty() const noexcept { return min[0] > max[0]; }
+
+    void extend(const Vec3& pos) noexcept {
+      for (auto axis = 0; axis < 3; ++axis) {
+        min[axis] = std::min(min[axis], pos[axis]);
+        max[axis] = std::max(max[axis], pos[axis]);
+      }
+    }
+
+    void extend(const Aabb& box) noexcept {
+      for (auto axis = 0; axis < 3; ++axis) {
+        min[axis] = std::min(min[axis], box.min[axis]);
+        max[axis] = std::max(max[axis], box.max[axis]);
+      }
+    }
+
+    bool overlaps(const Aabb& box) const noexcept {
+      return min[0] <= box.max[0] && box.min[0] <= max[0] && min[1] <= box.max[1] && box.min[1] <= max[1] &&
+             min[2] <= box.max[2] && box.min[2] <= max[2];
+    }
+
+    Vec3 center() const noexcept {
+      return {(min[0] + max[0]) / 2, (min[1] + max[1]) / 2, (min[2] + max[2]) / 2};
+    }
+
+    /// Half of the surface area, as used by the surface area heuristic.
+    float half_area() const noexcept {
+      if (empty()) {
+        return 0;
+      }
+      const auto dx = max[0] - min[0];
+      const auto dy = max[1] - min[1];
+      const auto dz = max[2] - min[2];
+      return dx * dy + dy * dz + dz * dx;
+    }
+  };
+
+  /// A half-line from an origin in a direction.
+  /// Distances along the ray are measured in multiples of the direction vector.
+  struct Ray {
+    Vec3 origin{};
+    Vec3 direction{};
+
+    Vec3 at(float distance) const noexcept {
+      return {origin[0] + distance * direction[0], origin[1] + distance * direction[1],
+              origin[2] + distance * direction[2]};
+    }
+  };
+
+  /// The volume seen by a camera, bounded by six planes.
+  struct Frustum {
+    /// The planes as coefficients (a, b, c, d), with a x + b y + c z + d >= 0 inside, not normalized.
+    std::array<std::array<float, 4>, 6> planes{};
+
+    /// Extracts the planes from a matrix mapping world space to clip space, that is projection times view,
+    /// in column-major order and with the clip space conventions of OpenGL.
+    static Frustum from_matrix(std::span<const float, 16> view_projection) noexcept;
+
+    /// Whether a box is not entirely outside of any of the planes.
+    /// This is conservative, boxes near the edges of the frustum may overlap although they are outside of it.
+    bool overlaps(const Aabb& box) const noexcept;
+
+    /// Whether a box is entirely inside of all planes.
+    bool contains(const Aabb& box) const noexcept;
+  };
+
+  /// The distance along the ray to a triangle, using the Moeller-Trumbore algorithm.
+  /// \return The distance, or a negative value if the ray misses the triangle. Both sides of it are hit.
+  float ray_triangle_distance(const Ray& ray, const Vec3& a, const Vec3& b, const Vec3& c) noexcept;
+
+  /// A bounding volume hierarchy over a list of primitives given by their bounding boxes.
+  /// Built top-down with the binned surface area heuristic, and stored as a flat array of nodes,
+  /// with the children of an inner node next to each other.
+  class Bvh {
+  public:
+    /// Creates an empty hierarchy.
+    Bvh() = default;
+
+    /// Builds the hierarchy over primitives, identified by their index in the list.
+    explicit Bvh(std::span<const Aabb> boxes);
+
+    /// The bounding box of all primitives.
+    Aabb bounds() const noexcept { return nodes_.empty() ? Aabb{} : nodes_.front().bounds; }
+
+    /// Fits the nodes above changed primitives to their new bounding boxes, keeping the structure of the hierarchy.
+    /// Takes time proportional to the number of changed primitives and the depth of the hierarchy,
+    /// but queries slow down as refitted primitives move away from the primitives they were grouped with.
+    /// \param boxes The current bounding boxes of all primitives.
+    /// \param changed The indices of the primitives whose bounding boxes changed.
+    void refit(std::span<const Aabb> boxes, std::span<const std::uint32_t> changed);
+
+    /// Visits the primitives whose bounding boxes the ray enters within the maximum distance, roughly front to back.
+    /// \param hit Called with a primitive index and the current maximum distance,
+    ///            it returns the distance of a hit with the primitive, or a negative value if there is none.
+    ///            Any closer hit reduces the maximum distance, pruning the nodes behind it.
+    /// \return The distance of the closest hit, or a negative value if there is none.
+    template <class HitFunc>
+    float raycast(const Ray& ray, float max_distance, HitFunc&& hit) const;
+
+    /// Visits the primitives whose bounding boxes overlap a box.
+    template <class Func>
+    void query(const Aabb& box, Func&& func) const;
+
+    /// Visits the primitives in leaves which overlap a frustum, see Frustum::overlaps().
+    /// Subtrees entirely inside of the frustum are visited without testing their nodes.
+    template <class Func>
+    void query(const Frustum& frustum, Func&& func) const;
+
+  private:
+    /// A leaf if count is not zero, with primitives at primitive_indices_[first .. first + count],
+    /// otherwise an inner node with children at nodes_[first] and nodes_[first + 1].
+    struct Node {
+      Aabb bounds;
+      std::uint32_t first{};
+      std::uint32_t count{};
+    };
+
+    static constexpr auto max_leaf_size = 4U;
+    static constexpr auto bin_count = 16;
+    static constexpr auto max_depth = 64;
+
+    std::vector<Node> nodes_;
+    std::vector<std::uint32_t> node_parents_;  // by node, the root is its own parent
+    std::vector<std::uint32_t> primitive_indices_;
+    std::vector<std::uint32_t> primitive_leaves_;  // by primitive, the leaf containing it
+
+    void build_node(std::uint32_t node_idx, std::span<const Aabb> boxes, std::span<const Vec3> centers, int depth);
+
+    /// The distance at which the ray enters a box, or infinity if it misses it within the maximum distance.
+    static float ray_box_entry(const Aabb& box, const Vec3& origin, const Vec3& inv_direction,
+                               float max_distance) noexcept;
+  };
+
+  template <class HitFunc>
+  float Bvh::raycast(const Ray& ray, float max_distance, HitFunc&& hit) const {
+    if (nodes_.empty()) {
+      return -1;
+    }
+    const auto inv_direction = Vec3{1 / ray.direction[0], 1 / ray.direction[1], 1 / ray.direction[2]};
+    // keep finite, so the infinite entry distance of a missed box is always beyond it
+    max_distance = std::min(max_distance, std::numeric_limits<float>::max());
+    auto closest = -1.F;
+    // nodes to visit with the distance at which the ray enters them
+    auto stack = std::array<std::pair<std::uint32_t, float>, max_depth + 1>{};
+    auto stack_size = 0;
+    if (const auto entry = ray_box_entry(nodes_.front().bounds, ray.origin, inv_direction, max_distance);
+        entry <= max_distance) {
+      stack[stack_size++] = {0, entry};
+    }
+    while (stack_size > 0) {
+      const auto [node_idx, node_entry] = stack[--stack_size];
+      if (node_entry > max_distance) {
+        continue;  // behind a hit found since the node was pushed
+      }
+      const auto& node = nodes_[node_idx];
+      if (node.count != 0) {
+        for (auto i = node.first; i < node.first + node.count; ++i) {
+          const auto distance = hit(primitive_indices_[i], max_distance);
+          if (distance >= 0 && distance <= max_distance) {
+            max_distance = distance;
+            closest = distance;
+          }
+        }
+        continue;
+      }
+      // push the farther child first, so the nearer one is visited next
+      auto near_idx = node.first;
+      auto far_idx = node.first + 1;
+      auto near_entry = ray_box_entry(nodes_[near_idx].bounds, ray.origin, inv_direction, max_distance);
+      auto far_entry = ray_box_entry(nodes_[far_idx].bounds, ray.origin, inv_direction, max_distance);
+      if (far_entry < near_entry) {
+        std::swap(near_idx, far_idx);
+        std::swap(near_entry, far_entry);
+      }
+      if (far_entry <= max_distance) {
+        stack[stack_size++] = {far_idx, far_entry};
+      }
+      if (near_entry <= max_distance) {
+        stack[stack_size++] = {near_idx, near_entry};
+      }
+    }
+    return closest;
+  }
+
+  template <class Func>
+  void Bvh::query(const Aabb& box, Func&& func) const {
+    if (nodes_.empty()) {
+      return;
+    }
+    auto stack = std::array<std::uint32_t, max_depth + 1>{};
+    auto stack_size = 0;
+    stack[stack_size++] = 0;
+    while (stack_size > 0) {
+      const auto& node = nodes_[stack[--stack_size]];
+      if (!node.bounds.overlaps(box)) {
+        continue;
+      }
+      if (node.count != 0) {
+        for (auto i = node.first; i < node.first + node.count; ++i) {
+          func(primitive_indices_[i]);
+        }
+        continue;
+      }
+      stack[stack_size++] = node.first;
+      stack[stack_size++] = node.first + 1;
+    }
+  }
+
+  template <class Func>
+  void Bvh::query(const Frustum& frustum, Func&& func) const {
+    if (nodes_.empty()) {
+      return;
+    }
+    // nodes to visit, and whether they are known to be inside
+    auto stack = std::array<std::pair<std::uint32_t, bool>, max_depth + 1>{};
+    auto stack_size = 0;
+    stack[stack_size++] = {0, false};
+    while (stack_size > 0) {
+      auto [node_idx, is_inside] = stack[--stack_size];
+      const auto& node = nodes_[node_idx];
+      if (!is_inside) {
+        if (!frustum.overlaps(node.bounds)) {
+          continue;
+        }
+        is_inside = frustum.contains(node.bounds);
+      }
+      if (node.count != 0) {
+        for (auto i = node.first; i < node.first + node.count; ++i) {
+          func(primitive_indices_[i]);
+        }
+        continue;
+      }
+      stack[stack_size++] = {node.first, is_inside};
+      stack[stack_size++] = {node.first + 1, is_inside};
+    }
+  }
+}
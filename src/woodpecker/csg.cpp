@@ -0,0 +1,472 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+#include "csg.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include <boost/container/small_vector.hpp>
+#include <woodpecker/mesh_builder.hpp>
+#include <woodpecker/mesh_validation.hpp>
+#include <woodpecker/motor_batch.hpp>
+#include <woodpecker/util/trace.hpp>
+
+namespace wdp {
+  namespace {
+    /// A plane as its unit normal and offset, with `normal · pos + offset = 0` for positions in it.
+    using Plane = std::array<double, 4>;
+
+    /// A convex polygon being cut, with the plane of the face it was cut from, its normal pointing outwards.
+    struct Polygon {
+      boost::container::small_vector<Vec3, 6> vertices;
+      Plane plane{};
+    };
+
+    /// The side of a plane a vertex or polygon lies on, as bit flags.
+    enum Side : unsigned {
+      coplanar = 0,
+      front = 1,
+      back = 2,
+      spanning = front | back,
+    };
+
+    double signed_distance(const Plane& plane, const Vec3& pos) noexcept {
+      // not exact, but its rounding error in double precision is far below the band of side_of()
+      return plane[0] * pos[0] + plane[1] * pos[1] + plane[2] * pos[2] + plane[3];
+    }
+
+    Side side_of(const Plane& plane, const Vec3& pos) noexcept {
+      const auto dist = signed_distance(plane, pos);
+      return dist > Mesh::merge_dist ? front : dist < -Mesh::merge_dist ? back : coplanar;
+    }
+
+    Plane flipped(const Plane& plane) noexcept { return {-plane[0], -plane[1], -plane[2], -plane[3]}; }
+
+    void flip(Polygon& polygon) noexcept {
+      std::ranges::reverse(polygon.vertices);
+      polygon.plane = flipped(polygon.plane);
+    }
+
+    /// Splits a polygon by a plane, appending its pieces to the lists of the sides they lie on.
+    /// Polygons in the plane go to one of the coplanar lists, depending on whether they face the same way.
+    void split_polygon(Polygon polygon, const Plane& plane, std::vector<Polygon>& coplanar_front,
+                       std::vector<Polygon>& coplanar_back, std::vector<Polygon>& front_polygons,
+                       std::vector<Polygon>& back_polygons) {
+      auto polygon_side = unsigned{coplanar};
+      auto sides = boost::container::small_vector<Side, 6>{};
+      for (const auto& pos : polygon.vertices) {
+        sides.push_back(side_of(plane, pos));
+        polygon_side |= sides.back();
+      }
+
+      switch (polygon_side) {
+        case coplanar: {
+          const auto facing = plane[0] * polygon.plane[0] + plane[1] * polygon.plane[1] + plane[2] * polygon.plane[2];
+          (facing > 0 ? coplanar_front : coplanar_back).push_back(std::move(polygon));
+          return;
+        }
+        case front:
+          front_polygons.push_back(std::move(polygon));
+          return;
+        case back:
+          back_polygons.push_back(std::move(polygon));
+          return;
+        default:
+          break;
+      }
+
+      // spanning: walk the edges, adding the crossing point of each edge which crosses the plane to both pieces
+      auto front_piece = Polygon{{}, polygon.plane};
+      auto back_piece = Polygon{{}, polygon.plane};
+      for (auto idx = std::size_t{0}; idx < polygon.vertices.size(); ++idx) {
+        const auto next_idx = (idx + 1) % polygon.vertices.size();
+        const auto& pos = polygon.vertices[idx];
+        const auto& next_pos = polygon.vertices[next_idx];
+        if (sides[idx] != back) {
+          front_piece.vertices.push_back(pos);
+        }
+        if (sides[idx] != front) {
+          back_piece.vertices.push_back(pos);
+        }
+        if ((sides[idx] | sides[next_idx]) == spanning) {
+          const auto dist = signed_distance(plane, pos);
+          const auto t = dist / (dist - signed_distance(plane, next_pos));
+          auto crossing = Vec3{};
+          for (auto axis = std::size_t{0}; axis < 3; ++axis) {
+            crossing[axis] = static_cast<float>(pos[axis] + t * (static_cast<double>(next_pos[axis]) - pos[axis]));
+          }
+          front_piece.vertices.push_back(crossing);
+          back_piece.vertices.push_back(crossing);
+        }
+      }
+      if (front_piece.vertices.size() >= 3) {
+        front_polygons.push_back(std::move(front_piece));
+      }
+      if (back_piece.vertices.size() >= 3) {
+        back_polygons.push_back(std::move(back_piece));
+      }
+    }
+
+    /// A binary space partitioning tree of polygons bounding a solid, with the nodes in a flat array.
+    /// All operations walk the tree iteratively, as trees of large meshes get deep.
+    class Bsp {
+    public:
+      explicit Bsp(std::vector<Polygon> polygons) : nodes_(1) { build(std::move(polygons)); }
+
+      /// Inserts polygons into the tree, splitting them along the planes of its nodes.
+      void build(std::vector<Polygon> polygons) {
+        auto stack = std::vector<std::pair<std::size_t, std::vector<Polygon>>>{};
+        stack.emplace_back(0, std::move(polygons));
+        while (!stack.empty()) {
+          auto [node_idx, node_polygons] = std::move(stack.back());
+          stack.pop_back();
+          if (node_polygons.empty()) {
+            continue;
+          }
+          if (!nodes_[node_idx].plane) {
+            nodes_[node_idx].plane = node_polygons.front().plane;
+          }
+          auto front_polygons = std::vector<Polygon>{};
+          auto back_polygons = std::vector<Polygon>{};
+          for (auto& polygon : node_polygons) {
+            split_polygon(std::move(polygon), *nodes_[node_idx].plane, nodes_[node_idx].polygons,
+                          nodes_[node_idx].polygons, front_polygons, back_polygons);
+          }
+          if (!front_polygons.empty()) {
+            stack.emplace_back(child(node_idx, &Node::front), std::move(front_polygons));
+          }
+          if (!back_polygons.empty()) {
+            stack.emplace_back(child(node_idx, &Node::back), std::move(back_polygons));
+          }
+        }
+      }
+
+      /// Turns the solid inside out.
+      void invert() {
+        for (auto& node : nodes_) {
+          for (auto& polygon : node.polygons) {
+            flip(polygon);
+          }
+          if (node.plane) {
+            node.plane = flipped(*node.plane);
+          }
+          std::swap(node.front, node.back);
+        }
+      }
+
+      /// Removes the parts of polygons inside the solid of this tree.
+      /// Polygons which are not clipped at all are kept whole, rather than as the fragments they were split into.
+      std::vector<Polygon> clip_polygons(std::vector<Polygon> polygons) const {
+        if (!nodes_.front().plane) {
+          return polygons;
+        }
+        auto clipped = std::vector<Polygon>{};
+        auto kept = std::vector<Polygon>{};
+        auto stack = std::vector<std::pair<std::size_t, Polygon>>{};
+        auto front_pieces = std::vector<Polygon>{};
+        auto back_pieces = std::vector<Polygon>{};
+        for (auto& polygon : polygons) {
+          kept.clear();
+          auto discarded = false;
+          stack.emplace_back(0, polygon);
+          while (!stack.empty()) {
+            auto [node_idx, piece] = std::move(stack.back());
+            stack.pop_back();
+            const auto& node = nodes_[node_idx];
+            front_pieces.clear();
+            back_pieces.clear();
+            split_polygon(std::move(piece), *node.plane, front_pieces, back_pieces, front_pieces, back_pieces);
+            for (auto& front_piece : front_pieces) {
+              if (node.front != no_node) {
+                stack.emplace_back(node.front, std::move(front_piece));
+              } else {
+                kept.push_back(std::move(front_piece));
+              }
+            }
+            if (node.back != no_node) {
+              for (auto& back_piece : back_pieces) {
+                stack.emplace_back(node.back, std::move(back_piece));
+              }
+            } else {
+              discarded = discarded || !back_pieces.empty();
+            }
+          }
+          if (discarded) {
+            std::ranges::move(kept, std::back_inserter(clipped));
+          } else {
+            clipped.push_back(std::move(polygon));
+          }
+        }
+        return clipped;
+      }
+
+      /// Removes the parts of the polygons of this tree inside the solid of another tree.
+      void clip_to(const Bsp& other) {
+        for (auto& node : nodes_) {
+          node.polygons = other.clip_polygons(std::move(node.polygons));
+        }
+      }
+
+      std::vector<Polygon> all_polygons() const {
+        auto polygons = std::vector<Polygon>{};
+        for (const auto& node : nodes_) {
+          polygons.insert(polygons.end(), node.polygons.begin(), node.polygons.end());
+        }
+        return polygons;
+      }
+
+    private:
+      static constexpr auto no_node = std::numeric_limits<std::size_t>::max();
+
+      struct Node {
+        std::optional<Plane> plane;
+        std::vector<Polygon> polygons;  // in the plane of the node
+        std::size_t front{no_node};
+        std::size_t back{no_node};
+      };
+
+      std::vector<Node> nodes_;
+
+      /// The index of a child of a node, which is added if missing.
+      std::size_t child(std::size_t node_idx, std::size_t Node::*member) {
+        if (nodes_[node_idx].*member == no_node) {
+          nodes_[node_idx].*member = nodes_.size();
+          nodes_.emplace_back();
+        }
+        return nodes_[node_idx].*member;
+      }
+    };
+
+    /// The cached triangles of a mesh as polygons, each with the plane of its face,
+    /// oriented by the winding of the triangle.
+    std::vector<Polygon> mesh_polygons(const Mesh& mesh, std::span<const Vec3> positions,
+                                       const std::optional<kln::motor>& motor) {
+      auto face_planes = std::vector<std::optional<Plane>>(mesh.face_count());
+      auto polygons = std::vector<Polygon>{};
+      polygons.reserve(mesh.triangles().size());
+      for (auto triangle_idx = std::size_t{0}; triangle_idx < mesh.triangles().size(); ++triangle_idx) {
+        const auto& triangle = mesh.triangles()[triangle_idx];
+        auto polygon = Polygon{{positions[triangle[0]], positions[triangle[1]], positions[triangle[2]]}, {}};
+
+        const auto face_idx = mesh.triangle_face(triangle_idx);
+        auto& plane = face_planes[face_idx];
+        if (!plane) {
+          const auto face_plane = motor ? (*motor)(mesh.face(face_idx).plane) : mesh.face(face_idx).plane;
+          const auto norm = static_cast<double>(face_plane.norm());
+          plane = Plane{face_plane.x() / norm, face_plane.y() / norm, face_plane.z() / norm, face_plane.d() / norm};
+        }
+
+        // orient the plane like the triangle, as the sign of the plane depends on how it was constructed
+        const auto& a = polygon.vertices[0];
+        const auto& b = polygon.vertices[1];
+        const auto& c = polygon.vertices[2];
+        const auto cross = Vec3{(b[1] - a[1]) * (c[2] - a[2]) - (b[2] - a[2]) * (c[1] - a[1]),
+                                (b[2] - a[2]) * (c[0] - a[0]) - (b[0] - a[0]) * (c[2] - a[2]),
+                                (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0])};
+        const auto facing = (*plane)[0] * cross[0] + (*plane)[1] * cross[1] + (*plane)[2] * cross[2];
+        if (facing != 0) {
+          polygon.plane = facing > 0 ? *plane : flipped(*plane);
+          polygons.push_back(std::move(polygon));
+        }
+      }
+      return polygons;
+    }
+
+    std::vector<Polygon> mesh_polygons(const Mesh& mesh) {
+      auto positions = std::vector<Vec3>{};
+      positions.reserve(mesh.vertices().size());
+      for (const auto& vtx : mesh.vertices()) {
+        const auto pos = vtx.pos.normalized();
+        positions.push_back({pos.x(), pos.y(), pos.z()});
+      }
+      return mesh_polygons(mesh, positions, std::nullopt);
+    }
+
+    std::vector<Polygon> mesh_polygons(const Mesh& mesh, const kln::motor& motor) {
+      auto positions = std::vector<Vec3>(mesh.vertices().size());
+      apply_motor(motor, mesh.vertices(), positions);
+      return mesh_polygons(mesh, positions, motor);
+    }
+
+    /// Welds polygons into a mesh, merging the coplanar fragments of each face again where possible.
+    /// Fragments split along the planes of other faces leave T-junctions between them, which are closed by repairing.
+    Mesh build_mesh(const std::vector<Polygon>& polygons) {
+      auto builder = MeshBuilder{};
+      auto vertices = std::vector<Vertex>{};
+      auto face_vertices = std::vector<VertexIndex>{};
+      auto face_sizes = std::vector<VertexIndex>{};
+      for (const auto& polygon : polygons) {
+        for (const auto& pos : polygon.vertices) {
+          face_vertices.push_back(static_cast<VertexIndex>(vertices.size()));
+          vertices.push_back({kln::point{pos[0], pos[1], pos[2]}});
+        }
+        face_sizes.push_back(static_cast<VertexIndex>(polygon.vertices.size()));
+      }
+      builder.add_vertices(vertices);
+      builder.add_faces(face_vertices, face_sizes);
+      auto mesh = builder.build({.repair_faces = true, .merge_coplanar_faces = true});
+      repair_mesh(mesh);
+      return mesh;
+    }
+
+    Mesh unite(std::vector<Polygon> a_polygons, std::vector<Polygon> b_polygons) {
+      WDP_TRACE_SCOPE("mesh_union");
+      auto a = Bsp{std::move(a_polygons)};
+      auto b = Bsp{std::move(b_polygons)};
+      a.clip_to(b);
+      b.clip_to(a);
+      b.invert();
+      b.clip_to(a);
+      b.invert();
+      a.build(b.all_polygons());
+      return build_mesh(a.all_polygons());
+    }
+
+    Mesh subtract(std::vector<Polygon> a_polygons, std::vector<Polygon> b_polygons) {
+      WDP_TRACE_SCOPE("mesh_difference");
+      auto a = Bsp{std::move(a_polygons)};
+      auto b = Bsp{std::move(b_polygons)};
+      a.invert();
+      a.clip_to(b);
+      b.clip_to(a);
+      b.invert();
+      b.clip_to(a);
+      b.invert();
+      a.build(b.all_polygons());
+      a.invert();
+      return build_mesh(a.all_polygons());
+    }
+
+    Mesh intersect(std::vector<Polygon> a_polygons, std::vector<Polygon> b_polygons) {
+      WDP_TRACE_SCOPE("mesh_intersection");
+      auto a = Bsp{std::move(a_polygons)};
+      auto b = Bsp{std::move(b_polygons)};
+      a.invert();
+      b.clip_to(a);
+      b.invert();
+      a.clip_to(b);
+      b.clip_to(a);
+      a.build(b.all_polygons());
+      a.invert();
+      return build_mesh(a.all_polygons());
+    }
+
+    /// The faces of a box behind a plane, large enough to contain a sphere around a center.
+    /// The face of the box in the plane keeps the plane exactly.
+    std::vector<Polygon> half_space_polygons(const Plane& plane, const Vec3& center, double radius) {
+      using DVec3 = std::array<double, 3>;
+      const auto normal = DVec3{plane[0], plane[1], plane[2]};
+      const auto cross = [](const DVec3& lhs, const DVec3& rhs) {
+        return DVec3{lhs[1] * rhs[2] - lhs[2] * rhs[1], lhs[2] * rhs[0] - lhs[0] * rhs[2],
+                     lhs[0] * rhs[1] - lhs[1] * rhs[0]};
+      };
+
+      // an orthonormal frame in the plane, around the center projected into it
+      const auto min_axis = static_cast<std::size_t>(std::ranges::min_element(normal, {}, [](double coord) {
+                                                       return std::abs(coord);
+                                                     }) -
+                                                     normal.begin());
+      auto axis = DVec3{};
+      axis[min_axis] = 1;
+      auto u = cross(normal, axis);
+      const auto u_length = std::hypot(u[0], u[1], u[2]);
+      for (auto& coord : u) {
+        coord /= u_length;
+      }
+      const auto v = cross(normal, u);
+      const auto center_dist = signed_distance(plane, center);
+
+      // corners by their signs along u and v, and whether they lie on the plane or behind the far side of the sphere
+      const auto depth = std::abs(center_dist) + 2 * radius;
+      const auto corner = [&](int u_sign, int v_sign, bool on_plane) {
+        auto pos = Vec3{};
+        for (auto axis_idx = std::size_t{0}; axis_idx < 3; ++axis_idx) {
+          pos[axis_idx] = static_cast<float>(center[axis_idx] - center_dist * normal[axis_idx] +
+                                             radius * (u_sign * u[axis_idx] + v_sign * v[axis_idx]) -
+                                             (on_plane ? 0 : depth * normal[axis_idx]));
+        }
+        return pos;
+      };
+      const auto quad = [&](const Plane& quad_plane, std::array<Vec3, 4> corners) {
+        return Polygon{{corners.begin(), corners.end()}, quad_plane};
+      };
+      const auto side_plane = [&](const DVec3& outward, const Vec3& pos) {
+        return Plane{outward[0], outward[1], outward[2],
+                     -(outward[0] * pos[0] + outward[1] * pos[1] + outward[2] * pos[2])};
+      };
+      const auto neg = [](const DVec3& dir) { return DVec3{-dir[0], -dir[1], -dir[2]}; };
+
+      // counter-clockwise from outside, as (u, v, normal) is right-handed
+      return {
+          quad(plane, {corner(-1, -1, true), corner(1, -1, true), corner(1, 1, true), corner(-1, 1, true)}),
+          quad(side_plane(neg(normal), corner(-1, -1, false)),
+               {corner(-1, -1, false), corner(-1, 1, false), corner(1, 1, false), corner(1, -1, false)}),
+          quad(side_plane(u, corner(1, -1, true)),
+               {corner(1, -1, true), corner(1, -1, false), corner(1, 1, false), corner(1, 1, true)}),
+          quad(side_plane(neg(u), corner(-1, -1, true)),
+               {corner(-1, -1, true), corner(-1, 1, true), corner(-1, 1, false), corner(-1, -1, false)}),
+          quad(side_plane(v, corner(-1, 1, true)),
+               {corner(-1, 1, true), corner(1, 1, true), corner(1, 1, false), corner(-1, 1, false)}),
+          quad(side_plane(neg(v), corner(-1, -1, true)),
+               {corner(-1, -1, true), corner(-1, -1, false), corner(1, -1, false), corner(1, -1, true)}),
+      };
+    }
+  }
+
+  Mesh mesh_union(const Mesh& a, const Mesh& b, const kln::motor& b_motor) {
+    return unite(mesh_polygons(a), mesh_polygons(b, b_motor));
+  }
+
+  Mesh mesh_union(const Mesh& a, const Mesh& b) { return unite(mesh_polygons(a), mesh_polygons(b)); }
+
+  Mesh mesh_difference(const Mesh& a, const Mesh& b, const kln::motor& b_motor) {
+    return subtract(mesh_polygons(a), mesh_polygons(b, b_motor));
+  }
+
+  Mesh mesh_difference(const Mesh& a, const Mesh& b) { return subtract(mesh_polygons(a), mesh_polygons(b)); }
+
+  Mesh mesh_intersection(const Mesh& a, const Mesh& b, const kln::motor& b_motor) {
+    return intersect(mesh_polygons(a), mesh_polygons(b, b_motor));
+  }
+
+  Mesh mesh_intersection(const Mesh& a, const Mesh& b) { return intersect(mesh_polygons(a), mesh_polygons(b)); }
+
+  std::array<Mesh, 2> split_mesh(const Mesh& mesh, const kln::plane& plane) {
+    WDP_TRACE_SCOPE("split_mesh");
+    const auto bounds = mesh.bounds();
+    if (bounds.empty()) {
+      return {};
+    }
+    const auto norm = static_cast<double>(plane.norm());
+    const auto front_plane = Plane{plane.x() / norm, plane.y() / norm, plane.z() / norm, plane.d() / norm};
+
+    // intersect with boxes behind the plane and behind the flipped plane, reaching beyond the mesh
+    const auto center = bounds.center();
+    const auto radius = 1 + std::hypot(static_cast<double>(bounds.max[0]) - bounds.min[0],
+                                       static_cast<double>(bounds.max[1]) - bounds.min[1],
+                                       static_cast<double>(bounds.max[2]) - bounds.min[2]);
+    const auto polygons = mesh_polygons(mesh);
+    return {intersect(polygons, half_space_polygons(flipped(front_plane), center, radius)),
+            intersect(polygons, half_space_polygons(front_plane, center, radius))};
+  }
+}
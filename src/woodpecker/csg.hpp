@@ -0,0 +1,55 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+#include <array>
+
+#include <woodpecker/mesh.hpp>
+#include <woodpecker/pga.hpp>
+
+namespace wdp {
+  // Boolean operations on closed meshes, for cutting joints such as miters, dowel holes and dados.
+  //
+  // The operands are split along the planes of each other's faces in binary space partitioning trees,
+  // as in the classic csg.js algorithm. Each fragment keeps the plane of the face it was cut from,
+  // so cuts are decided against the planes stored in the meshes, never against planes refitted to rounded vertices.
+  // A vertex is classified against a plane by the plane equation evaluated in double precision, and counts as lying
+  // in the plane within an epsilon band of Mesh::merge_dist. The evaluation rounds, but far below the band for
+  // coordinates of any practical size. The band absorbs the rounding of the vertices created by earlier cuts,
+  // which would otherwise leave slivers and cracks.
+  // The fragments are welded back into polygonal faces by MeshBuilder, merging coplanar fragments,
+  // and the T-junctions left between fragments cut along different planes are closed by repair_mesh().
+  //
+  // The operands must be closed and consistently wound, with faces counter-clockwise when viewed from outside.
+
+  /// The union of two solids, where `b` is first moved by a motor into the space of `a`.
+  Mesh mesh_union(const Mesh& a, const Mesh& b, const kln::motor& b_motor);
+  Mesh mesh_union(const Mesh& a, const Mesh& b);
+
+  /// The solid `a` without the solid `b`, where `b` is first moved by a motor into the space of `a`.
+  Mesh mesh_difference(const Mesh& a, const Mesh& b, const kln::motor& b_motor);
+  Mesh mesh_difference(const Mesh& a, const Mesh& b);
+
+  /// The intersection of two solids, where `b` is first moved by a motor into the space of `a`.
+  Mesh mesh_intersection(const Mesh& a, const Mesh& b, const kln::motor& b_motor);
+  Mesh mesh_intersection(const Mesh& a, const Mesh& b);
+
+  /// Splits a solid by a plane into two closed solids.
+  /// \return The parts in front of the plane, towards which its normal points, and behind it.
+  ///         Either is empty if the plane does not cut the solid.
+  std::array<Mesh, 2> split_mesh(const Mesh& mesh, const kln::plane& plane);
+}
@@ -0,0 +1,271 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "interference.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <tuple>
+#include <utility>
+
+#include <woodpecker/util/cast.hpp>
+#include <woodpecker/util/trace.hpp>
+#include <woodpecker/vertex_grid.hpp>
+
+namespace wdp {
+  namespace {
+    Vec3 sub(const Vec3& a, const Vec3& b) noexcept { return {a[0] - b[0], a[1] - b[1], a[2] - b[2]}; }
+
+    Vec3 cross(const Vec3& a, const Vec3& b) noexcept {
+      return {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+    }
+
+    float dot(const Vec3& a, const Vec3& b) noexcept { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+
+    /// The minimum squared length of a cross product of unit vectors for them to count as non-parallel.
+    constexpr auto parallel_tolerance = 1e-10F;
+
+    /// Collects unit directions without zero or parallel duplicates.
+    /// Beyond a few directions, as of curved or profiled parts, they are hashed in a grid,
+    /// so adding one takes constant time rather than time linear in those added.
+    class UniqueDirections {
+    public:
+      explicit UniqueDirections(std::vector<Vec3>& directions) : directions_{directions} {}
+
+      /// Adds a direction, unless it is zero or parallel to one added before.
+      void add(Vec3 dir) {
+        const auto len = std::sqrt(dot(dir, dir));
+        if (len < Mesh::merge_dist) {
+          return;
+        }
+        dir = {dir[0] / len, dir[1] / len, dir[2] / len};
+        const auto is_parallel = [&](const Vec3& other) {
+          const auto crossed = cross(dir, other);
+          return dot(crossed, crossed) < parallel_tolerance;
+        };
+        if (directions_.size() <= max_scanned_count) {
+          if (std::ranges::any_of(directions_, is_parallel)) {
+            return;
+          }
+        } else {
+          for (; gridded_count_ < directions_.size(); ++gridded_count_) {
+            const auto& other = directions_[gridded_count_];
+            grid_.insert(kln::point{other[0], other[1], other[2]}, narrow<VertexIndex>(gridded_count_));
+          }
+          // opposite directions are parallel as well
+          const auto is_parallel_at = [&](VertexIndex index) { return is_parallel(directions_[index]); };
+          if (grid_.find(kln::point{dir[0], dir[1], dir[2]}, is_parallel_at) ||
+              grid_.find(kln::point{-dir[0], -dir[1], -dir[2]}, is_parallel_at)) {
+            return;
+          }
+        }
+        directions_.push_back(dir);
+      }
+
+    private:
+      /// The number of directions up to which they are scanned rather than hashed, enough for boards.
+      static constexpr auto max_scanned_count = std::size_t{32};
+
+      std::vector<Vec3>& directions_;
+      std::size_t gridded_count_{};
+      // parallel unit directions are closer than about the square root of the tolerance, well within half a cell
+      VertexGrid grid_{4 * std::sqrt(parallel_tolerance)};
+    };
+
+    /// The smallest overlap of two shapes' projections onto candidate axes,
+    /// or nothing if an axis separates them.
+    class SeparatingAxisTest {
+    public:
+      SeparatingAxisTest(const std::vector<Vec3>& positions_a, const std::vector<Vec3>& positions_b)
+          : positions_a_{positions_a}, positions_b_{positions_b} {}
+
+      /// Projects both shapes onto an axis.
+      /// \return Whether the shapes still overlap, false once a separating axis was found.
+      bool test(Vec3 axis) {
+        const auto len = std::sqrt(dot(axis, axis));
+        if (len < std::sqrt(parallel_tolerance)) {
+          return true;  // degenerate axis from parallel edges, covered by the face normals
+        }
+        axis = {axis[0] / len, axis[1] / len, axis[2] / len};
+        const auto [min_a, max_a] = project(positions_a_, axis);
+        const auto [min_b, max_b] = project(positions_b_, axis);
+        // moving b along the axis, or against it, separates the shapes
+        const auto forward = max_a - min_b;
+        const auto backward = max_b - min_a;
+        const auto overlap = std::min(forward, backward);
+        if (overlap <= Mesh::merge_dist) {
+          return false;
+        }
+        if (overlap < depth_) {
+          depth_ = overlap;
+          axis_ = forward < backward ? axis : Vec3{-axis[0], -axis[1], -axis[2]};
+        }
+        return true;
+      }
+
+      float depth() const noexcept { return depth_; }
+      const Vec3& axis() const noexcept { return axis_; }
+
+    private:
+      const std::vector<Vec3>& positions_a_;
+      const std::vector<Vec3>& positions_b_;
+      float depth_{std::numeric_limits<float>::infinity()};
+      Vec3 axis_{};
+
+      static std::pair<float, float> project(const std::vector<Vec3>& positions, const Vec3& axis) noexcept {
+        auto min = std::numeric_limits<float>::infinity();
+        auto max = -std::numeric_limits<float>::infinity();
+        for (const auto& pos : positions) {
+          const auto dist = dot(pos, axis);
+          min = std::min(min, dist);
+          max = std::max(max, dist);
+        }
+        return {min, max};
+      }
+    };
+  }
+
+  const std::vector<Interference>& InterferenceDetector::update(const Scene& scene) {
+    WDP_TRACE_SCOPE("InterferenceDetector::update");
+    ++generation_;
+
+    // update the shapes of changed parts
+    auto changed_ids = std::unordered_set<PartId>{};
+    for (const auto& part : scene.parts()) {
+      const auto [iter, inserted] = part_shapes_.try_emplace(part.id());
+      auto& part_shape = iter->second;
+      if (inserted || part_shape.mesh_revision != part.mesh_revision() ||
+          part_shape.motor_revision != part.motor_revision()) {
+        part_shape.shape = make_shape(part);
+        part_shape.mesh_revision = part.mesh_revision();
+        part_shape.motor_revision = part.motor_revision();
+        changed_ids.insert(part.id());
+      }
+      if (inserted) {
+        sweep_order_.push_back({part.id(), &part_shape});
+      }
+      part_shape.generation = generation_;
+    }
+
+    // forget parts not seen in this update
+    std::erase_if(sweep_order_, [&](const SweepEntry& entry) {
+      if (entry.part_shape->generation == generation_) {
+        return false;
+      }
+      changed_ids.insert(entry.id);
+      return true;
+    });
+    std::erase_if(part_shapes_, [&](const auto& entry) { return entry.second.generation != generation_; });
+    if (!changed_ids.empty()) {
+      update_overlaps(changed_ids);
+    }
+
+    // joints may have changed without any part moving, so they are applied to all overlaps
+    const auto is_jointed = [&](const Interference& overlap) {
+      return std::ranges::any_of(scene.part_joints(overlap.parts[0]), [&](JointId joint_id) {
+        const auto& joint_parts = scene.find_joint(joint_id)->parts;
+        return joint_parts[0] == overlap.parts[1] || joint_parts[1] == overlap.parts[1];
+      });
+    };
+    interferences_.clear();
+    std::ranges::remove_copy_if(overlaps_, std::back_inserter(interferences_), is_jointed);
+    return interferences_;
+  }
+
+  void InterferenceDetector::update_overlaps(const std::unordered_set<PartId>& changed_ids) {
+    // overlaps between unchanged parts stay valid
+    std::erase_if(overlaps_, [&](const Interference& interference) {
+      return changed_ids.contains(interference.parts[0]) || changed_ids.contains(interference.parts[1]);
+    });
+
+    // insertion sort, which takes linear time when only a few parts moved since the last update
+    const auto min_x = [](const SweepEntry& entry) { return entry.part_shape->shape.bounds.min[0]; };
+    for (std::size_t i = 1; i < sweep_order_.size(); ++i) {
+      const auto entry = sweep_order_[i];
+      auto j = i;
+      for (; j > 0 && min_x(sweep_order_[j - 1]) > min_x(entry); --j) {
+        sweep_order_[j] = sweep_order_[j - 1];
+      }
+      sweep_order_[j] = entry;
+    }
+
+    // sweep along x, keeping the parts whose x-interval contains the current position
+    auto active = std::vector<SweepEntry>{};
+    for (const auto& entry : sweep_order_) {
+      const auto& shape = entry.part_shape->shape;
+      std::erase_if(active, [&](const SweepEntry& other) {
+        return other.part_shape->shape.bounds.max[0] < shape.bounds.min[0];
+      });
+      const auto changed = changed_ids.contains(entry.id);
+      for (const auto& other : active) {
+        const auto& other_shape = other.part_shape->shape;
+        if ((!changed && !changed_ids.contains(other.id)) || !shape.bounds.overlaps(other_shape.bounds)) {
+          continue;
+        }
+        // narrow phase, the smaller identifier first
+        const auto& [id_a, shape_a, id_b, shape_b] = entry.id < other.id
+                                                         ? std::tuple{entry.id, &shape, other.id, &other_shape}
+                                                         : std::tuple{other.id, &other_shape, entry.id, &shape};
+        auto sat = SeparatingAxisTest{shape_a->positions, shape_b->positions};
+        const auto overlaps = [&] {
+          for (const auto* normals : {&shape_a->face_normals, &shape_b->face_normals}) {
+            for (const auto& normal : *normals) {
+              if (!sat.test(normal)) {
+                return false;
+              }
+            }
+          }
+          for (const auto& edge_a : shape_a->edge_directions) {
+            for (const auto& edge_b : shape_b->edge_directions) {
+              if (!sat.test(cross(edge_a, edge_b))) {
+                return false;
+              }
+            }
+          }
+          return true;
+        }();
+        if (overlaps) {
+          overlaps_.push_back({{id_a, id_b}, sat.depth(), sat.axis()});
+        }
+      }
+      active.push_back(entry);
+    }
+  }
+
+  InterferenceDetector::ConvexShape InterferenceDetector::make_shape(const Part& part) {
+    const auto& mesh = part.mesh();
+    auto shape = ConvexShape{};
+    shape.positions.resize(mesh.vertices().size());
+    part.world_positions(shape.positions);
+    for (const auto& pos : shape.positions) {
+      shape.bounds.extend(pos);
+    }
+    auto face_normals = UniqueDirections{shape.face_normals};
+    auto edge_directions = UniqueDirections{shape.edge_directions};
+    for (const auto& face : mesh.faces()) {
+      const auto plane = part.motor()(face.plane);
+      face_normals.add({plane.x(), plane.y(), plane.z()});
+      for (std::size_t i = 0; i < face.vertices.size(); ++i) {
+        const auto next = (i + 1) % face.vertices.size();
+        edge_directions.add(sub(shape.positions[face.vertices[next]], shape.positions[face.vertices[i]]));
+      }
+    }
+    return shape;
+  }
+}
@@ -0,0 +1,90 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <woodpecker/bvh.hpp>
+#include <woodpecker/scene.hpp>
+
+namespace wdp {
+  /// An overlap between two parts of a Scene.
+  struct Interference {
+    std::array<PartId, 2> parts{};  ///< The overlapping parts, the smaller identifier first.
+    float depth{};                  ///< The penetration depth, the shortest distance which separates the parts.
+    Vec3 axis{};                    ///< The unit direction in which moving the second part by depth separates them.
+  };
+
+  /// Detects overlaps between the parts of a Scene.
+  /// Candidate pairs are found by sweep and prune on the world bounds along the x-axis,
+  /// then tested exactly with the separating axis theorem, using the face planes and edges of the part meshes.
+  /// Parts are treated as convex: their vertices are projected onto the face normals of both meshes and the cross
+  /// products of their edge directions. For a concave part the projections are those of its convex hull, but faces
+  /// of the hull which the mesh lacks add no axes. So it is reported wherever its hull overlaps the other part,
+  /// and possibly also where only such an axis would separate them.
+  /// Parts which merely touch, within Mesh::merge_dist, do not overlap,
+  /// and parts connected by a joint are expected to and not reported.
+  ///
+  /// The world-space shapes and detected overlaps are kept between updates, so only the parts
+  /// which were added, moved or given another mesh since the previous update are tested again, e.g. while dragging.
+  class InterferenceDetector {
+  public:
+    /// Updates the detected overlaps to the current state of the scene.
+    /// \return All overlapping pairs of parts, in no particular order.
+    const std::vector<Interference>& update(const Scene& scene);
+
+    /// The overlaps found by the last update.
+    const std::vector<Interference>& interferences() const noexcept { return interferences_; }
+
+  private:
+    /// The world-space geometry of a part, as needed by the separating axis test.
+    struct ConvexShape {
+      std::vector<Vec3> positions;
+      std::vector<Vec3> face_normals;     // unit length, without parallel duplicates
+      std::vector<Vec3> edge_directions;  // unit length, without parallel duplicates
+      Aabb bounds;
+    };
+
+    struct PartShape {
+      ConvexShape shape;
+      Revision mesh_revision{};
+      Revision motor_revision{};
+      std::uint64_t generation{};  // of the last update which saw the part
+    };
+
+    struct SweepEntry {
+      PartId id{};
+      const PartShape* part_shape{};
+    };
+
+    std::unordered_map<PartId, PartShape> part_shapes_;
+    std::vector<SweepEntry> sweep_order_;  // by the minimum x of the bounds, nearly sorted between updates
+    std::vector<Interference> overlaps_;  // including jointed parts, kept until one of the parts changes
+    std::vector<Interference> interferences_;
+    std::uint64_t generation_{};
+
+    static ConvexShape make_shape(const Part& part);
+
+    /// Tests the pairs involving changed parts again, keeping the overlaps of all other pairs.
+    void update_overlaps(const std::unordered_set<PartId>& changed_ids);
+  };
+}
@@ -18,6 +18,7 @@
 #pragma once
 
 #include <array>
+#include <cstdint>
 #include <memory>
 
 #include <woodpecker/part.hpp>
@@ -43,8 +44,13 @@ namespace wdp {
     Fastener fastener;
   };
 
+  /// An identifier of a joint in a Scene, stable for the lifetime of the joint and never reused.
+  using JointId = std::uint32_t;
+
+  /// A rigid connection between two parts of a Scene.
   struct Joint {
     std::unique_ptr<JointTypeBase> type;
-    std::array<const Part*, 2> parts;
+    /// The connected parts. In the kinematic tree of the scene, the second part follows the first.
+    std::array<PartId, 2> parts{};
   };
 }
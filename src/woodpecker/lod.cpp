@@ -0,0 +1,181 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "lod.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+#include <woodpecker/mesh_builder.hpp>
+#include <woodpecker/vertex_grid.hpp>
+#include <woodpecker/util/assert.hpp>
+#include <woodpecker/util/cast.hpp>
+#include <woodpecker/util/trace.hpp>
+
+namespace wdp {
+  namespace {
+    /// The fraction of the largest extent of a mesh below which details collapse in its simplified mesh.
+    constexpr auto simplified_cell_fraction = 1.F / 16;
+
+    /// A vertex cluster, summing the positions of its vertices.
+    struct Cluster {
+      std::array<double, 3> sum{};
+      std::size_t count{};
+    };
+  }
+
+  float screen_size(const Aabb& box, const CameraView& view) noexcept {
+    const auto center = box.center();
+    auto radius_sq = 0.F;
+    auto distance_sq = 0.F;
+    for (auto axis = 0; axis < 3; ++axis) {
+      const auto half_extent = (box.max[axis] - box.min[axis]) / 2;
+      radius_sq += half_extent * half_extent;
+      const auto offset = center[axis] - view.eye[axis];
+      distance_sq += offset * offset;
+    }
+    if (distance_sq <= radius_sq) {
+      return std::numeric_limits<float>::infinity();
+    }
+    return 2 * std::sqrt(radius_sq / distance_sq) * view.pixels_per_unit;
+  }
+
+  std::optional<DetailLevel> select_detail_level(float screen_size, const DetailThresholds& thresholds) noexcept {
+    if (screen_size < thresholds.culled) {
+      return std::nullopt;
+    }
+    if (screen_size < thresholds.cuboid) {
+      return DetailLevel::cuboid;
+    }
+    if (screen_size < thresholds.simplified) {
+      return DetailLevel::simplified;
+    }
+    return DetailLevel::full;
+  }
+
+  std::vector<VisiblePart> visible_parts(const Scene& scene, const CameraView& view,
+                                         const DetailThresholds& thresholds) {
+    WDP_TRACE_SCOPE("visible_parts");
+    const auto parts = scene.query_parts(view.frustum);
+    auto visible = std::vector<VisiblePart>{};
+    visible.reserve(parts.size());
+    for (const auto& part : parts) {
+      if (const auto level = select_detail_level(screen_size(part.bounds, view), thresholds)) {
+        visible.push_back({part.part, *level});
+      }
+    }
+    return visible;
+  }
+
+  Mesh simplify_mesh(const Mesh& mesh, float cell_size) {
+    WDP_TRACE_SCOPE("simplify_mesh");
+    WDP_ASSERT_CHEAP(cell_size > 0);
+
+    // merge the vertices of each cell into a cluster, using the cells of a vertex grid
+    const auto grid = VertexGrid{cell_size};
+    const auto& vertices = mesh.vertices();
+    auto cluster_indices = std::unordered_map<VertexGrid::CellKey, VertexIndex, VertexGrid::CellKeyHash>{};
+    auto clusters = std::vector<Cluster>{};
+    auto vertex_clusters = std::vector<VertexIndex>{};
+    vertex_clusters.reserve(vertices.size());
+    for (const auto& vtx : vertices) {
+      const auto pos = vtx.pos.normalized();
+      const auto [iter, inserted] =
+          cluster_indices.try_emplace(grid.cell_of(pos), narrow<VertexIndex>(clusters.size()));
+      if (inserted) {
+        clusters.emplace_back();
+      }
+      auto& cluster = clusters[iter->second];
+      cluster.sum[0] += pos.x();
+      cluster.sum[1] += pos.y();
+      cluster.sum[2] += pos.z();
+      ++cluster.count;
+      vertex_clusters.push_back(iter->second);
+    }
+
+    // rebuild the faces on the cluster means, repairing those which collapsed
+    auto builder = MeshBuilder{};
+    builder.reserve(clusters.size(), mesh.face_count(), mesh.face_vertex_count());
+    auto cluster_vertices = std::vector<Vertex>{};
+    cluster_vertices.reserve(clusters.size());
+    for (const auto& cluster : clusters) {
+      const auto count = static_cast<double>(cluster.count);
+      cluster_vertices.push_back({kln::point{static_cast<float>(cluster.sum[0] / count),
+                                             static_cast<float>(cluster.sum[1] / count),
+                                             static_cast<float>(cluster.sum[2] / count)}});
+    }
+    builder.add_vertices(cluster_vertices);
+    auto face_vertices = std::vector<VertexIndex>{};
+    for (const auto& face : mesh.faces()) {
+      face_vertices.clear();
+      for (const auto vertex_index : face.vertices) {
+        face_vertices.push_back(vertex_clusters[vertex_index]);
+      }
+      builder.add_face(face_vertices);
+    }
+    return builder.build({.repair_faces = true, .merge_coplanar_faces = true});
+  }
+
+  Mesh bounding_cuboid_mesh(const Mesh& mesh) {
+    const auto bounds = mesh.bounds();
+    if (bounds.empty()) {
+      return {};
+    }
+    auto builder = MeshBuilder{};
+    auto corners = std::array<Vertex, 8>{};
+    for (auto corner = 0; corner < 8; ++corner) {
+      const auto x = (corner & 1) != 0 ? bounds.max[0] : bounds.min[0];
+      const auto y = (corner & 2) != 0 ? bounds.max[1] : bounds.min[1];
+      const auto z = (corner & 4) != 0 ? bounds.max[2] : bounds.min[2];
+      corners[static_cast<std::size_t>(corner)] = {kln::point{x, y, z}};
+    }
+    builder.add_vertices(corners);
+    // counter-clockwise seen from outside, faces of a flat cuboid without area are dropped by the repair
+    constexpr auto faces = std::array<std::array<VertexIndex, 4>, 6>{{
+        {0, 4, 6, 2},  // -x
+        {1, 3, 7, 5},  // +x
+        {0, 1, 5, 4},  // -y
+        {2, 6, 7, 3},  // +y
+        {0, 2, 3, 1},  // -z
+        {4, 5, 7, 6},  // +z
+    }};
+    for (const auto& face : faces) {
+      builder.add_face(face);
+    }
+    return builder.build({.repair_faces = true});
+  }
+
+  Mesh make_detail_mesh(const Mesh& mesh, DetailLevel level) {
+    WDP_ASSERT_CHEAP(level != DetailLevel::full);
+    if (level == DetailLevel::cuboid) {
+      return bounding_cuboid_mesh(mesh);
+    }
+    const auto bounds = mesh.bounds();
+    if (bounds.empty()) {
+      return {};
+    }
+    const auto extent = std::max({bounds.max[0] - bounds.min[0], bounds.max[1] - bounds.min[1],
+                                  bounds.max[2] - bounds.min[2]});
+    if (extent <= 0) {
+      return bounding_cuboid_mesh(mesh);
+    }
+    return simplify_mesh(mesh, extent * simplified_cell_fraction);
+  }
+}
@@ -0,0 +1,82 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <woodpecker/bvh.hpp>
+#include <woodpecker/mesh.hpp>
+#include <woodpecker/scene.hpp>
+
+namespace wdp {
+  /// How detailed a part is drawn, chosen by its size on screen.
+  enum class DetailLevel : std::uint8_t {
+    full,        ///< The mesh of the part.
+    simplified,  ///< The mesh with details collapsed, see simplify_mesh().
+    cuboid       ///< The bounding cuboid of the mesh, see bounding_cuboid_mesh().
+  };
+
+  constexpr auto detail_level_count = std::size_t{3};
+
+  /// The sizes on screen in pixels below which parts are drawn at a coarser level of detail, or not at all.
+  struct DetailThresholds {
+    float simplified{128};
+    float cuboid{24};
+    float culled{1.5F};
+  };
+
+  /// The view of a perspective camera, for culling parts and choosing their levels of detail.
+  struct CameraView {
+    Frustum frustum;
+    Vec3 eye{};                ///< The position of the camera in world space.
+    float pixels_per_unit{1};  ///< The viewport height in pixels divided by 2 tan(fov_y / 2).
+  };
+
+  /// A part in view of a camera, with the level of detail to draw it with.
+  struct VisiblePart {
+    PartId part{};
+    DetailLevel level{};
+  };
+
+  /// The approximate diameter in pixels of the bounding sphere of a box on screen,
+  /// or infinity if the camera is inside of the sphere.
+  float screen_size(const Aabb& box, const CameraView& view) noexcept;
+
+  /// The level of detail for a size on screen, or nothing if a part of this size is not drawn at all.
+  std::optional<DetailLevel> select_detail_level(float screen_size, const DetailThresholds& thresholds = {}) noexcept;
+
+  /// The parts of a scene in view of a camera with their levels of detail, in no particular order.
+  /// Takes time proportional to the number of parts in the frustum and of the parts changed since the last call,
+  /// see Scene::query_parts().
+  std::vector<VisiblePart> visible_parts(const Scene& scene, const CameraView& view,
+                                         const DetailThresholds& thresholds = {});
+
+  /// Simplifies a mesh by vertex clustering: the vertices in each cell of a grid are merged into their mean.
+  /// Details smaller than a cell, such as profiled edges, collapse, and faces which lose their area are dropped.
+  /// Faces which are no longer planar are split into triangles, and coplanar faces are merged again.
+  Mesh simplify_mesh(const Mesh& mesh, float cell_size);
+
+  /// The axis-aligned bounding cuboid of a mesh, with only two opposite faces if the mesh is flat.
+  Mesh bounding_cuboid_mesh(const Mesh& mesh);
+
+  /// The mesh drawn for a level of detail coarser than DetailLevel::full.
+  /// The simplified mesh collapses details smaller than a sixteenth of the largest extent of the mesh.
+  Mesh make_detail_mesh(const Mesh& mesh, DetailLevel level);
+}
@@ -18,12 +18,22 @@
 #include "mesh.hpp"
 
 #include <algorithm>
+#include <cmath>
 
-#include <boost/circular_buffer.hpp>
+#include <boost/container_hash/hash.hpp>
+#include <woodpecker/mesh_validation.hpp>
+#include <woodpecker/util/arena.hpp>
 #include <woodpecker/util/assert.hpp>
 #include <woodpecker/util/cast.hpp>
+#include <woodpecker/util/thread_pool.hpp>
+#include <woodpecker/util/trace.hpp>
 
 namespace wdp {
+  namespace {
+    /// The number of faces triangulated by one task of a parallel loop.
+    constexpr auto parallel_grain_size = std::size_t{256};
+  }
+
   Mesh Mesh::create_plane(float size_x, float size_z) {
     const auto t_x = kln::translator{size_x, 1, 0, 0};
     const auto t_z = kln::translator{size_z, 0, 0, 1};
@@ -61,80 +71,285 @@ namespace wdp {
     mesh.add_face({{p_y}, {p_yz}, {p_xyz}, {p_xy}});  // top
     mesh.add_face({{p_0}, {p_y}, {p_xy}, {p_x}});     // front
     mesh.add_face({{p_z}, {p_zx}, {p_xyz}, {p_yz}});  // back
+    WDP_ASSERT_AUDIT(validate_mesh(mesh).empty(), "cuboid must be closed and wound counter-clockwise from outside");
     return mesh;
   }
 
   VertexIndex Mesh::add_vertex(const Vertex& new_vtx) {
+    // index vertices which were added in bulk
+    for (auto idx = vertex_grid_.size(); idx < vertices_.size(); ++idx) {
+      vertex_grid_.insert(vertices_[idx].pos.normalized(), narrow_cast<VertexIndex>(idx));
+    }
+
     // check if mesh has existing vertex at same position
     const auto new_vtx_pos = new_vtx.pos.normalized();
-    const auto is_at_same_pos = [&](const Vertex& old_vtx) {
-      return (old_vtx.pos.normalized() & new_vtx_pos).norm() <= merge_dist;
+    const auto is_at_same_pos = [&](VertexIndex old_idx) {
+      return (vertices_[old_idx].pos.normalized() & new_vtx_pos).norm() <= merge_dist;
     };
-    const auto iter = std::ranges::find_if(vertices_, is_at_same_pos);
-    if (iter != vertices_.end()) {
+    if (const auto old_idx = vertex_grid_.find(new_vtx_pos, is_at_same_pos)) {
       // return index of existing vertex
-      return narrow<VertexIndex>(std::ranges::distance(vertices_.begin(), iter));
+      return *old_idx;
     }
-    // add new vertex to list
+    // add new vertex to list and grid
+    const auto new_idx = narrow<VertexIndex>(vertices_.size());
     vertices_.push_back(new_vtx);
-    return narrow<VertexIndex>(vertices_.size() - 1);
+    vertex_grid_.insert(new_vtx_pos, new_idx);
+    return new_idx;
   }
 
-  const Face& Mesh::add_face(const std::vector<Vertex>& vertices) {
-    WDP_ASSERT(vertices.size() >= 3);
+  Face Mesh::add_face(std::span<const Vertex> vertices) {
+    WDP_TRACE_SCOPE("Mesh::add_face");
+    WDP_ASSERT_CHEAP(vertices.size() >= 3);
 
-    // construct normalized plane of first 3 vertices
-    const auto p = (vertices[0].pos & vertices[1].pos & vertices[2].pos);
-    const auto plane = fix_kln::normalized(p);
-
-    // add vertices
-    auto vertex_indices = std::vector<VertexIndex>{};
+    // add vertices, appending their indices straight to the face storage
+    const auto face_begin = face_vertices_.size();
     for (const auto& vtx : vertices) {
-      const auto join = (vtx.pos.normalized() & plane);
-      const auto vtx_plane_dist = std::abs(join.scalar());
-      WDP_ASSERT(vtx_plane_dist < merge_dist, "vertex must be in plane");
-
-      const auto vertex_index = add_vertex(vtx);
-      vertex_indices.push_back(vertex_index);
+      face_vertices_.push_back(add_vertex(vtx));
     }
 
     // add face
-    const auto new_face = Face{vertex_indices, plane};
-    faces_.push_back(new_face);
-    return faces_.back();
+    const auto plane = face_plane(std::span{face_vertices_}.subspan(face_begin));
+    face_offsets_.push_back(face_vertices_.size());
+    face_planes_.push_back(plane);
+    mark_face_dirty(face_count() - 1);
+    return face(face_count() - 1);
+  }
+
+  kln::plane Mesh::face_plane(std::span<const VertexIndex> vertex_indices) const {
+    const auto plane = corner_plane(vertex_indices);
+    WDP_ASSERT_CHEAP(std::isfinite(plane.x()) && std::isfinite(plane.y()) && std::isfinite(plane.z()) &&
+                         std::isfinite(plane.d()),
+                     "vertices must span a plane");
+    WDP_ASSERT_AUDIT(in_plane(vertex_indices, plane), "vertex must be in plane");
+    return plane;
+  }
+
+  kln::plane Mesh::corner_plane(std::span<const VertexIndex> vertex_indices) const {
+    WDP_ASSERT_CHEAP(vertex_indices.size() >= 3);
+    const auto p = (vertices_[vertex_indices[0]].pos & vertices_[vertex_indices[1]].pos &
+                    vertices_[vertex_indices[2]].pos);
+    return fix_kln::normalized(p);
+  }
+
+  bool Mesh::in_plane(std::span<const VertexIndex> vertex_indices, const kln::plane& plane) const {
+    return std::ranges::all_of(vertex_indices, [&](VertexIndex vertex_index) {
+      const auto join = (vertices_[vertex_index].pos.normalized() & plane);
+      const auto vtx_plane_dist = std::abs(join.scalar());
+      return vtx_plane_dist < merge_dist;  // fails on NaN of degenerate planes as well
+    });
+  }
+
+  std::optional<kln::plane> Mesh::fit_face_plane(std::span<const VertexIndex> vertex_indices) const {
+    const auto plane = corner_plane(vertex_indices);
+    return in_plane(vertex_indices, plane) ? std::optional{plane} : std::nullopt;
   }
 
-  std::vector<TriFace> Mesh::triangulate() const {
-    auto all_tri_faces = std::vector<TriFace>{};
-    for (const auto& face : faces_) {
-      const auto tri_faces = triangulate_face(face);
-      all_tri_faces.insert(all_tri_faces.end(), tri_faces.begin(), tri_faces.end());
+  std::vector<TriFace> Mesh::triangulate(TriangulationMethod method) const {
+    WDP_TRACE_SCOPE("Mesh::triangulate");
+    auto all_tri_faces = std::vector<TriFace>(face_vertices_.size() - 2 * face_count());
+    for (auto face_idx = FaceIndex{0}; face_idx < face_count(); ++face_idx) {
+      const auto face_tri_faces = std::span{all_tri_faces}.subspan(face_triangles_offset(face_idx),
+                                                                   face(face_idx).vertices.size() - 2);
+      auto arena = ScratchArena{};
+      triangulate_face(face(face_idx), method, face_tri_faces, arena.resource());
     }
     return all_tri_faces;
   }
 
-  std::vector<TriFace> Mesh::triangulate_face(const Face& face) const {
-    auto ears = std::vector<TriFace>{};
-    auto polygon = boost::circular_buffer<VertexIndex>{face.vertices.begin(), face.vertices.end()};
+  const std::vector<TriFace>& Mesh::triangles() const { return update_triangles(nullptr); }
+
+  const std::vector<TriFace>& Mesh::triangles(ThreadPool& pool) const { return update_triangles(&pool); }
+
+  const std::vector<TriFace>& Mesh::update_triangles(ThreadPool* pool) const {
+    if (dirty_faces_.empty()) {
+      return triangles_;
+    }
+    WDP_TRACE_SCOPE("Mesh::update_triangles");
+    // each face has a fixed range in the cache, faces added since the last call append to it
+    triangles_.resize(face_vertices_.size() - 2 * face_count());
+    std::ranges::sort(dirty_faces_);
+    const auto duplicates = std::ranges::unique(dirty_faces_);
+    dirty_faces_.erase(duplicates.begin(), duplicates.end());
+    const auto update_face = [&](std::size_t dirty_idx) {
+      const auto face_idx = dirty_faces_[dirty_idx];
+      const auto face_tri_faces = std::span{triangles_}.subspan(face_triangles_offset(face_idx),
+                                                                face(face_idx).vertices.size() - 2);
+      auto arena = ScratchArena{};  // per face, as each task takes its arena from the cache of its thread
+      triangulate_face(face(face_idx), TriangulationMethod::monotone, face_tri_faces, arena.resource());
+    };
+    if (pool != nullptr) {
+      pool->parallel_for(0, dirty_faces_.size(), parallel_grain_size, update_face);
+    } else {
+      for (auto dirty_idx = std::size_t{0}; dirty_idx < dirty_faces_.size(); ++dirty_idx) {
+        update_face(dirty_idx);
+      }
+    }
+    dirty_faces_.clear();
+    return triangles_;
+  }
+
+  std::span<const TriFace> Mesh::face_triangles(FaceIndex index) const {
+    const auto& all_tri_faces = triangles();
+    const auto face_size = face_offsets_[index + 1] - face_offsets_[index];
+    return std::span{all_tri_faces}.subspan(face_triangles_offset(index), face_size - 2);
+  }
+
+  FaceIndex Mesh::triangle_face(std::size_t triangle_index) const noexcept {
+    // binary search for the last face starting at or before the triangle,
+    // the triangle offsets of the faces are strictly increasing, as each face has at least one triangle
+    auto first = FaceIndex{0};
+    auto count = face_count();
+    while (count > 0) {
+      const auto step = count / 2;
+      if (face_triangles_offset(first + step) <= triangle_index) {
+        first += step + 1;
+        count -= step + 1;
+      } else {
+        count = step;
+      }
+    }
+    return first - 1;
+  }
+
+  const Bvh& Mesh::triangle_bvh() const {
+    if (!triangle_bvh_dirty_) {
+      return triangle_bvh_;
+    }
+    WDP_TRACE_SCOPE("Mesh::triangle_bvh");
+    const auto& tri_faces = triangles();
+    auto boxes = std::vector<Aabb>(tri_faces.size());
+    for (std::size_t tri_idx = 0; tri_idx < tri_faces.size(); ++tri_idx) {
+      for (const auto vertex_index : tri_faces[tri_idx]) {
+        boxes[tri_idx].extend(vertex_position(vertex_index));
+      }
+    }
+    triangle_bvh_ = Bvh{boxes};
+    triangle_bvh_dirty_ = false;
+    return triangle_bvh_;
+  }
+
+  std::optional<MeshHit> Mesh::raycast(const Ray& ray, float max_distance) const {
+    const auto& bvh = triangle_bvh();
+    const auto& tri_faces = triangles_;
+    auto closest_tri_idx = std::uint32_t{};
+    const auto distance = bvh.raycast(ray, max_distance, [&](std::uint32_t tri_idx, float max_dist) {
+      const auto& tri_face = tri_faces[tri_idx];
+      const auto tri_distance = ray_triangle_distance(ray, vertex_position(tri_face[0]), vertex_position(tri_face[1]),
+                                                      vertex_position(tri_face[2]));
+      if (tri_distance >= 0 && tri_distance <= max_dist) {
+        closest_tri_idx = tri_idx;
+      }
+      return tri_distance;
+    });
+    if (distance < 0) {
+      return std::nullopt;
+    }
+    return MeshHit{triangle_face(closest_tri_idx), distance};
+  }
+
+  std::size_t Mesh::content_hash() const noexcept {
+    auto seed = std::size_t{};
+    for (const auto& vtx : vertices_) {
+      boost::hash_combine(seed, vtx.pos.x());
+      boost::hash_combine(seed, vtx.pos.y());
+      boost::hash_combine(seed, vtx.pos.z());
+      boost::hash_combine(seed, vtx.pos.w());
+    }
+    boost::hash_range(seed, face_vertices_.begin(), face_vertices_.end());
+    boost::hash_range(seed, face_offsets_.begin(), face_offsets_.end());
+    return seed;
+  }
+
+  bool Mesh::same_content(const Mesh& other) const noexcept {
+    const auto same_pos = [](const Vertex& a, const Vertex& b) {
+      return a.pos.x() == b.pos.x() && a.pos.y() == b.pos.y() && a.pos.z() == b.pos.z() &&
+             a.pos.w() == b.pos.w();
+    };
+    return std::ranges::equal(vertices_, other.vertices_, same_pos) && face_vertices_ == other.face_vertices_ &&
+           face_offsets_ == other.face_offsets_;
+  }
+
+  void Mesh::triangulate_face(const Face& face, TriangulationMethod method, std::span<TriFace> tri_faces,
+                              std::pmr::memory_resource* scratch) const {
+    WDP_ASSERT_CHEAP(tri_faces.size() + 2 == face.vertices.size());
+    switch (method) {
+      case TriangulationMethod::monotone:
+        triangulate_face_monotone(face, tri_faces, scratch);
+        return;
+      case TriangulationMethod::ear_clipping:
+        triangulate_face_ear_clipping(face, tri_faces, scratch);
+        return;
+    }
+    WDP_ASSERT(false, "unknown triangulation method");
+  }
+
+  void Mesh::triangulate_face_monotone(const Face& face, std::span<TriFace> tri_faces,
+                                       std::pmr::memory_resource* scratch) const {
+    if (face.vertices.size() == 3) {
+      tri_faces[0] = {face.vertices[0], face.vertices[1], face.vertices[2]};
+      return;
+    }
+
+    // project vertices into an orthogonal 2D frame of the face plane, scaled by the same factor on both axes
+    const auto normal = std::array{face.plane.x(), face.plane.y(), face.plane.z()};
+    const auto cross = [](const std::array<float, 3>& a, const std::array<float, 3>& b) {
+      return std::array{a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+    };
+    const auto min_axis = std::ranges::min_element(normal, {}, [](float c) { return std::abs(c); }) - normal.begin();
+    auto axis = std::array<float, 3>{};
+    axis[static_cast<std::size_t>(min_axis)] = 1;
+    const auto u = cross(normal, axis);
+    const auto v = cross(normal, u);  // same length as u, since the plane is normalized
+
+    auto polygon = std::pmr::vector<Vec2>{scratch};
+    polygon.reserve(face.vertices.size());
+    for (const auto idx : face.vertices) {
+      const auto pos = vertices_[idx].pos.normalized();
+      polygon.push_back(
+          {pos.x() * u[0] + pos.y() * u[1] + pos.z() * u[2], pos.x() * v[0] + pos.y() * v[1] + pos.z() * v[2]});
+    }
+
+    // map polygon triangles back to mesh vertex indices
+    auto triangles = std::pmr::vector<PolygonTriangle>(tri_faces.size(), scratch);
+    triangulate_monotone(polygon, triangles, scratch);
+    std::ranges::transform(triangles, tri_faces.begin(), [&](const PolygonTriangle& tri) {
+      return TriFace{face.vertices[tri[0]], face.vertices[tri[1]], face.vertices[tri[2]]};
+    });
+  }
+
+  void Mesh::triangulate_face_ear_clipping(const Face& face, std::span<TriFace> tri_faces,
+                                           std::pmr::memory_resource* scratch) const {
+    auto ear_count = std::size_t{0};
+    auto polygon = std::pmr::vector<VertexIndex>{face.vertices.begin(), face.vertices.end(), scratch};
+
+    // the sign of the doubled area of the polygon along the face plane, which is negative for a plane taken at a
+    // reflex corner
+    const auto& origin = vertices_[polygon[0]].pos;
+    auto winding = 0.0F;
+    for (auto i = std::size_t{1}; i + 1 < polygon.size(); ++i) {
+      winding += (origin & vertices_[polygon[i]].pos & vertices_[polygon[i + 1]].pos) | face.plane;
+    }
+    const auto orientation = winding < 0 ? -1.0F : 1.0F;
 
     // clip ears until polygon is a single triangle
     while (polygon.size() > 3) {
-      for (auto iter = polygon.begin(); iter != polygon.end(); ++iter) {
+      const auto size = polygon.size();
+      auto clipped_ear = false;
+      for (auto i = std::size_t{0}; i < size && !clipped_ear; ++i) {
         // look at three consecutive vertices in polygon, check if it is an ear
-        const auto idx = *iter;
+        const auto i_prev = (i + size - 1) % size;
+        const auto i_next = (i + 1) % size;
+        const auto idx = polygon[i];
         const auto vtx = vertices_[idx].pos;
-        const auto idx_prev = *(iter - 1);
+        const auto idx_prev = polygon[i_prev];
         const auto vtx_prev = vertices_[idx_prev].pos;
-        const auto idx_next = *(iter + 1);
+        const auto idx_next = polygon[i_next];
         const auto vtx_next = vertices_[idx_next].pos;
 
-        // compute angle at vertex v_i
+        // cond 1: check if convex, by the signed area of the corner at v_i along the winding of the polygon
         const auto edge_vp_to_v = vtx_prev & vtx;
         const auto edge_v_to_vn = vtx & vtx_next;
-        const auto angle = std::acos(fix_kln::normalized(edge_vp_to_v) | fix_kln::normalized(edge_v_to_vn));
-
-        // cond 1: check if convex
-        const auto is_convex = angle < kln::pi;
+        const auto is_convex = orientation * ((edge_vp_to_v & vtx_next) | face.plane) > 0;
         if (!is_convex) {
           continue;
         }
@@ -144,19 +359,20 @@ namespace wdp {
         const auto plane_v_to_vn = face.plane | edge_v_to_vn;
         const auto plane_vn_to_vp = face.plane | (vtx_next & vtx_prev);
         bool any_other_inside_triangle = false;
-        for (auto other_iter = polygon.begin(); other_iter != polygon.end(); ++other_iter) {
-          if (other_iter == iter || other_iter == (iter - 1) || other_iter == (iter + 1)) {
+        for (auto j = std::size_t{0}; j < size; ++j) {
+          if (j == i || j == i_prev || j == i_next) {
             continue;
           }
-          const auto other_vtx = vertices_[*other_iter].pos;
+          const auto other_vtx = vertices_[polygon[j]].pos;
 
           // check on which side of the planes the vertex lies
-          const auto meet_vp_to_v = (other_vtx ^ plane_vp_to_v).scalar();
-          const auto meet_v_to_vn = (other_vtx ^ plane_v_to_vn).scalar();
-          const auto meet_vn_to_vp = (other_vtx ^ plane_vn_to_vp).scalar();
+          const auto meet_vp_to_v = (other_vtx ^ plane_vp_to_v).e0123();
+          const auto meet_v_to_vn = (other_vtx ^ plane_v_to_vn).e0123();
+          const auto meet_vn_to_vp = (other_vtx ^ plane_vn_to_vp).e0123();
 
-          // if all meets are positive, the point v_j is inside
-          if (meet_vp_to_v > 0 && meet_v_to_vn > 0 && meet_vn_to_vp > 0) {
+          // if all meets have the same sign, the point v_j is on the inner side of each edge, thus inside
+          if ((meet_vp_to_v > 0 && meet_v_to_vn > 0 && meet_vn_to_vp > 0) ||
+              (meet_vp_to_v < 0 && meet_v_to_vn < 0 && meet_vn_to_vp < 0)) {
             any_other_inside_triangle = true;
             break;
           }
@@ -165,15 +381,15 @@ namespace wdp {
           continue;
         }
 
-        // clip ear, remove idx from polygon
-        ears.push_back({idx_prev, idx, idx_next});
-        polygon.erase(iter);
+        // clip ear, remove idx from polygon and start over
+        tri_faces[ear_count++] = {idx_prev, idx, idx_next};
+        polygon.erase(polygon.begin() + static_cast<std::ptrdiff_t>(i));
+        clipped_ear = true;
       }
+      WDP_ASSERT(clipped_ear, "polygon must have an ear");
     }
 
     // add remaining triangle to clipped ears
-    ears.push_back({polygon[0], polygon[1], polygon[2]});
-
-    return ears;
+    tri_faces[ear_count] = {polygon[0], polygon[1], polygon[2]};
   }
 }
@@ -19,32 +19,45 @@
 
 #include <array>
 #include <cstddef>
+#include <memory_resource>
+#include <optional>
+#include <ranges>
+#include <span>
 #include <vector>
 
+#include <woodpecker/bvh.hpp>
 #include <woodpecker/pga.hpp>
+#include <woodpecker/triangulation.hpp>
+#include <woodpecker/vertex.hpp>
+#include <woodpecker/vertex_grid.hpp>
 
 namespace wdp {
-  /// A vertex in the Mesh.
-  struct Vertex {
-    kln::point pos{};  ///< The position of the vertex.
-  };
-
-  /// An index to a vertex in the Mesh.
-  using VertexIndex = unsigned;
+  class ThreadPool;
 
   /// A polygonal face of at least 3 vertices in the Mesh.
+  /// This is a view into the face storage of the mesh, which is invalidated when faces are added.
   struct Face {
-    std::vector<VertexIndex> vertices;  ///< The list of indices into the vertex list of the mesh.
-    kln::plane plane{};                 ///< The plane in which all vertices of this face lie, normalized.
+    std::span<const VertexIndex> vertices;  ///< The list of indices into the vertex list of the mesh.
+    kln::plane plane{};                     ///< The plane in which all vertices of this face lie, normalized.
   };
 
+  /// An index to a face in the Mesh.
+  using FaceIndex = unsigned;
+
   /// A triangular face of exactly 3 vertex indices.
   using TriFace = std::array<VertexIndex, 3>;
 
+  /// The closest intersection of a ray with a Mesh.
+  struct MeshHit {
+    FaceIndex face{};  ///< The face which was hit.
+    float distance{};  ///< The distance along the ray, in multiples of its direction.
+  };
+
   /// A polygonal mesh built from the faces and vertices.
   /// The vertices are positioned in 3D space.
   /// A face is a coplanar simple polygon of at least 3 vertices.
-  /// The winding order is clockwise.
+  /// Faces are wound counter-clockwise seen from outside, like those of create_cuboid().
+  /// The planes joining their corners thus point inwards, as klein's join turns against the right-handed normal.
   class Mesh {
   public:
     /// The maximum distance threshold below which any two vertices are merged into one.
@@ -59,24 +72,134 @@ namespace wdp {
     /// Adds a new vertex to the mesh.
     /// If there is already an existing vertex in the mesh, which is not further than
     /// #merge_dist apart from the new vertex, then the new vertex is not added to mesh.
+    /// Existing vertices are looked up in a spatial hash grid, taking expected constant time.
     /// \return The index of the newly added vertex, or the existing vertex at the same position.
     VertexIndex add_vertex(const Vertex& new_vtx);
 
     /// Adds a new face to the mesh.
     /// \param vertices 3 or more coplanar vertices spanning the face.
-    const Face& add_face(const std::vector<Vertex>& vertices);
+    Face add_face(std::span<const Vertex> vertices);
+    Face add_face(const std::vector<Vertex>& vertices) { return add_face(std::span{vertices}); }
 
     /// Creates a triangulation of this mesh.
-    /// \return A list of index triples forming triangles.
-    std::vector<TriFace> triangulate() const;
+    /// \param method The algorithm used to triangulate each face.
+    /// \return A list of index triples forming triangles, n - 2 for each face of n vertices.
+    std::vector<TriFace> triangulate(TriangulationMethod method = TriangulationMethod::monotone) const;
+
+    /// The triangulation of this mesh using the monotone method, cached between calls.
+    /// Only faces which were added or modified since the previous call are triangulated again.
+    /// The n - 2 triangles of a face with n vertices are stored in the order of the faces.
+    /// Must not be called concurrently on the same mesh.
+    const std::vector<TriFace>& triangles() const;
+
+    /// Like triangles(), but triangulates the outdated faces in parallel.
+    /// Each face writes to its fixed range in the cache, so the result does not depend on scheduling.
+    const std::vector<TriFace>& triangles(ThreadPool& pool) const;
+
+    /// The cached triangles of a single face, see triangles().
+    std::span<const TriFace> face_triangles(FaceIndex index) const;
+
+    /// The face which a triangle of the cache belongs to, see triangles().
+    FaceIndex triangle_face(std::size_t triangle_index) const noexcept;
+
+    /// A bounding volume hierarchy over the cached triangles, rebuilt when faces were added or modified.
+    /// The primitive indices are indices into triangles(). Must not be called concurrently on the same mesh.
+    const Bvh& triangle_bvh() const;
+
+    /// The bounding box of all faces.
+    Aabb bounds() const { return triangle_bvh().bounds(); }
+
+    /// Casts a ray against the triangles of the mesh, from either side.
+    /// \return The closest hit within the maximum distance, if any.
+    std::optional<MeshHit> raycast(const Ray& ray, float max_distance = std::numeric_limits<float>::infinity()) const;
+
+    /// A hash over the vertex positions and faces of the mesh, equal for meshes with the same content.
+    std::size_t content_hash() const noexcept;
+
+    /// Whether both meshes have the same vertex positions and faces, in the same order.
+    bool same_content(const Mesh& other) const noexcept;
 
     const auto& vertices() const noexcept { return vertices_; }
-    const auto& faces() const noexcept { return faces_; }
+
+    /// The number of faces in the mesh.
+    FaceIndex face_count() const noexcept { return static_cast<FaceIndex>(face_planes_.size()); }
+
+    /// The total number of vertex indices over all faces.
+    std::size_t face_vertex_count() const noexcept { return face_vertices_.size(); }
+
+    /// The face at the given index.
+    Face face(FaceIndex index) const noexcept {
+      const auto begin = face_offsets_[index];
+      const auto end = face_offsets_[index + 1];
+      return {std::span{face_vertices_}.subspan(begin, end - begin), face_planes_[index]};
+    }
+
+    /// A random-access range over all faces in the mesh.
+    auto faces() const noexcept {
+      return std::views::iota(FaceIndex{0}, face_count()) |
+             std::views::transform([this](FaceIndex index) { return face(index); });
+    }
 
   private:
-    std::vector<Vertex> vertices_;
-    std::vector<Face> faces_;
+    friend class MeshBuilder;
+    friend class SceneFileIo;
+    friend class MeshRepair;
 
-    std::vector<TriFace> triangulate_face(const Face& face) const;
+    static constexpr auto vertex_grid_cell_size = 4 * merge_dist;  // twice the search diameter, see VertexGrid
+
+    std::vector<Vertex> vertices_;
+    // faces in compressed sparse row layout: the vertex indices of face i are
+    // face_vertices_[face_offsets_[i] .. face_offsets_[i + 1]], its plane is face_planes_[i]
+    std::vector<VertexIndex> face_vertices_;
+    std::vector<std::size_t> face_offsets_{0};
+    std::vector<kln::plane> face_planes_;
+    VertexGrid vertex_grid_{vertex_grid_cell_size};  // filled lazily by add_vertex, after bulk construction
+
+    // triangulation cache: the triangles of face i start at face_offsets_[i] - 2 * i
+    mutable std::vector<TriFace> triangles_;
+    mutable std::vector<FaceIndex> dirty_faces_;
+    mutable Bvh triangle_bvh_;
+    mutable bool triangle_bvh_dirty_{true};
+
+    /// Triangulates the outdated faces into the cache, in parallel if a pool is given.
+    const std::vector<TriFace>& update_triangles(ThreadPool* pool) const;
+
+    /// Marks the cached triangles of a face as outdated.
+    void mark_face_dirty(FaceIndex index) {
+      dirty_faces_.push_back(index);
+      triangle_bvh_dirty_ = true;
+    }
+
+    /// The euclidean position of a vertex.
+    Vec3 vertex_position(VertexIndex index) const noexcept {
+      const auto pos = vertices_[index].pos.normalized();
+      return {pos.x(), pos.y(), pos.z()};
+    }
+
+    /// The offset of the first triangle of a face in the triangulation cache.
+    std::size_t face_triangles_offset(FaceIndex index) const noexcept { return face_offsets_[index] - 2 * index; }
+
+    /// Computes the plane through the first 3 vertices of a face.
+    /// That they span a plane is a cheap contract, that the other vertices lie in it is an audit contract.
+    kln::plane face_plane(std::span<const VertexIndex> vertex_indices) const;
+
+    /// The normalized plane through the first 3 vertices of a face, which is not finite if they do not span one.
+    kln::plane corner_plane(std::span<const VertexIndex> vertex_indices) const;
+
+    /// Whether all vertices of a face are closer than #merge_dist to a plane.
+    /// Always fails for planes which are not finite.
+    bool in_plane(std::span<const VertexIndex> vertex_indices, const kln::plane& plane) const;
+
+    /// Computes the plane through the first 3 vertices of a face,
+    /// or nothing if they do not span a plane or any other vertex is #merge_dist or further away from it.
+    std::optional<kln::plane> fit_face_plane(std::span<const VertexIndex> vertex_indices) const;
+
+    /// Writes the n - 2 triangles of a face with n vertices, allocating temporaries from a scratch resource.
+    void triangulate_face(const Face& face, TriangulationMethod method, std::span<TriFace> tri_faces,
+                          std::pmr::memory_resource* scratch) const;
+    void triangulate_face_monotone(const Face& face, std::span<TriFace> tri_faces,
+                                   std::pmr::memory_resource* scratch) const;
+    void triangulate_face_ear_clipping(const Face& face, std::span<TriFace> tri_faces,
+                                       std::pmr::memory_resource* scratch) const;
   };
 }
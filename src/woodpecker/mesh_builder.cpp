@@ -0,0 +1,437 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "mesh_builder.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <numeric>
+#include <utility>
+
+#include <woodpecker/util/assert.hpp>
+#include <woodpecker/util/cast.hpp>
+#include <woodpecker/util/trace.hpp>
+
+namespace wdp {
+  namespace {
+    /// The minimum cosine of the angle between the normals of adjacent faces merged by merge_coplanar_faces.
+    /// Merged polygons are checked against Mesh::merge_dist afterwards, as any face.
+    constexpr auto coplanar_tolerance = 1e-6F;
+
+    /// The minimum doubled area of the triangle at a corner of a face spanning its plane.
+    constexpr auto min_corner_area = Mesh::merge_dist * Mesh::merge_dist;
+
+    /// A directed edge from a vertex of a face to the next one.
+    struct HalfEdge {
+      std::uint64_t edge_key{};  ///< The indices of both vertices, smaller first, equal for the opposite half-edge.
+      std::size_t position{};    ///< The position of the start vertex in the face vertices.
+      FaceIndex face{};
+    };
+
+    /// Rotates a polygon so that its first 3 vertices, from which the plane of a face is computed,
+    /// are those around the convex corner spanning the largest triangle.
+    /// Corners are convex if they are wound like the whole polygon, so that its plane points inwards as in Mesh,
+    /// even if a reflex corner spans a larger triangle.
+    /// \return Whether that triangle has any area, i.e. whether the polygon spans a plane at all.
+    bool make_plane_corner_first(const Mesh& mesh, std::span<VertexIndex> polygon) {
+      const auto position = [&](VertexIndex idx) { return mesh.vertices()[idx].pos.normalized(); };
+
+      // the sum of the planes joining the first vertex with each edge, whose normal follows the winding
+      const auto origin = position(polygon[0]);
+      auto winding = kln::plane{0, 0, 0, 0};
+      for (auto idx = std::size_t{1}; idx + 1 < polygon.size(); ++idx) {
+        winding += origin & position(polygon[idx]) & position(polygon[idx + 1]);
+      }
+
+      auto best_corner = std::size_t{0};
+      auto best_area = 0.0F;
+      for (auto idx = std::size_t{0}; idx < polygon.size(); ++idx) {
+        const auto prev = position(polygon[(idx + polygon.size() - 1) % polygon.size()]);
+        const auto corner = position(polygon[idx]);
+        const auto next = position(polygon[(idx + 1) % polygon.size()]);
+        const auto corner_plane = prev & corner & next;
+        const auto area = corner_plane.norm();
+        if ((corner_plane | winding) > 0 && area > best_area) {
+          best_corner = idx;
+          best_area = area;
+        }
+      }
+      std::ranges::rotate(polygon, polygon.begin() + narrow<std::ptrdiff_t>((best_corner + polygon.size() - 1) %
+                                                                             polygon.size()));
+      return best_area > min_corner_area;
+    }
+  }
+
+  void MeshBuilder::reserve(std::size_t vertex_count, std::size_t face_count, std::size_t face_vertex_count) {
+    vertices_.reserve(vertex_count);
+    face_sizes_.reserve(face_count);
+    face_vertices_.reserve(face_vertex_count);
+  }
+
+  VertexIndex MeshBuilder::add_vertices(std::span<const Vertex> vertices) {
+    // all builder indices fit if the count does, so that they need not be checked one by one
+    static_cast<void>(narrow<VertexIndex>(vertices_.size() + vertices.size()));
+    const auto first_index = static_cast<VertexIndex>(vertices_.size());
+    vertices_.insert(vertices_.end(), vertices.begin(), vertices.end());
+    return first_index;
+  }
+
+  void MeshBuilder::add_face(std::span<const VertexIndex> face_vertices) {
+    WDP_ASSERT_CHEAP(face_vertices.size() >= 3);
+    face_vertices_.insert(face_vertices_.end(), face_vertices.begin(), face_vertices.end());
+    face_sizes_.push_back(narrow<VertexIndex>(face_vertices.size()));
+  }
+
+  void MeshBuilder::add_faces(std::span<const VertexIndex> face_vertices, std::span<const VertexIndex> face_sizes) {
+    WDP_ASSERT_AUDIT(std::accumulate(face_sizes.begin(), face_sizes.end(), std::size_t{0}) == face_vertices.size());
+    WDP_ASSERT_AUDIT(std::ranges::all_of(face_sizes, [](VertexIndex size) { return size >= 3; }));
+    face_vertices_.insert(face_vertices_.end(), face_vertices.begin(), face_vertices.end());
+    face_sizes_.insert(face_sizes_.end(), face_sizes.begin(), face_sizes.end());
+  }
+
+  Mesh MeshBuilder::build(const MeshBuildOptions& options) {
+    WDP_TRACE_SCOPE("MeshBuilder::build");
+    static_cast<void>(narrow<FaceIndex>(face_sizes_.size()));
+    const auto weld_targets = weld();
+
+    // keep merge targets in order of first occurrence, like Mesh::add_vertex does
+    auto mesh = Mesh{};
+    auto mesh_indices = std::vector<VertexIndex>(vertices_.size());
+    for (auto idx = std::size_t{0}; idx < vertices_.size(); ++idx) {
+      const auto target = weld_targets[idx];
+      if (target == idx) {
+        mesh_indices[idx] = narrow_cast<VertexIndex>(mesh.vertices_.size());
+        mesh.vertices_.push_back(vertices_[idx]);
+      } else {
+        mesh_indices[idx] = mesh_indices[target];
+      }
+    }
+
+    // remap faces to mesh vertices and clean them up if requested
+    mesh.face_vertices_.reserve(face_vertices_.size());
+    std::ranges::transform(face_vertices_, std::back_inserter(mesh.face_vertices_),
+                           [&](VertexIndex idx) { return mesh_indices[idx]; });
+    if (options.repair_faces) {
+      repair_faces(mesh, mesh.face_vertices_, face_sizes_);
+    }
+    if (options.merge_coplanar_faces) {
+      merge_coplanar_faces(mesh, mesh.face_vertices_, face_sizes_);
+    }
+    if (options.repair_faces || options.merge_coplanar_faces) {
+      remove_unused_vertices(mesh);
+    }
+
+    // add faces, computing their planes
+    mesh.face_offsets_.reserve(face_sizes_.size() + 1);
+    std::inclusive_scan(face_sizes_.begin(), face_sizes_.end(), std::back_inserter(mesh.face_offsets_), std::plus<>{},
+                        std::size_t{0});
+    mesh.face_planes_.reserve(face_sizes_.size());
+    for (auto face_idx = std::size_t{0}; face_idx < face_sizes_.size(); ++face_idx) {
+      const auto face_begin = mesh.face_offsets_[face_idx];
+      const auto face_vertices = std::span{mesh.face_vertices_}.subspan(face_begin, face_sizes_[face_idx]);
+      mesh.face_planes_.push_back(mesh.face_plane(face_vertices));
+      mesh.mark_face_dirty(narrow_cast<FaceIndex>(face_idx));
+    }
+
+    *this = MeshBuilder{};
+    return mesh;
+  }
+
+  std::vector<VertexIndex> MeshBuilder::weld() const {
+    using CellKey = VertexGrid::CellKey;
+    const auto grid = VertexGrid{Mesh::vertex_grid_cell_size};
+
+    // sort vertices by the grid cell of their position, ties by index
+    auto positions = std::vector<kln::point>{};
+    positions.reserve(vertices_.size());
+    auto cells = std::vector<std::pair<CellKey, VertexIndex>>{};
+    cells.reserve(vertices_.size());
+    for (const auto& vtx : vertices_) {
+      const auto pos = vtx.pos.normalized();
+      cells.emplace_back(grid.cell_of(pos), narrow_cast<VertexIndex>(positions.size()));
+      positions.push_back(pos);
+    }
+    std::ranges::sort(cells);
+
+    // mark occupied cells in a bitmap small enough to stay cached,
+    // so that the binary search is skipped for most empty neighbour cells of large meshes
+    const auto hash_cell = VertexGrid::CellKeyHash{};
+    const auto occupied_mask = std::bit_ceil(std::max(8 * cells.size(), std::size_t{64})) - 1;
+    auto occupied = std::vector<std::uint64_t>((occupied_mask + 1) / 64);
+    for (const auto& [key, idx] : cells) {
+      const auto bit = hash_cell(key) & occupied_mask;
+      occupied[bit / 64] |= std::uint64_t{1} << (bit % 64);
+    }
+
+    // the start of the cell of each vertex in the sorted cells, which needs no search
+    auto own_cell_begins = std::vector<std::size_t>(vertices_.size());
+    for (auto cell_idx = std::size_t{0}, cell_begin = std::size_t{0}; cell_idx < cells.size(); ++cell_idx) {
+      cell_begin = cells[cell_idx].first == cells[cell_begin].first ? cell_begin : cell_idx;
+      own_cell_begins[cells[cell_idx].second] = cell_begin;
+    }
+
+    // in order of addition, merge each vertex into the first earlier, unmerged vertex close to it
+    auto targets = std::vector<VertexIndex>(vertices_.size());
+    for (auto idx = VertexIndex{0}; idx < targets.size(); ++idx) {
+      targets[idx] = idx;
+      grid.for_each_near_cell(positions[idx], [&](const CellKey& key) {
+        const auto bit = hash_cell(key) & occupied_mask;
+        if ((occupied[bit / 64] & (std::uint64_t{1} << (bit % 64))) == 0) {
+          return;
+        }
+        const auto cell_begin = key == cells[own_cell_begins[idx]].first
+                                    ? cells.begin() + narrow_cast<std::ptrdiff_t>(own_cell_begins[idx])
+                                    : std::ranges::lower_bound(cells, std::pair{key, VertexIndex{0}});
+        for (auto iter = cell_begin; iter != cells.end() && iter->first == key; ++iter) {
+          const auto other_idx = iter->second;
+          if (other_idx >= targets[idx]) {
+            break;  // sorted by index within a cell
+          }
+          if (targets[other_idx] == other_idx && (positions[other_idx] & positions[idx]).norm() <= Mesh::merge_dist) {
+            targets[idx] = other_idx;
+          }
+        }
+      });
+    }
+    return targets;
+  }
+
+  void MeshBuilder::repair_faces(const Mesh& mesh, std::vector<VertexIndex>& face_vertices,
+                                 std::vector<VertexIndex>& face_sizes) {
+    auto repaired_vertices = std::vector<VertexIndex>{};
+    repaired_vertices.reserve(face_vertices.size());
+    auto repaired_sizes = std::vector<VertexIndex>{};
+    repaired_sizes.reserve(face_sizes.size());
+    const auto push_face = [&](std::span<const VertexIndex> face) {
+      repaired_vertices.insert(repaired_vertices.end(), face.begin(), face.end());
+      repaired_sizes.push_back(narrow<VertexIndex>(face.size()));
+    };
+
+    auto polygon = std::vector<VertexIndex>{};
+    auto sorted_polygon = std::vector<VertexIndex>{};
+    auto face_begin = std::size_t{0};
+    for (const auto face_size : face_sizes) {
+      const auto face = std::span{face_vertices}.subspan(face_begin, face_size);
+      face_begin += face_size;
+
+      // drop vertices merged into their predecessor by welding
+      polygon.clear();
+      for (const auto idx : face) {
+        if (polygon.empty() || polygon.back() != idx) {
+          polygon.push_back(idx);
+        }
+      }
+      while (polygon.size() > 1 && polygon.back() == polygon.front()) {
+        polygon.pop_back();
+      }
+      if (polygon.size() < 3) {
+        continue;
+      }
+
+      // keep the face if it is a simple, planar polygon with area
+      sorted_polygon.assign(polygon.begin(), polygon.end());
+      std::ranges::sort(sorted_polygon);
+      const auto is_simple = std::ranges::adjacent_find(sorted_polygon) == sorted_polygon.end();
+      if (is_simple && make_plane_corner_first(mesh, polygon) && mesh.fit_face_plane(polygon)) {
+        push_face(polygon);
+        continue;
+      }
+
+      // otherwise split it into a fan of triangles, dropping those without area
+      for (auto idx = std::size_t{1}; idx + 1 < polygon.size(); ++idx) {
+        auto triangle = std::array{polygon[0], polygon[idx], polygon[idx + 1]};
+        if (triangle[0] != triangle[1] && triangle[1] != triangle[2] && triangle[2] != triangle[0] &&
+            make_plane_corner_first(mesh, triangle) && mesh.fit_face_plane(triangle)) {
+          push_face(triangle);
+        }
+      }
+    }
+
+    face_vertices = std::move(repaired_vertices);
+    face_sizes = std::move(repaired_sizes);
+  }
+
+  void MeshBuilder::merge_coplanar_faces(const Mesh& mesh, std::vector<VertexIndex>& face_vertices,
+                                         std::vector<VertexIndex>& face_sizes) {
+    const auto face_count = face_sizes.size();
+    auto face_offsets = std::vector<std::size_t>{};
+    face_offsets.reserve(face_count + 1);
+    face_offsets.push_back(0);
+    std::inclusive_scan(face_sizes.begin(), face_sizes.end(), std::back_inserter(face_offsets), std::plus<>{},
+                        std::size_t{0});
+    const auto face_span = [&](std::size_t face_idx) {
+      return std::span{face_vertices}.subspan(face_offsets[face_idx], face_sizes[face_idx]);
+    };
+
+    // all half-edges, sorted so that those along the same edge are adjacent
+    auto half_edges = std::vector<HalfEdge>{};
+    half_edges.reserve(face_vertices.size());
+    for (auto face_idx = std::size_t{0}; face_idx < face_count; ++face_idx) {
+      const auto face = face_span(face_idx);
+      for (auto idx = std::size_t{0}; idx < face.size(); ++idx) {
+        const auto from = face[idx];
+        const auto to = face[(idx + 1) % face.size()];
+        const auto edge_key = (std::uint64_t{std::min(from, to)} << 32U) | std::uint64_t{std::max(from, to)};
+        half_edges.push_back({edge_key, face_offsets[face_idx] + idx, narrow_cast<FaceIndex>(face_idx)});
+      }
+    }
+    std::ranges::sort(half_edges, {}, &HalfEdge::edge_key);
+    const auto for_each_edge = [&](const auto& func) {
+      for (auto edge_begin = half_edges.begin(); edge_begin != half_edges.end();) {
+        auto edge_end = edge_begin + 1;
+        while (edge_end != half_edges.end() && edge_end->edge_key == edge_begin->edge_key) {
+          ++edge_end;
+        }
+        func(std::span{edge_begin, edge_end});
+        edge_begin = edge_end;
+      }
+    };
+
+    // unite faces across manifold edges between faces of the same plane
+    auto planes = std::vector<kln::plane>{};
+    planes.reserve(face_count);
+    for (auto face_idx = std::size_t{0}; face_idx < face_count; ++face_idx) {
+      planes.push_back(mesh.face_plane(face_span(face_idx)));
+    }
+    auto parents = std::vector<FaceIndex>(face_count);
+    std::iota(parents.begin(), parents.end(), FaceIndex{0});
+    const auto find_root = [&](FaceIndex face_idx) {
+      while (parents[face_idx] != face_idx) {
+        parents[face_idx] = parents[parents[face_idx]];
+        face_idx = parents[face_idx];
+      }
+      return face_idx;
+    };
+    for_each_edge([&](std::span<const HalfEdge> edge) {
+      if (edge.size() != 2 || face_vertices[edge[0].position] == face_vertices[edge[1].position]) {
+        return;  // not manifold
+      }
+      const auto face_a = edge[0].face;
+      const auto face_b = edge[1].face;
+      if (face_a != face_b && (planes[face_a] | planes[face_b]) > 1 - coplanar_tolerance) {
+        parents[find_root(face_a)] = find_root(face_b);
+      }
+    });
+    auto roots = std::vector<FaceIndex>(face_count);
+    for (auto face_idx = FaceIndex{0}; face_idx < face_count; ++face_idx) {
+      roots[face_idx] = find_root(face_idx);
+    }
+
+    // half-edges with an opposite half-edge in the same region are inside of it, the others on its boundary
+    auto is_inner = std::vector<bool>(face_vertices.size());
+    for_each_edge([&](std::span<const HalfEdge> edge) {
+      for (const auto& half_edge : edge) {
+        is_inner[half_edge.position] = std::ranges::any_of(edge, [&](const HalfEdge& other) {
+          return face_vertices[other.position] != face_vertices[half_edge.position] &&
+                 roots[other.face] == roots[half_edge.face];
+        });
+      }
+    });
+
+    // group faces by region, each ascending
+    auto region_offsets = std::vector<std::size_t>(face_count + 1);
+    for (const auto root : roots) {
+      ++region_offsets[root + 1];
+    }
+    std::partial_sum(region_offsets.begin(), region_offsets.end(), region_offsets.begin());
+    auto region_faces = std::vector<FaceIndex>(face_count);
+    auto region_fill = std::vector<std::size_t>(region_offsets.begin(), region_offsets.end() - 1);
+    for (auto face_idx = FaceIndex{0}; face_idx < face_count; ++face_idx) {
+      region_faces[region_fill[roots[face_idx]]++] = face_idx;
+    }
+
+    // emit each region at its first face, as one polygon if its boundary is a single simple loop
+    auto merged_vertices = std::vector<VertexIndex>{};
+    merged_vertices.reserve(face_vertices.size());
+    auto merged_sizes = std::vector<VertexIndex>{};
+    merged_sizes.reserve(face_count);
+    const auto push_face = [&](std::span<const VertexIndex> face) {
+      merged_vertices.insert(merged_vertices.end(), face.begin(), face.end());
+      merged_sizes.push_back(narrow<VertexIndex>(face.size()));
+    };
+    auto boundary = std::vector<std::pair<VertexIndex, VertexIndex>>{};
+    auto polygon = std::vector<VertexIndex>{};
+    for (auto face_idx = FaceIndex{0}; face_idx < face_count; ++face_idx) {
+      const auto root = roots[face_idx];
+      const auto faces = std::span{region_faces}.subspan(region_offsets[root],
+                                                         region_offsets[root + 1] - region_offsets[root]);
+      if (faces.size() == 1) {
+        push_face(face_span(face_idx));
+        continue;
+      }
+      if (faces.front() != face_idx) {
+        continue;  // emitted with the first face of its region
+      }
+
+      // collect the boundary half-edges of the region
+      boundary.clear();
+      for (const auto region_face : faces) {
+        const auto face = face_span(region_face);
+        for (auto idx = std::size_t{0}; idx < face.size(); ++idx) {
+          if (!is_inner[face_offsets[region_face] + idx]) {
+            boundary.emplace_back(face[idx], face[(idx + 1) % face.size()]);
+          }
+        }
+      }
+      std::ranges::sort(boundary);
+
+      // trace the loop starting at the first boundary half-edge
+      polygon.clear();
+      auto is_simple_loop = std::ranges::adjacent_find(boundary, {}, [](const auto& edge) { return edge.first; }) ==
+                            boundary.end();
+      for (auto from = boundary.front().first; is_simple_loop && polygon.size() < boundary.size();) {
+        polygon.push_back(from);
+        const auto edge = std::ranges::lower_bound(boundary, std::pair{from, VertexIndex{0}});
+        is_simple_loop = edge != boundary.end() && edge->first == from;
+        from = is_simple_loop ? edge->second : from;
+        is_simple_loop = is_simple_loop && (from == polygon.front()) == (polygon.size() == boundary.size());
+      }
+      if (is_simple_loop && make_plane_corner_first(mesh, polygon) && mesh.fit_face_plane(polygon)) {
+        push_face(polygon);
+      } else {
+        for (const auto region_face : faces) {
+          push_face(face_span(region_face));
+        }
+      }
+    }
+
+    face_vertices = std::move(merged_vertices);
+    face_sizes = std::move(merged_sizes);
+  }
+
+  void MeshBuilder::remove_unused_vertices(Mesh& mesh) {
+    auto new_indices = std::vector<VertexIndex>(mesh.vertices_.size());
+    for (const auto idx : mesh.face_vertices_) {
+      new_indices[idx] = 1;
+    }
+    auto used_count = VertexIndex{0};
+    for (auto idx = std::size_t{0}; idx < new_indices.size(); ++idx) {
+      if (new_indices[idx] != 0) {
+        mesh.vertices_[used_count] = mesh.vertices_[idx];
+        new_indices[idx] = used_count++;
+      }
+    }
+    mesh.vertices_.resize(used_count);
+    for (auto& idx : mesh.face_vertices_) {
+      idx = new_indices[idx];
+    }
+  }
+}
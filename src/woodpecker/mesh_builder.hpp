@@ -0,0 +1,85 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include <woodpecker/mesh.hpp>
+
+namespace wdp {
+  /// How MeshBuilder::build() treats faces which do not form a valid mesh by themselves, such as imported ones.
+  /// With any option enabled, vertices which are no longer used by any face are removed.
+  struct MeshBuildOptions {
+    /// Drops repeated vertices and faces without area after welding,
+    /// and splits faces whose vertices are not coplanar into triangles, instead of asserting their validity.
+    bool repair_faces{false};
+
+    /// Merges each region of edge-adjacent coplanar faces, such as the triangles of a scanned or exported polygon,
+    /// into a single face, if the boundary of the region is a single simple loop.
+    bool merge_coplanar_faces{false};
+  };
+
+  /// Builds a Mesh from whole arrays of vertices and faces at once.
+  /// In contrast to Mesh::add_face, vertices are not welded while they are added,
+  /// but in a single pass over their quantized positions sorted once when building the mesh.
+  /// With the default options, the resulting mesh is the same as if all faces were added one by one.
+  class MeshBuilder {
+  public:
+    /// Reserves storage for the given number of vertices, faces and vertex indices of all faces.
+    void reserve(std::size_t vertex_count, std::size_t face_count, std::size_t face_vertex_count);
+
+    /// Appends vertices, without welding them yet.
+    /// \return The builder index of the first appended vertex.
+    VertexIndex add_vertices(std::span<const Vertex> vertices);
+
+    /// Appends a face.
+    /// \param face_vertices 3 or more builder indices of coplanar vertices spanning the face.
+    void add_face(std::span<const VertexIndex> face_vertices);
+
+    /// Appends many faces at once.
+    /// \param face_vertices The builder vertex indices of all faces, concatenated.
+    /// \param face_sizes The number of vertex indices per face, each 3 or more.
+    void add_faces(std::span<const VertexIndex> face_vertices, std::span<const VertexIndex> face_sizes);
+
+    /// Welds the vertices and builds the mesh of all faces.
+    /// The builder is empty afterwards.
+    Mesh build(const MeshBuildOptions& options = {});
+
+  private:
+    std::vector<Vertex> vertices_;
+    std::vector<VertexIndex> face_vertices_;
+    std::vector<VertexIndex> face_sizes_;
+
+    /// Computes for each builder vertex the builder index of the vertex it is merged into.
+    std::vector<VertexIndex> weld() const;
+
+    /// Rewrites the faces, given by mesh vertex indices and sizes, as described by MeshBuildOptions::repair_faces.
+    static void repair_faces(const Mesh& mesh, std::vector<VertexIndex>& face_vertices,
+                             std::vector<VertexIndex>& face_sizes);
+
+    /// Rewrites the valid faces, given by mesh vertex indices and sizes,
+    /// as described by MeshBuildOptions::merge_coplanar_faces.
+    static void merge_coplanar_faces(const Mesh& mesh, std::vector<VertexIndex>& face_vertices,
+                                     std::vector<VertexIndex>& face_sizes);
+
+    /// Removes the vertices not referenced by any face, keeping the order of the others.
+    static void remove_unused_vertices(Mesh& mesh);
+  };
+}
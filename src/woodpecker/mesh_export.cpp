@@ -0,0 +1,399 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+#include "mesh_export.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/crc.hpp>
+#include <fmt/format.h>
+#include <woodpecker/motor_batch.hpp>
+#include <woodpecker/util/cast.hpp>
+#include <woodpecker/util/thread_pool.hpp>
+#include <woodpecker/util/trace.hpp>
+
+namespace wdp {
+  namespace {
+    /// The maximum number of triangles or vertices encoded by a single task.
+    constexpr auto slice_size = std::size_t{1} << 16U;
+
+    /// The number of slices encoded at once per thread, which bounds the memory of encoded data.
+    constexpr auto slices_per_thread = std::size_t{4};
+
+    /// The size of a binary STL triangle record: normal, 3 vertices and an attribute byte count.
+    constexpr auto stl_record_size = std::size_t{50};
+
+    /// A range of triangles or vertices of a part or mesh, encoded by a single task.
+    struct Slice {
+      std::size_t index{};  ///< The index of the part or mesh.
+      std::size_t begin{};
+      std::size_t end{};
+      bool is_triangles{true};  ///< Whether the range is of triangles, or of vertices.
+    };
+
+    /// Splits the range of a part or mesh into slices of at most slice_size elements.
+    void append_slices(std::size_t index, std::size_t size, bool is_triangles, std::vector<Slice>& slices) {
+      for (auto begin = std::size_t{0}; begin < size; begin += slice_size) {
+        slices.push_back({index, begin, std::min(begin + slice_size, size), is_triangles});
+      }
+    }
+
+    /// Encodes slices in parallel and writes them in order, a bounded batch at a time.
+    /// \param encode Called as `encode(slice_idx, buffer)` on any thread of the pool, appending to the empty buffer.
+    /// \param write Called as `write(buffer)` with each encoded slice in order.
+    template <class Encode, class Write>
+    void encode_in_order(std::size_t slice_count, ThreadPool& pool, const Encode& encode, const Write& write) {
+      const auto batch_size = slices_per_thread * pool.thread_count();
+      auto buffers = std::vector<std::string>(batch_size);
+      for (auto batch_begin = std::size_t{0}; batch_begin < slice_count; batch_begin += batch_size) {
+        const auto batch_end = std::min(batch_begin + batch_size, slice_count);
+        pool.parallel_for(batch_begin, batch_end, 1, [&](std::size_t slice_idx) {
+          auto& buffer = buffers[slice_idx - batch_begin];
+          buffer.clear();
+          encode(slice_idx, buffer);
+        });
+        for (auto slice_idx = batch_begin; slice_idx < batch_end; ++slice_idx) {
+          write(std::string_view{buffers[slice_idx - batch_begin]});
+        }
+      }
+    }
+
+    /// Appends a scalar in little-endian byte order.
+    template <class T>
+    void append_scalar(std::string& buffer, T value) {
+      auto bytes = std::bit_cast<std::array<char, sizeof(T)>>(value);
+      if constexpr (std::endian::native != std::endian::little) {
+        std::ranges::reverse(bytes);
+      }
+      buffer.append(bytes.data(), bytes.size());
+    }
+
+    std::ofstream open_output(const std::filesystem::path& path) {
+      auto out = std::ofstream{path, std::ios::binary | std::ios::trunc};
+      if (!out) {
+        throw MeshExportError{fmt::format("could not open {} for writing", path.string())};
+      }
+      return out;
+    }
+
+    /// The triangles of each part, triangulated in parallel beforehand,
+    /// as the triangulation cache of a mesh must not be updated concurrently.
+    std::vector<const std::vector<TriFace>*> part_triangles(const Scene& scene, ThreadPool& pool) {
+      scene.triangulate(pool);
+      auto triangles = std::vector<const std::vector<TriFace>*>{};
+      triangles.reserve(scene.parts().size());
+      for (const auto& part : scene.parts()) {
+        triangles.push_back(&part.mesh().triangles());
+      }
+      return triangles;
+    }
+
+    /// Writes an uncompressed zip file, streaming each entry and patching its local header afterwards.
+    class ZipWriter {
+    public:
+      explicit ZipWriter(std::ofstream& out) : out_{out} {}
+
+      /// Starts a new entry, into which write() appends.
+      void begin_entry(std::string_view name) {
+        entries_.push_back({std::string{name}, 0, 0, checked_offset(out_.tellp())});
+        crc_.reset();
+        write_raw(local_header(entries_.back()));
+      }
+
+      void write(std::string_view data) {
+        crc_.process_bytes(data.data(), data.size());
+        entries_.back().size += data.size();
+        write_raw(data);
+      }
+
+      /// Completes the current entry with its checksum and size.
+      void end_entry() {
+        auto& entry = entries_.back();
+        entry.crc = crc_.checksum();
+        checked_offset(entry.size);
+        const auto end = out_.tellp();
+        out_.seekp(narrow<std::streamoff>(entry.offset));
+        write_raw(local_header(entry));
+        out_.seekp(end);
+      }
+
+      /// Writes the central directory after all entries.
+      void finish() {
+        const auto directory_offset = checked_offset(out_.tellp());
+        auto directory = std::string{};
+        for (const auto& entry : entries_) {
+          append_scalar(directory, std::uint32_t{0x02014b50});
+          append_scalar(directory, zip_version);  // made by
+          append_common_header(directory, entry);
+          append_scalar(directory, std::uint16_t{0});  // comment length
+          append_scalar(directory, std::uint16_t{0});  // disk number
+          append_scalar(directory, std::uint16_t{0});  // internal attributes
+          append_scalar(directory, std::uint32_t{0});  // external attributes
+          append_scalar(directory, narrow<std::uint32_t>(entry.offset));
+          directory += entry.name;
+        }
+        const auto directory_size = directory.size();
+        const auto entry_count = narrow<std::uint16_t>(entries_.size());
+        append_scalar(directory, std::uint32_t{0x06054b50});
+        append_scalar(directory, std::uint16_t{0});  // disk number
+        append_scalar(directory, std::uint16_t{0});  // disk of the directory
+        append_scalar(directory, entry_count);
+        append_scalar(directory, entry_count);
+        append_scalar(directory, narrow<std::uint32_t>(directory_size));
+        append_scalar(directory, narrow<std::uint32_t>(directory_offset));
+        append_scalar(directory, std::uint16_t{0});  // comment length
+        write_raw(directory);
+      }
+
+    private:
+      struct Entry {
+        std::string name;
+        std::uint32_t crc{};
+        std::uint64_t size{};
+        std::uint64_t offset{};  // of the local header
+      };
+
+      static constexpr auto zip_version = std::uint16_t{20};
+      static constexpr auto dos_date = std::uint16_t{(0U << 9U) | (1U << 5U) | 1U};  // 1980-01-01
+
+      std::ofstream& out_;
+      std::vector<Entry> entries_;
+      boost::crc_32_type crc_;
+
+      static std::uint64_t checked_offset(std::uint64_t offset) {
+        if (offset > std::numeric_limits<std::uint32_t>::max()) {
+          throw MeshExportError{"zip file exceeds 4 GiB"};
+        }
+        return offset;
+      }
+      static std::uint64_t checked_offset(std::streampos pos) {
+        return checked_offset(narrow<std::uint64_t>(static_cast<std::streamoff>(pos)));
+      }
+
+      /// Appends the fields shared by local and central headers, from the version needed to the extra field length.
+      static void append_common_header(std::string& header, const Entry& entry) {
+        append_scalar(header, zip_version);          // needed to extract
+        append_scalar(header, std::uint16_t{0});     // flags
+        append_scalar(header, std::uint16_t{0});     // stored, without compression
+        append_scalar(header, std::uint16_t{0});     // time
+        append_scalar(header, dos_date);
+        append_scalar(header, entry.crc);
+        append_scalar(header, narrow<std::uint32_t>(entry.size));  // compressed
+        append_scalar(header, narrow<std::uint32_t>(entry.size));  // uncompressed
+        append_scalar(header, narrow<std::uint16_t>(entry.name.size()));
+        append_scalar(header, std::uint16_t{0});  // extra field length
+      }
+
+      static std::string local_header(const Entry& entry) {
+        auto header = std::string{};
+        append_scalar(header, std::uint32_t{0x04034b50});
+        append_common_header(header, entry);
+        header += entry.name;
+        return header;
+      }
+
+      void write_raw(std::string_view data) {
+        if (!out_.write(data.data(), narrow<std::streamsize>(data.size()))) {
+          throw MeshExportError{"could not write zip file"};
+        }
+      }
+    };
+
+    constexpr auto content_types_xml = std::string_view{
+        R"(<?xml version="1.0" encoding="UTF-8"?>)"
+        "\n"
+        R"(<Types xmlns="http://schemas.openxmlformats.org/package/2006/content-types">)"
+        R"(<Default Extension="rels" ContentType="application/vnd.openxmlformats-package.relationships+xml"/>)"
+        R"(<Default Extension="model" ContentType="application/vnd.ms-package.3dmanufacturing-3dmodel+xml"/>)"
+        "</Types>\n"};
+
+    constexpr auto relationships_xml = std::string_view{
+        R"(<?xml version="1.0" encoding="UTF-8"?>)"
+        "\n"
+        R"(<Relationships xmlns="http://schemas.openxmlformats.org/package/2006/relationships">)"
+        R"(<Relationship Target="/3D/3dmodel.model" Id="rel0" )"
+        R"(Type="http://schemas.microsoft.com/3dmanufacturing/2013/01/3dmodel"/>)"
+        "</Relationships>\n"};
+
+    constexpr auto model_path = std::string_view{"3D/3dmodel.model"};
+  }
+
+  void export_stl(const Scene& scene, const std::filesystem::path& path, ThreadPool& pool) {
+    WDP_TRACE_SCOPE("export_stl");
+    const auto& parts = scene.parts();
+    const auto triangles = part_triangles(scene, pool);
+    auto triangle_count = std::uint64_t{0};
+    for (const auto* part_triangles : triangles) {
+      triangle_count += part_triangles->size();
+    }
+    if (triangle_count > std::numeric_limits<std::uint32_t>::max()) {
+      throw MeshExportError{fmt::format("{} triangles exceed the STL limit", triangle_count)};
+    }
+
+    auto out = open_output(path);
+    auto header = std::string(80, '\0');
+    fmt::format_to_n(header.begin(), header.size(), "binary STL written by Woodpecker");
+    append_scalar(header, narrow<std::uint32_t>(triangle_count));
+    out.write(header.data(), narrow<std::streamsize>(header.size()));
+
+    auto slices = std::vector<Slice>{};
+    for (auto part_idx = std::size_t{0}; part_idx < parts.size(); ++part_idx) {
+      append_slices(part_idx, triangles[part_idx]->size(), true, slices);
+    }
+    const auto encode = [&](std::size_t slice_idx, std::string& buffer) {
+      const auto& slice = slices[slice_idx];
+      const auto& part = parts[slice.index];
+      const auto slice_triangles = std::span{*triangles[slice.index]}.subspan(slice.begin, slice.end - slice.begin);
+
+      // move the corners of the slice by the batched kernel, instead of all vertices of the part
+      auto corners = std::vector<Vertex>{};
+      corners.reserve(slice_triangles.size() * 3);
+      for (const auto& triangle : slice_triangles) {
+        for (const auto vertex_idx : triangle) {
+          corners.push_back(part.mesh().vertices()[vertex_idx]);
+        }
+      }
+      auto positions = std::vector<Vec3>(corners.size());
+      apply_motor(part.motor(), corners, positions);
+
+      buffer.reserve(slice_triangles.size() * stl_record_size);
+      for (auto corner = std::size_t{0}; corner < positions.size(); corner += 3) {
+        const auto& a = positions[corner];
+        const auto& b = positions[corner + 1];
+        const auto& c = positions[corner + 2];
+        auto normal = Vec3{(b[1] - a[1]) * (c[2] - a[2]) - (b[2] - a[2]) * (c[1] - a[1]),
+                           (b[2] - a[2]) * (c[0] - a[0]) - (b[0] - a[0]) * (c[2] - a[2]),
+                           (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0])};
+        const auto length = std::hypot(normal[0], normal[1], normal[2]);
+        for (auto& coord : normal) {
+          coord = length > 0 ? coord / length : 0;
+        }
+        for (const auto& vec : {normal, a, b, c}) {
+          for (const auto coord : vec) {
+            append_scalar(buffer, coord);
+          }
+        }
+        append_scalar(buffer, std::uint16_t{0});  // attribute byte count
+      }
+    };
+    encode_in_order(slices.size(), pool, encode, [&](std::string_view data) {
+      out.write(data.data(), narrow<std::streamsize>(data.size()));
+    });
+
+    out.close();
+    if (!out) {
+      throw MeshExportError{fmt::format("could not write {}", path.string())};
+    }
+  }
+
+  void export_3mf(const Scene& scene, const std::filesystem::path& path, ThreadPool& pool) {
+    WDP_TRACE_SCOPE("export_3mf");
+    const auto& parts = scene.parts();
+    const auto triangles = part_triangles(scene, pool);
+
+    // one object per distinct mesh with triangles, numbered from 1 in order of first use
+    auto meshes = std::vector<const Mesh*>{};
+    auto object_ids = std::unordered_map<const Mesh*, std::size_t>{};
+    for (const auto& part : parts) {
+      if (!part.mesh().triangles().empty() && object_ids.try_emplace(&part.mesh(), meshes.size() + 1).second) {
+        meshes.push_back(&part.mesh());
+      }
+    }
+
+    // each object is written as its vertices, then its triangles
+    auto slices = std::vector<Slice>{};
+    for (auto mesh_idx = std::size_t{0}; mesh_idx < meshes.size(); ++mesh_idx) {
+      append_slices(mesh_idx, meshes[mesh_idx]->vertices().size(), false, slices);
+      append_slices(mesh_idx, meshes[mesh_idx]->triangles().size(), true, slices);
+    }
+    const auto encode = [&](std::size_t slice_idx, std::string& buffer) {
+      auto out = std::back_inserter(buffer);
+      const auto& slice = slices[slice_idx];
+      const auto& mesh = *meshes[slice.index];
+      if (!slice.is_triangles) {
+        if (slice.begin == 0) {
+          fmt::format_to(out, "<object id=\"{}\" type=\"model\"><mesh><vertices>\n", slice.index + 1);
+        }
+        for (auto vertex_idx = slice.begin; vertex_idx < slice.end; ++vertex_idx) {
+          const auto pos = mesh.vertices()[vertex_idx].pos.normalized();
+          fmt::format_to(out, "<vertex x=\"{}\" y=\"{}\" z=\"{}\"/>\n", pos.x(), pos.y(), pos.z());
+        }
+        if (slice.end == mesh.vertices().size()) {
+          fmt::format_to(out, "</vertices><triangles>\n");
+        }
+        return;
+      }
+      for (auto triangle_idx = slice.begin; triangle_idx < slice.end; ++triangle_idx) {
+        const auto& triangle = mesh.triangles()[triangle_idx];
+        fmt::format_to(out, "<triangle v1=\"{}\" v2=\"{}\" v3=\"{}\"/>\n", triangle[0], triangle[1], triangle[2]);
+      }
+      if (slice.end == mesh.triangles().size()) {
+        fmt::format_to(out, "</triangles></mesh></object>\n");
+      }
+    };
+
+    auto out = open_output(path);
+    auto zip = ZipWriter{out};
+    zip.begin_entry("[Content_Types].xml");
+    zip.write(content_types_xml);
+    zip.end_entry();
+    zip.begin_entry("_rels/.rels");
+    zip.write(relationships_xml);
+    zip.end_entry();
+
+    zip.begin_entry(model_path);
+    zip.write(R"(<?xml version="1.0" encoding="UTF-8"?>)"
+              "\n"
+              R"(<model unit="millimeter" xml:lang="en-US" )"
+              R"(xmlns="http://schemas.microsoft.com/3dmanufacturing/core/2015/02">)"
+              "\n<resources>\n");
+    encode_in_order(slices.size(), pool, encode, [&](std::string_view data) { zip.write(data); });
+
+    // place each object by the column-major affine matrix of the motor, as 3MF expects
+    auto build = std::string{"</resources>\n<build>\n"};
+    for (const auto& part : parts) {
+      const auto object_id = object_ids.find(&part.mesh());
+      if (object_id == object_ids.end()) {
+        continue;
+      }
+      const auto& m = part.motor().as_mat4x4().data;
+      fmt::format_to(std::back_inserter(build),
+                     "<item objectid=\"{}\" transform=\"{} {} {} {} {} {} {} {} {} {} {} {}\"/>\n", object_id->second,
+                     m[0], m[1], m[2], m[4], m[5], m[6], m[8], m[9], m[10], m[12], m[13], m[14]);
+    }
+    build += "</build>\n</model>\n";
+    zip.write(build);
+    zip.end_entry();
+    zip.finish();
+
+    out.close();
+    if (!out) {
+      throw MeshExportError{fmt::format("could not write {}", path.string())};
+    }
+  }
+}
@@ -0,0 +1,48 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+
+#include <woodpecker/scene.hpp>
+
+namespace wdp {
+  class ThreadPool;
+
+  /// An error writing a mesh file.
+  class MeshExportError : public std::runtime_error {
+  public:
+    explicit MeshExportError(const std::string& message) : runtime_error(message) {}
+  };
+
+  /// Writes the triangles of all parts of a scene, moved into place by their motors, to a binary STL file.
+  ///
+  /// The triangles are encoded in parallel on the pool, in slices of bounded size which are written in order,
+  /// so that no copy of all triangles of the scene is held in memory at once.
+  /// \throws MeshExportError If the file could not be written or the scene has too many triangles for STL.
+  void export_stl(const Scene& scene, const std::filesystem::path& path, ThreadPool& pool);
+
+  /// Writes all parts of a scene to a 3MF file.
+  ///
+  /// Each mesh shared by several parts is written once as a 3MF object, which is placed by a build item per part,
+  /// transformed by the motor of the part. Like export_stl(), the objects are encoded in parallel in slices of
+  /// bounded size, which are streamed into the uncompressed zip package in order.
+  /// \throws MeshExportError If the file could not be written or exceeds the 4 GiB limit of zip files without Zip64.
+  void export_3mf(const Scene& scene, const std::filesystem::path& path, ThreadPool& pool);
+}
@@ -0,0 +1,798 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+#include "mesh_import.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+#include <woodpecker/mesh_builder.hpp>
+#include <woodpecker/util/assert.hpp>
+#include <woodpecker/util/cast.hpp>
+#include <woodpecker/util/thread_pool.hpp>
+#include <woodpecker/util/trace.hpp>
+
+namespace wdp {
+  namespace {
+    /// The number of bytes read from a file at once.
+    constexpr auto chunk_size = std::size_t{16} << 20U;
+
+    /// The minimum number of bytes of text parsed by a single task.
+    constexpr auto min_piece_size = std::size_t{256} << 10U;
+
+    /// The number of binary STL triangles or PLY vertices parsed by a single task.
+    constexpr auto record_grain_size = std::size_t{16} << 10U;
+
+    /// The size of the binary STL header, followed by the triangle count.
+    constexpr auto stl_header_size = std::size_t{80};
+
+    /// The size of a binary STL triangle record: normal, 3 vertices and an attribute byte count.
+    constexpr auto stl_record_size = std::size_t{50};
+
+    /// The vertices and faces parsed from a piece of a file.
+    struct ParsedPiece {
+      std::vector<Vertex> vertices;
+      std::vector<VertexIndex> face_vertices;  ///< Indices counted from the first vertex of the file.
+      std::vector<VertexIndex> face_sizes;
+
+      /// Face vertex indices relative to the first vertex of the piece, as pairs of the position in #face_vertices
+      /// and the index, as OBJ files refer to vertices relative to the current one with negative indices.
+      std::vector<std::pair<std::size_t, std::int64_t>> relative_face_vertices;
+    };
+
+    /// Collects the parsed pieces of a file in order and builds the mesh from them.
+    class PieceCollector {
+    public:
+      /// Appends the vertices and faces of a piece following all earlier ones.
+      void append(ParsedPiece& piece) {
+        const auto first_vertex = std::int64_t{builder_.add_vertices(piece.vertices)};
+        vertex_count_ += piece.vertices.size();
+        for (const auto& [face_vertex_idx, relative_idx] : piece.relative_face_vertices) {
+          if (first_vertex + relative_idx < 0) {
+            throw MeshImportError{"face vertex index out of range"};
+          }
+          piece.face_vertices[face_vertex_idx] = narrow<VertexIndex>(first_vertex + relative_idx);
+        }
+        if (!piece.face_vertices.empty()) {
+          max_face_vertex_ = std::max(max_face_vertex_, std::size_t{std::ranges::max(piece.face_vertices)} + 1);
+        }
+        builder_.add_faces(piece.face_vertices, piece.face_sizes);
+      }
+
+      /// Adds a triangle for each 3 consecutive vertices, as STL files consist of nothing else.
+      void add_vertex_triangles() {
+        if (vertex_count_ % 3 != 0) {
+          throw MeshImportError{"vertex count is not a multiple of 3"};
+        }
+        constexpr auto block_size = std::size_t{1} << 16U;
+        auto face_vertices = std::vector<VertexIndex>{};
+        const auto face_sizes = std::vector<VertexIndex>(block_size / 3, 3);
+        for (auto block_begin = std::size_t{0}; block_begin < vertex_count_; block_begin += face_sizes.size() * 3) {
+          face_vertices.resize(std::min(face_sizes.size() * 3, vertex_count_ - block_begin));
+          std::iota(face_vertices.begin(), face_vertices.end(), narrow<VertexIndex>(block_begin));
+          builder_.add_faces(face_vertices, std::span{face_sizes}.first(face_vertices.size() / 3));
+        }
+        max_face_vertex_ = vertex_count_;
+      }
+
+      /// Builds the mesh of all pieces, see import_mesh.
+      Mesh build() {
+        if (max_face_vertex_ > vertex_count_) {
+          throw MeshImportError{"face vertex index out of range"};
+        }
+        return builder_.build({.repair_faces = true, .merge_coplanar_faces = true});
+      }
+
+    private:
+      MeshBuilder builder_;
+      std::size_t vertex_count_{0};
+      std::size_t max_face_vertex_{0};  // one past the largest vertex index of any face
+    };
+
+    /// Reads a binary stream through a buffer in large blocks.
+    class ByteReader {
+    public:
+      /// Reads the given number of bytes left in the stream at most.
+      ByteReader(std::istream& in, std::uintmax_t size) : in_{in}, remaining_{size} {}
+
+      /// The number of bytes left in the stream.
+      std::uintmax_t remaining() const noexcept { return remaining_; }
+
+      /// The next bytes of the stream, valid until the next call.
+      /// \throws MeshImportError If the stream ends before.
+      std::span<const char> read(std::size_t size) {
+        if (size > remaining_) {
+          throw MeshImportError{"unexpected end of file"};
+        }
+        if (buffer_end_ - buffer_pos_ < size) {
+          refill(size);
+        }
+        const auto bytes = std::span{buffer_}.subspan(buffer_pos_, size);
+        buffer_pos_ += size;
+        remaining_ -= size;
+        return bytes;
+      }
+
+    private:
+      std::istream& in_;
+      std::uintmax_t remaining_;
+      std::vector<char> buffer_;
+      std::size_t buffer_pos_{0};
+      std::size_t buffer_end_{0};
+
+      void refill(std::size_t min_size) {
+        // keep the unread rest at the front
+        std::copy(buffer_.begin() + narrow<std::ptrdiff_t>(buffer_pos_),
+                  buffer_.begin() + narrow<std::ptrdiff_t>(buffer_end_), buffer_.begin());
+        buffer_end_ -= buffer_pos_;
+        buffer_pos_ = 0;
+
+        buffer_.resize(std::max(buffer_.size(), std::max(min_size, chunk_size)));
+        in_.read(buffer_.data() + buffer_end_, narrow<std::streamsize>(buffer_.size() - buffer_end_));
+        buffer_end_ += narrow<std::size_t>(in_.gcount());
+        if (buffer_end_ < min_size) {
+          throw MeshImportError{"unexpected end of file"};
+        }
+      }
+    };
+
+    /// Loads a scalar of the given type from unaligned bytes, swapping them if the endianness differs.
+    template <class T>
+    T load_scalar(const char* data, std::endian endianness) noexcept {
+      auto bytes = std::array<char, sizeof(T)>{};
+      std::memcpy(bytes.data(), data, sizeof(T));
+      if (endianness != std::endian::native) {
+        std::ranges::reverse(bytes);
+      }
+      return std::bit_cast<T>(bytes);
+    }
+
+    /// Whether the coordinates of a vertex are finite, as welding and the geometry of faces require them to be.
+    bool is_finite_position(float x, float y, float z) noexcept {
+      return std::isfinite(x) && std::isfinite(y) && std::isfinite(z);
+    }
+
+    [[noreturn]] void throw_line_error(std::size_t line_idx, std::string_view message) {
+      throw MeshImportError{fmt::format("line {}: {}", line_idx + 1, message)};
+    }
+
+    bool is_space(char c) noexcept { return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v'; }
+
+    /// Removes and returns the next token of a line, separated by whitespace.
+    std::string_view next_token(std::string_view& line) noexcept {
+      const auto begin = std::ranges::find_if_not(line, is_space) - line.begin();
+      line.remove_prefix(narrow<std::size_t>(begin));
+      const auto end = std::ranges::find_if(line, is_space) - line.begin();
+      const auto token = line.substr(0, narrow<std::size_t>(end));
+      line.remove_prefix(token.size());
+      return token;
+    }
+
+    /// Parses a whole token as a number.
+    template <class T>
+    T parse_number(std::string_view token, std::size_t line_idx) {
+      if (token.starts_with('+')) {
+        token.remove_prefix(1);  // not accepted by from_chars
+      }
+      auto value = T{};
+      const auto [end, error] = std::from_chars(token.data(), token.data() + token.size(), value);
+      if (error != std::errc{} || end != token.data() + token.size()) {
+        throw_line_error(line_idx, fmt::format("invalid number '{}'", token));
+      }
+      return value;
+    }
+
+    /// Parses the next token of a line as a number.
+    template <class T>
+    T parse_next_number(std::string_view& line, std::size_t line_idx) {
+      return parse_number<T>(next_token(line), line_idx);
+    }
+
+    /// Parses the next 3 tokens of a line as the coordinates of a vertex.
+    Vertex parse_next_vertex(std::string_view& line, std::size_t line_idx) {
+      const auto x = parse_next_number<float>(line, line_idx);
+      const auto y = parse_next_number<float>(line, line_idx);
+      const auto z = parse_next_number<float>(line, line_idx);
+      if (!is_finite_position(x, y, z)) {
+        throw_line_error(line_idx, "non-finite vertex coordinate");
+      }
+      return {kln::point{x, y, z}};
+    }
+
+    /// Calls `func(line, line_idx)` for each line of a text, without the line break.
+    template <class Func>
+    void for_each_line(std::string_view text, std::size_t first_line_idx, const Func& func) {
+      for (auto line_idx = first_line_idx; !text.empty(); ++line_idx) {
+        const auto line_end = std::min(text.find('\n'), text.size());
+        func(text.substr(0, line_end), line_idx);
+        text.remove_prefix(std::min(line_end + 1, text.size()));
+      }
+    }
+
+    /// Streams a text in chunks of whole lines, each split into pieces of lines parsed in parallel.
+    /// \param first_line_idx The index of the first line to be read, for error messages.
+    /// \param parse Called as `parse(text, first_line_idx, piece)` for each piece, on any thread of the pool.
+    /// \param collector Receives the parsed pieces in order.
+    template <class Parse>
+    void parse_lines(std::istream& in, std::size_t first_line_idx, ThreadPool& pool, const Parse& parse,
+                     PieceCollector& collector) {
+      auto buffer = std::string{};
+      auto pieces = std::vector<ParsedPiece>{};
+      auto piece_bounds = std::vector<std::size_t>{};
+      auto piece_lines = std::vector<std::size_t>{};
+      for (auto at_end = false; !at_end;) {
+        // append a chunk to the incomplete last line of the previous one
+        const auto carry_size = buffer.size();
+        buffer.resize(carry_size + chunk_size);
+        in.read(buffer.data() + carry_size, narrow<std::streamsize>(chunk_size));
+        buffer.resize(carry_size + narrow<std::size_t>(in.gcount()));
+        if (in.bad()) {
+          throw MeshImportError{"could not read file"};
+        }
+        at_end = buffer.size() < carry_size + chunk_size;
+        const auto last_line_end = buffer.rfind('\n');
+        if (!at_end && last_line_end == std::string::npos) {
+          continue;  // a single line longer than a chunk
+        }
+        const auto text = std::string_view{buffer}.substr(0, at_end ? buffer.size() : last_line_end + 1);
+
+        // split at line breaks near equal sizes
+        const auto max_piece_count = std::clamp(text.size() / min_piece_size, std::size_t{1}, 4 * pool.thread_count());
+        piece_bounds.assign(1, 0);
+        for (auto piece_idx = std::size_t{1}; piece_idx < max_piece_count; ++piece_idx) {
+          const auto target_bound = std::max(piece_bounds.back(), piece_idx * text.size() / max_piece_count);
+          const auto line_end = text.find('\n', target_bound);
+          if (line_end == std::string_view::npos) {
+            break;
+          }
+          piece_bounds.push_back(line_end + 1);
+        }
+        piece_bounds.push_back(text.size());
+        const auto piece_count = piece_bounds.size() - 1;
+        const auto piece_text = [&](std::size_t piece_idx) {
+          return text.substr(piece_bounds[piece_idx], piece_bounds[piece_idx + 1] - piece_bounds[piece_idx]);
+        };
+
+        // count lines before parsing, so that each piece knows the index of its first line
+        piece_lines.assign(piece_count + 1, first_line_idx);
+        pool.parallel_for(0, piece_count, 1, [&](std::size_t piece_idx) {
+          piece_lines[piece_idx + 1] = narrow<std::size_t>(std::ranges::count(piece_text(piece_idx), '\n'));
+        });
+        std::partial_sum(piece_lines.begin(), piece_lines.end(), piece_lines.begin());
+
+        pieces.clear();
+        pieces.resize(piece_count);
+        pool.parallel_for(0, piece_count, 1, [&](std::size_t piece_idx) {
+          parse(piece_text(piece_idx), piece_lines[piece_idx], pieces[piece_idx]);
+        });
+        for (auto& piece : pieces) {
+          collector.append(piece);
+        }
+        first_line_idx = piece_lines.back();
+        buffer.erase(0, text.size());
+      }
+    }
+
+    Mesh import_stl(std::istream& in, std::uintmax_t file_size, ThreadPool& pool) {
+      auto collector = PieceCollector{};
+
+      // binary files may start with "solid" as well, but their size is determined by the triangle count
+      auto header = std::array<char, stl_header_size + sizeof(std::uint32_t)>{};
+      in.read(header.data(), header.size());
+      const auto triangle_count =
+          in.gcount() == header.size()
+              ? load_scalar<std::uint32_t>(header.data() + stl_header_size, std::endian::little)
+              : std::uint32_t{0};
+      if (in.gcount() == header.size() && header.size() + triangle_count * stl_record_size == file_size) {
+        auto reader = ByteReader{in, file_size - header.size()};
+        auto piece = ParsedPiece{};
+        const auto chunk_triangle_count = chunk_size / stl_record_size;
+        for (auto chunk_begin = std::size_t{0}; chunk_begin < triangle_count; chunk_begin += chunk_triangle_count) {
+          const auto chunk_count = std::min(chunk_triangle_count, triangle_count - chunk_begin);
+          const auto records = reader.read(chunk_count * stl_record_size);
+          piece.vertices.resize(chunk_count * 3);
+          pool.parallel_for(0, chunk_count, record_grain_size, [&](std::size_t triangle_idx) {
+            const auto* record = records.data() + triangle_idx * stl_record_size;
+            for (auto corner = std::size_t{0}; corner < 3; ++corner) {
+              const auto* coords = record + (corner + 1) * 3 * sizeof(float);  // behind the normal
+              const auto x = load_scalar<float>(coords, std::endian::little);
+              const auto y = load_scalar<float>(coords + sizeof(float), std::endian::little);
+              const auto z = load_scalar<float>(coords + 2 * sizeof(float), std::endian::little);
+              if (!is_finite_position(x, y, z)) {
+                throw MeshImportError{"non-finite vertex coordinate"};
+              }
+              piece.vertices[triangle_idx * 3 + corner] = {kln::point{x, y, z}};
+            }
+          });
+          collector.append(piece);
+        }
+        collector.add_vertex_triangles();
+        return collector.build();
+      }
+
+      // ASCII files consist of facets of 3 "vertex x y z" lines each, which are the only lines needed
+      if (!std::string_view{header.data(), narrow<std::size_t>(in.gcount())}.starts_with("solid")) {
+        throw MeshImportError{"not an STL file"};
+      }
+      in.clear();
+      in.seekg(0);
+      const auto parse = [](std::string_view text, std::size_t first_line_idx, ParsedPiece& piece) {
+        for_each_line(text, first_line_idx, [&](std::string_view line, std::size_t line_idx) {
+          if (next_token(line) == "vertex") {
+            piece.vertices.push_back(parse_next_vertex(line, line_idx));
+          }
+        });
+      };
+      parse_lines(in, 0, pool, parse, collector);
+      collector.add_vertex_triangles();
+      return collector.build();
+    }
+
+    /// Parses the vertex index of a face vertex token of an OBJ file, such as "7", "-2", "7/3" or "7//5".
+    void parse_obj_face_vertex(std::string_view token, std::size_t line_idx, ParsedPiece& piece) {
+      const auto index = parse_number<std::int64_t>(token.substr(0, token.find('/')), line_idx);
+      if (index > 0 && index <= std::int64_t{std::numeric_limits<VertexIndex>::max()}) {
+        piece.face_vertices.push_back(narrow<VertexIndex>(index - 1));
+      } else if (index < 0) {
+        const auto relative_idx = narrow<std::int64_t>(piece.vertices.size()) + index;
+        piece.relative_face_vertices.emplace_back(piece.face_vertices.size(), relative_idx);
+        piece.face_vertices.push_back(0);
+      } else {
+        throw_line_error(line_idx, "face vertex index out of range");
+      }
+    }
+
+    Mesh import_obj(std::istream& in, ThreadPool& pool) {
+      // all other statements, such as texture coordinates, normals, groups and materials, are skipped
+      const auto parse = [](std::string_view text, std::size_t first_line_idx, ParsedPiece& piece) {
+        for_each_line(text, first_line_idx, [&](std::string_view line, std::size_t line_idx) {
+          const auto statement = next_token(line);
+          if (statement == "v") {
+            piece.vertices.push_back(parse_next_vertex(line, line_idx));
+          } else if (statement == "f") {
+            const auto face_begin = piece.face_vertices.size();
+            for (auto token = next_token(line); !token.empty(); token = next_token(line)) {
+              parse_obj_face_vertex(token, line_idx, piece);
+            }
+            if (piece.face_vertices.size() - face_begin < 3) {
+              throw_line_error(line_idx, "face with less than 3 vertices");
+            }
+            piece.face_sizes.push_back(narrow<VertexIndex>(piece.face_vertices.size() - face_begin));
+          }
+        });
+      };
+      auto collector = PieceCollector{};
+      parse_lines(in, 0, pool, parse, collector);
+      return collector.build();
+    }
+
+    /// The scalar types of PLY properties.
+    enum class PlyType { int8, uint8, int16, uint16, int32, uint32, float32, float64 };
+
+    /// A property of the elements of a PLY file, which is a scalar or a list of scalars preceded by their count.
+    struct PlyProperty {
+      std::string name;
+      PlyType type{};
+      std::optional<PlyType> count_type;  ///< The type of the count of a list property.
+    };
+
+    /// A kind of element of a PLY file, such as vertices or faces.
+    struct PlyElement {
+      std::string name;
+      std::uint64_t count{};
+      std::vector<PlyProperty> properties;
+    };
+
+    /// The parsed header of a PLY file.
+    struct PlyHeader {
+      std::optional<std::endian> endianness;  ///< The endianness of a binary file, nothing for ASCII files.
+      std::vector<PlyElement> elements;
+      std::size_t line_count{};  ///< The number of lines up to the end of the header.
+    };
+
+    std::size_t ply_type_size(PlyType type) noexcept {
+      switch (type) {
+        case PlyType::int8:
+        case PlyType::uint8:
+          return 1;
+        case PlyType::int16:
+        case PlyType::uint16:
+          return 2;
+        case PlyType::int32:
+        case PlyType::uint32:
+        case PlyType::float32:
+          return 4;
+        case PlyType::float64:
+          return 8;
+      }
+      return 0;
+    }
+
+    bool is_ply_integer(PlyType type) noexcept { return type != PlyType::float32 && type != PlyType::float64; }
+
+    /// Loads a binary PLY scalar, converted to the given type.
+    template <class T>
+    T load_ply_scalar(const char* data, PlyType type, std::endian endianness) noexcept {
+      switch (type) {
+        case PlyType::int8:
+          return static_cast<T>(load_scalar<std::int8_t>(data, endianness));
+        case PlyType::uint8:
+          return static_cast<T>(load_scalar<std::uint8_t>(data, endianness));
+        case PlyType::int16:
+          return static_cast<T>(load_scalar<std::int16_t>(data, endianness));
+        case PlyType::uint16:
+          return static_cast<T>(load_scalar<std::uint16_t>(data, endianness));
+        case PlyType::int32:
+          return static_cast<T>(load_scalar<std::int32_t>(data, endianness));
+        case PlyType::uint32:
+          return static_cast<T>(load_scalar<std::uint32_t>(data, endianness));
+        case PlyType::float32:
+          return static_cast<T>(load_scalar<float>(data, endianness));
+        case PlyType::float64:
+          return static_cast<T>(load_scalar<double>(data, endianness));
+      }
+      return T{};
+    }
+
+    PlyType parse_ply_type(std::string_view name, std::size_t line_idx) {
+      static constexpr auto type_names = std::array<std::pair<std::string_view, PlyType>, 16>{{
+          {"char", PlyType::int8},     {"int8", PlyType::int8},       {"uchar", PlyType::uint8},
+          {"uint8", PlyType::uint8},   {"short", PlyType::int16},     {"int16", PlyType::int16},
+          {"ushort", PlyType::uint16}, {"uint16", PlyType::uint16},   {"int", PlyType::int32},
+          {"int32", PlyType::int32},   {"uint", PlyType::uint32},     {"uint32", PlyType::uint32},
+          {"float", PlyType::float32}, {"float32", PlyType::float32}, {"double", PlyType::float64},
+          {"float64", PlyType::float64},
+      }};
+      const auto iter = std::ranges::find(type_names, name, [](const auto& type_name) { return type_name.first; });
+      if (iter == type_names.end()) {
+        throw_line_error(line_idx, fmt::format("unknown property type '{}'", name));
+      }
+      return iter->second;
+    }
+
+    PlyHeader parse_ply_header(std::istream& in) {
+      auto header = PlyHeader{};
+      auto line_buffer = std::string{};
+      auto format_known = false;
+      for (auto line_idx = std::size_t{0};; ++line_idx) {
+        if (!std::getline(in, line_buffer)) {
+          throw MeshImportError{"unexpected end of PLY header"};
+        }
+        auto line = std::string_view{line_buffer};
+        const auto keyword = next_token(line);
+        if (line_idx == 0) {
+          if (keyword != "ply") {
+            throw MeshImportError{"not a PLY file"};
+          }
+        } else if (keyword == "format") {
+          const auto encoding = next_token(line);
+          if (encoding == "binary_little_endian") {
+            header.endianness = std::endian::little;
+          } else if (encoding == "binary_big_endian") {
+            header.endianness = std::endian::big;
+          } else if (encoding != "ascii") {
+            throw_line_error(line_idx, fmt::format("unknown format '{}'", encoding));
+          }
+          format_known = true;
+        } else if (keyword == "element") {
+          const auto name = next_token(line);
+          header.elements.push_back({std::string{name}, parse_next_number<std::uint64_t>(line, line_idx), {}});
+        } else if (keyword == "property") {
+          if (header.elements.empty()) {
+            throw_line_error(line_idx, "property outside of element");
+          }
+          auto property = PlyProperty{};
+          auto type_name = next_token(line);
+          if (type_name == "list") {
+            property.count_type = parse_ply_type(next_token(line), line_idx);
+            if (!is_ply_integer(*property.count_type)) {
+              throw_line_error(line_idx, "list count of non-integer type");
+            }
+            type_name = next_token(line);
+          }
+          property.type = parse_ply_type(type_name, line_idx);
+          property.name = next_token(line);
+          header.elements.back().properties.push_back(std::move(property));
+        } else if (keyword == "end_header") {
+          header.line_count = line_idx + 1;
+          break;
+        }
+      }
+      if (!format_known) {
+        throw MeshImportError{"PLY header without format"};
+      }
+      return header;
+    }
+
+    /// The properties of the vertex and face elements of a PLY file which make up the mesh.
+    struct PlyLayout {
+      std::optional<std::size_t> vertex_element;
+      std::array<std::size_t, 3> position_properties{};  ///< The x, y and z properties of the vertex element.
+      std::optional<std::size_t> face_element;
+      std::size_t index_property{};  ///< The list property of vertex indices of the face element.
+    };
+
+    PlyLayout ply_layout(const PlyHeader& header) {
+      auto layout = PlyLayout{};
+      for (auto element_idx = std::size_t{0}; element_idx < header.elements.size(); ++element_idx) {
+        const auto& element = header.elements[element_idx];
+        const auto find_property = [&](std::string_view name) {
+          const auto iter = std::ranges::find(element.properties, name, &PlyProperty::name);
+          if (iter == element.properties.end()) {
+            return std::optional<std::size_t>{};
+          }
+          return std::optional{narrow<std::size_t>(iter - element.properties.begin())};
+        };
+        if (element.name == "vertex") {
+          const auto x = find_property("x");
+          const auto y = find_property("y");
+          const auto z = find_property("z");
+          if (!x || !y || !z || element.properties[*x].count_type || element.properties[*y].count_type ||
+              element.properties[*z].count_type) {
+            throw MeshImportError{"PLY vertices without scalar x, y and z properties"};
+          }
+          layout.vertex_element = element_idx;
+          layout.position_properties = {*x, *y, *z};
+        } else if (element.name == "face") {
+          auto indices = find_property("vertex_indices");
+          indices = indices ? indices : find_property("vertex_index");
+          if (!indices || !element.properties[*indices].count_type) {
+            throw MeshImportError{"PLY faces without vertex index list"};
+          }
+          layout.face_element = element_idx;
+          layout.index_property = *indices;
+        }
+      }
+      if (!layout.vertex_element || !layout.face_element) {
+        throw MeshImportError{"PLY file without vertices or faces"};
+      }
+      return layout;
+    }
+
+    /// Appends the vertex indices of a face, checking their number.
+    template <class LoadIndex>
+    void push_ply_face(std::uint64_t index_count, const LoadIndex& load_index, ParsedPiece& piece) {
+      if (index_count < 3) {
+        throw MeshImportError{"face with less than 3 vertices"};
+      }
+      for (auto idx = std::uint64_t{0}; idx < index_count; ++idx) {
+        const auto vertex_idx = load_index(idx);
+        if (vertex_idx < 0 || vertex_idx > std::int64_t{std::numeric_limits<VertexIndex>::max()}) {
+          throw MeshImportError{"face vertex index out of range"};
+        }
+        piece.face_vertices.push_back(narrow<VertexIndex>(vertex_idx));
+      }
+      piece.face_sizes.push_back(narrow<VertexIndex>(index_count));
+    }
+
+    void parse_ply_ascii_row(std::string_view line, std::size_t line_idx, const PlyElement& element, bool is_vertex,
+                             const PlyLayout& layout, ParsedPiece& piece) {
+      auto position = std::array<float, 3>{};
+      for (auto property_idx = std::size_t{0}; property_idx < element.properties.size(); ++property_idx) {
+        const auto& property = element.properties[property_idx];
+        if (!property.count_type) {
+          const auto value = parse_next_number<double>(line, line_idx);
+          for (auto axis = std::size_t{0}; is_vertex && axis < 3; ++axis) {
+            if (layout.position_properties[axis] == property_idx) {
+              position[axis] = static_cast<float>(value);
+            }
+          }
+          continue;
+        }
+        const auto count = parse_next_number<std::uint64_t>(line, line_idx);
+        if (!is_vertex && property_idx == layout.index_property) {
+          if (count < 3) {
+            throw_line_error(line_idx, "face with less than 3 vertices");
+          }
+          push_ply_face(count, [&](std::uint64_t) { return parse_next_number<std::int64_t>(line, line_idx); }, piece);
+        } else {
+          for (auto idx = std::uint64_t{0}; idx < count; ++idx) {
+            parse_next_number<double>(line, line_idx);
+          }
+        }
+      }
+      if (is_vertex) {
+        // also catches values out of the range of float
+        if (!is_finite_position(position[0], position[1], position[2])) {
+          throw_line_error(line_idx, "non-finite vertex coordinate");
+        }
+        piece.vertices.push_back({kln::point{position[0], position[1], position[2]}});
+      }
+    }
+
+    void import_ply_ascii(std::istream& in, const PlyHeader& header, const PlyLayout& layout, ThreadPool& pool,
+                          PieceCollector& collector) {
+      // each line is a row of the element whose rows span its index
+      auto element_ends = std::vector<std::uint64_t>{};
+      for (const auto& element : header.elements) {
+        element_ends.push_back((element_ends.empty() ? header.line_count : element_ends.back()) + element.count);
+      }
+      const auto parse = [&](std::string_view text, std::size_t first_line_idx, ParsedPiece& piece) {
+        for_each_line(text, first_line_idx, [&](std::string_view line, std::size_t line_idx) {
+          const auto element_idx = narrow<std::size_t>(std::ranges::upper_bound(element_ends, line_idx) -
+                                                       element_ends.begin());
+          if (element_idx == layout.vertex_element || element_idx == layout.face_element) {
+            parse_ply_ascii_row(line, line_idx, header.elements[element_idx], element_idx == layout.vertex_element,
+                                layout, piece);
+          }
+        });
+      };
+      parse_lines(in, header.line_count, pool, parse, collector);
+    }
+
+    void import_ply_binary(std::istream& in, std::uintmax_t file_size, const PlyHeader& header, const PlyLayout& layout,
+                           ThreadPool& pool, PieceCollector& collector) {
+      const auto endianness = *header.endianness;
+      const auto header_size = static_cast<std::uintmax_t>(std::streamoff{in.tellg()});
+      auto reader = ByteReader{in, file_size - std::min(header_size, file_size)};
+      auto piece = ParsedPiece{};
+      for (auto element_idx = std::size_t{0}; element_idx < header.elements.size(); ++element_idx) {
+        const auto& element = header.elements[element_idx];
+        const auto is_vertex = element_idx == layout.vertex_element;
+        const auto is_face = element_idx == layout.face_element;
+
+        // rows of scalars have a fixed size, so that chunks of them are parsed in parallel
+        auto property_offsets = std::vector<std::size_t>{0};
+        for (const auto& property : element.properties) {
+          const auto property_size = property.count_type ? 0 : ply_type_size(property.type);
+          property_offsets.push_back(property_offsets.back() + property_size);
+        }
+        const auto row_size = property_offsets.back();
+        const auto is_list = [](const PlyProperty& property) { return property.count_type.has_value(); };
+        if (std::ranges::none_of(element.properties, is_list)) {
+          const auto chunk_row_count = std::max(chunk_size / std::max(row_size, std::size_t{1}), std::size_t{1});
+          for (auto chunk_begin = std::uint64_t{0}; chunk_begin < element.count; chunk_begin += chunk_row_count) {
+            const auto chunk_count = narrow<std::size_t>(std::min<std::uint64_t>(chunk_row_count,
+                                                                                 element.count - chunk_begin));
+            const auto rows = reader.read(chunk_count * row_size);
+            if (!is_vertex) {
+              continue;
+            }
+            piece.vertices.resize(chunk_count);
+            pool.parallel_for(0, chunk_count, record_grain_size, [&](std::size_t row_idx) {
+              const auto load_coord = [&](std::size_t axis) {
+                const auto& property = element.properties[layout.position_properties[axis]];
+                const auto offset = row_idx * row_size + property_offsets[layout.position_properties[axis]];
+                return load_ply_scalar<float>(rows.data() + offset, property.type, endianness);
+              };
+              const auto x = load_coord(0);
+              const auto y = load_coord(1);
+              const auto z = load_coord(2);
+              if (!is_finite_position(x, y, z)) {
+                throw MeshImportError{"non-finite vertex coordinate"};
+              }
+              piece.vertices[row_idx] = {kln::point{x, y, z}};
+            });
+            collector.append(piece);
+          }
+          continue;
+        }
+
+        // rows with lists are parsed one after another
+        piece.vertices.clear();
+        for (auto row_idx = std::uint64_t{0}; row_idx < element.count; ++row_idx) {
+          auto position = std::array<float, 3>{};
+          for (auto property_idx = std::size_t{0}; property_idx < element.properties.size(); ++property_idx) {
+            const auto& property = element.properties[property_idx];
+            const auto type_size = ply_type_size(property.type);
+            if (!property.count_type) {
+              const auto value = load_ply_scalar<float>(reader.read(type_size).data(), property.type, endianness);
+              for (auto axis = std::size_t{0}; is_vertex && axis < 3; ++axis) {
+                position[axis] = layout.position_properties[axis] == property_idx ? value : position[axis];
+              }
+              continue;
+            }
+            const auto count_size = ply_type_size(*property.count_type);
+            const auto count = load_ply_scalar<std::uint64_t>(reader.read(count_size).data(), *property.count_type,
+                                                              endianness);
+            if (count > reader.remaining() / type_size) {
+              throw MeshImportError{"PLY list longer than the rest of the file"};
+            }
+            const auto values = reader.read(narrow<std::size_t>(count) * type_size);
+            if (is_face && property_idx == layout.index_property) {
+              const auto load_index = [&](std::uint64_t idx) {
+                return load_ply_scalar<std::int64_t>(values.data() + idx * type_size, property.type, endianness);
+              };
+              push_ply_face(count, load_index, piece);
+            }
+          }
+          if (is_vertex) {
+            if (!is_finite_position(position[0], position[1], position[2])) {
+              throw MeshImportError{"non-finite vertex coordinate"};
+            }
+            piece.vertices.push_back({kln::point{position[0], position[1], position[2]}});
+          }
+        }
+        collector.append(piece);
+        piece = ParsedPiece{};
+      }
+    }
+
+    Mesh import_ply(std::istream& in, std::uintmax_t file_size, ThreadPool& pool) {
+      const auto header = parse_ply_header(in);
+      const auto layout = ply_layout(header);
+      auto collector = PieceCollector{};
+      if (header.endianness) {
+        import_ply_binary(in, file_size, header, layout, pool, collector);
+      } else {
+        import_ply_ascii(in, header, layout, pool, collector);
+      }
+      return collector.build();
+    }
+  }
+
+  std::optional<MeshFileFormat> mesh_file_format(const std::filesystem::path& path) {
+    auto extension = path.extension().string();
+    std::ranges::transform(extension, extension.begin(), [](unsigned char c) { return std::tolower(c); });
+    if (extension == ".stl") {
+      return MeshFileFormat::stl;
+    }
+    if (extension == ".obj") {
+      return MeshFileFormat::obj;
+    }
+    if (extension == ".ply") {
+      return MeshFileFormat::ply;
+    }
+    return std::nullopt;
+  }
+
+  Mesh import_mesh(const std::filesystem::path& path, ThreadPool& pool) {
+    const auto format = mesh_file_format(path);
+    if (!format) {
+      throw MeshImportError{fmt::format("{} has an unknown mesh file extension", path.string())};
+    }
+    return import_mesh(path, *format, pool);
+  }
+
+  Mesh import_mesh(const std::filesystem::path& path, MeshFileFormat format, ThreadPool& pool) {
+    WDP_TRACE_SCOPE("import_mesh");
+    auto in = std::ifstream{path, std::ios::binary};
+    if (!in) {
+      throw MeshImportError{fmt::format("could not open {}", path.string())};
+    }
+    try {
+      switch (format) {
+        case MeshFileFormat::stl:
+          return import_stl(in, std::filesystem::file_size(path), pool);
+        case MeshFileFormat::obj:
+          return import_obj(in, pool);
+        case MeshFileFormat::ply:
+          return import_ply(in, std::filesystem::file_size(path), pool);
+      }
+      WDP_ASSERT(false, "unknown mesh file format");
+      return {};
+    } catch (const MeshImportError& e) {
+      throw MeshImportError{fmt::format("{}: {}", path.string(), e.what())};
+    } catch (const std::filesystem::filesystem_error& e) {
+      throw MeshImportError{fmt::format("{}: {}", path.string(), e.what())};
+    }
+  }
+}
@@ -0,0 +1,59 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+#include <woodpecker/mesh.hpp>
+
+namespace wdp {
+  class ThreadPool;
+
+  /// The file formats from which meshes are imported.
+  enum class MeshFileFormat {
+    stl,  ///< STL, in binary or ASCII encoding.
+    obj,  ///< Wavefront OBJ, of which only vertex positions and faces are read.
+    ply,  ///< Stanford PLY, in ASCII or binary encoding of either endianness.
+  };
+
+  /// An error reading a mesh file.
+  class MeshImportError : public std::runtime_error {
+  public:
+    explicit MeshImportError(const std::string& message) : runtime_error(message) {}
+  };
+
+  /// Determines the format of a mesh file from its extension, ignoring case.
+  std::optional<MeshFileFormat> mesh_file_format(const std::filesystem::path& path);
+
+  /// Imports a mesh from a file in a format determined by its extension.
+  /// \throws MeshImportError If the format is unknown, or see the other overload.
+  Mesh import_mesh(const std::filesystem::path& path, ThreadPool& pool);
+
+  /// Imports a mesh from a file in the given format.
+  ///
+  /// The file is streamed in chunks of a few megabytes, each of which is parsed on all threads of the pool,
+  /// so that even multi-gigabyte scans are never held in memory as a whole.
+  /// The parsed polygons are built into a mesh in bulk by MeshBuilder, welding vertices closer than
+  /// Mesh::merge_dist, repairing degenerate and non-planar faces and merging regions of coplanar triangles,
+  /// as written by most exporters, back into polygonal faces.
+  /// The winding order of faces is kept as in the file.
+  /// \throws MeshImportError If the file could not be read or is malformed.
+  Mesh import_mesh(const std::filesystem::path& path, MeshFileFormat format, ThreadPool& pool);
+}
@@ -0,0 +1,60 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "mesh_pool.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace wdp {
+  SharedMesh MeshPool::intern(Mesh mesh) {
+    return intern(std::make_shared<const Mesh>(std::move(mesh)));
+  }
+
+  SharedMesh MeshPool::intern(const SharedMesh& mesh) {
+    // a mesh from the pool, e.g. shared by many parts, is found without hashing its content
+    if (const auto iter = pooled_.find(mesh.get()); iter != pooled_.end() && iter->second.lock() == mesh) {
+      return mesh;
+    }
+    const auto hash = mesh->content_hash();
+    const auto [begin, end] = meshes_.equal_range(hash);
+    for (auto iter = begin; iter != end; ++iter) {
+      if (auto existing = iter->second.lock(); existing && existing->same_content(*mesh)) {
+        return existing;
+      }
+    }
+    prune();
+    meshes_.emplace(hash, mesh);
+    pooled_.insert_or_assign(mesh.get(), mesh);
+    return mesh;
+  }
+
+  std::size_t MeshPool::size() const {
+    return static_cast<std::size_t>(
+        std::ranges::count_if(meshes_, [](const auto& entry) { return !entry.second.expired(); }));
+  }
+
+  void MeshPool::prune() {
+    if (meshes_.size() < prune_threshold_) {
+      return;
+    }
+    std::erase_if(meshes_, [](const auto& entry) { return entry.second.expired(); });
+    std::erase_if(pooled_, [](const auto& entry) { return entry.second.expired(); });
+    // amortized constant time per insertion
+    prune_threshold_ = std::max(prune_threshold_, 2 * meshes_.size());
+  }
+}
@@ -0,0 +1,52 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <unordered_map>
+
+#include <woodpecker/mesh.hpp>
+
+namespace wdp {
+  /// A shared, immutable mesh, referenced by any number of parts.
+  using SharedMesh = std::shared_ptr<const Mesh>;
+
+  /// Deduplicates meshes by content, so that parts with identical geometry share a single mesh.
+  /// The pool does not own its meshes: a mesh is released when the last part referencing it is gone.
+  /// Must not be used concurrently.
+  class MeshPool {
+  public:
+    /// The shared mesh with the same content as the given one, taking ownership of it if there is none yet.
+    SharedMesh intern(Mesh mesh);
+
+    /// The shared mesh with the same content as the given one, which is added to the pool if there is none yet.
+    SharedMesh intern(const SharedMesh& mesh);
+
+    /// The number of distinct meshes in the pool which are still referenced.
+    std::size_t size() const;
+
+  private:
+    std::unordered_multimap<std::size_t, std::weak_ptr<const Mesh>> meshes_;  // by content hash
+    std::unordered_map<const Mesh*, std::weak_ptr<const Mesh>> pooled_;       // by address, to skip hashing
+    std::size_t prune_threshold_{16};
+
+    /// Removes the entries of released meshes, once the pool has grown enough since the last time.
+    void prune();
+  };
+}
@@ -0,0 +1,740 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "mesh_validation.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+#include <boost/container/small_vector.hpp>
+#include <boost/container_hash/hash.hpp>
+#include <woodpecker/util/assert.hpp>
+#include <woodpecker/util/cast.hpp>
+#include <woodpecker/util/trace.hpp>
+
+namespace wdp {
+  namespace {
+    /// The minimum doubled area of a face, as of the triangle at a corner spanning a plane in MeshBuilder.
+    constexpr auto min_face_area = double{Mesh::merge_dist} * Mesh::merge_dist;
+
+    /// No face, as the face of a missing half-edge.
+    constexpr auto no_face = std::numeric_limits<FaceIndex>::max();
+
+    using Vec3d = std::array<double, 3>;
+
+    /// Faces in compressed sparse row layout, as stored in Mesh.
+    struct FaceSpans {
+      std::span<const VertexIndex> vertices;
+      std::span<const std::size_t> offsets;
+      std::span<const kln::plane> planes;
+
+      std::size_t size() const noexcept { return planes.size(); }
+
+      std::span<const VertexIndex> face(std::size_t index) const noexcept {
+        return vertices.subspan(offsets[index], offsets[index + 1] - offsets[index]);
+      }
+    };
+
+    /// Faces in compressed sparse row layout while they are repaired.
+    struct FaceList {
+      std::vector<VertexIndex> vertices;
+      std::vector<std::size_t> offsets{0};
+      std::vector<kln::plane> planes;
+      std::vector<FaceIndex> sources;  ///< The face of the mesh each face was made from.
+
+      std::size_t size() const noexcept { return planes.size(); }
+
+      std::span<VertexIndex> face(std::size_t index) noexcept {
+        return std::span{vertices}.subspan(offsets[index], offsets[index + 1] - offsets[index]);
+      }
+
+      void add(std::span<const VertexIndex> face, const kln::plane& plane, FaceIndex source) {
+        vertices.insert(vertices.end(), face.begin(), face.end());
+        offsets.push_back(vertices.size());
+        planes.push_back(plane);
+        sources.push_back(source);
+      }
+
+      FaceSpans spans() const noexcept { return {vertices, offsets, planes}; }
+    };
+
+    /// A directed edge of a face, from a vertex to the next one.
+    struct HalfEdge {
+      FaceIndex face{no_face};
+      VertexIndex from{};
+    };
+
+    /// The faces along an edge.
+    struct EdgeFaces {
+      std::array<HalfEdge, 2> first;  ///< The first two half-edges along the edge.
+      std::uint32_t count{};          ///< The number of half-edges along the edge.
+
+      /// The half-edge along the edge other than the given one, of a manifold edge.
+      const HalfEdge& opposite(const HalfEdge& half_edge) const noexcept {
+        return first[0].face == half_edge.face && first[0].from == half_edge.from ? first[1] : first[0];
+      }
+    };
+
+    /// The edges of faces with the faces along them, and the edge of each half-edge of the faces.
+    struct EdgeMap {
+      std::vector<EdgeFaces> edges;
+      std::vector<std::uint32_t> half_edge_edges;  ///< By position of the start vertex in the face vertices.
+
+      /// The edge of the half-edge starting at a position in the face vertices, of a face which was not skipped.
+      const EdgeFaces& of(std::size_t position) const noexcept { return edges[half_edge_edges[position]]; }
+    };
+
+    /// The key of an undirected edge, equal for both of its half-edges.
+    std::uint64_t edge_key(VertexIndex a, VertexIndex b) noexcept {
+      return (std::uint64_t{std::min(a, b)} << 32U) | std::uint64_t{std::max(a, b)};
+    }
+
+    /// Calls `func(from, to)` for each directed edge of a face.
+    template <class Func>
+    void for_each_half_edge(std::span<const VertexIndex> face, const Func& func) {
+      for (std::size_t idx = 0; idx < face.size(); ++idx) {
+        func(face[idx], face[(idx + 1) % face.size()]);
+      }
+    }
+
+    /// Calls `func(from, to, position)` for each directed edge of a face,
+    /// with the position of its start vertex in the face vertices.
+    template <class Func>
+    void for_each_face_edge(const FaceSpans& faces, FaceIndex face_idx, const Func& func) {
+      const auto face = faces.face(face_idx);
+      const auto offset = faces.offsets[face_idx];
+      for (std::size_t idx = 0; idx < face.size(); ++idx) {
+        func(face[idx], face[(idx + 1) % face.size()], offset + idx);
+      }
+    }
+
+    /// Maps each edge of the faces which are not skipped to the faces along it.
+    /// Each half-edge is looked up in a hash map once, later passes index the edges by half-edge.
+    EdgeMap map_edges(const FaceSpans& faces, const std::vector<bool>& skipped) {
+      auto map = EdgeMap{};
+      map.half_edge_edges.resize(faces.vertices.size());
+      auto edge_ids = std::unordered_map<std::uint64_t, std::uint32_t>{};
+      edge_ids.reserve(faces.vertices.size());
+      for (auto face_idx = FaceIndex{0}; face_idx < faces.size(); ++face_idx) {
+        if (skipped[face_idx]) {
+          continue;
+        }
+        for_each_face_edge(faces, face_idx, [&](VertexIndex from, VertexIndex to, std::size_t position) {
+          const auto next_id = narrow<std::uint32_t>(map.edges.size());
+          const auto [iter, inserted] = edge_ids.try_emplace(edge_key(from, to), next_id);
+          if (inserted) {
+            map.edges.emplace_back();
+          }
+          auto& edge = map.edges[iter->second];
+          if (edge.count < edge.first.size()) {
+            edge.first[edge.count] = {face_idx, from};
+          }
+          ++edge.count;
+          map.half_edge_edges[position] = iter->second;
+        });
+      }
+      return map;
+    }
+
+    Vec3d position(std::span<const Vertex> vertices, VertexIndex index) {
+      const auto pos = vertices[index].pos.normalized();
+      return {pos.x(), pos.y(), pos.z()};
+    }
+
+    /// The normal of a polygon with the length of its doubled area, oriented like the planes joining its corners:
+    /// the sum of the planes joining its first vertex with each of its edges.
+    Vec3d winding_normal(std::span<const Vertex> vertices, std::span<const VertexIndex> face) {
+      const auto& origin = vertices[face[0]].pos;
+      auto normal = Vec3d{};
+      for (std::size_t idx = 1; idx + 1 < face.size(); ++idx) {
+        const auto plane = origin & vertices[face[idx]].pos & vertices[face[idx + 1]].pos;
+        normal[0] += plane.x();
+        normal[1] += plane.y();
+        normal[2] += plane.z();
+      }
+      return normal;
+    }
+
+    double dot(const Vec3d& a, const Vec3d& b) noexcept { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+
+    double dot(const Vec3d& normal, const kln::plane& plane) noexcept {
+      return normal[0] * plane.x() + normal[1] * plane.y() + normal[2] * plane.z();
+    }
+
+    /// Whether a face with a winding normal winds along a plane, which fails for planes which are not finite.
+    bool winds_along(const Vec3d& normal, const kln::plane& plane) noexcept { return dot(normal, plane) > 0; }
+
+    bool repeats_consecutive_vertex(std::span<const VertexIndex> face) {
+      for (std::size_t idx = 0; idx < face.size(); ++idx) {
+        if (face[idx] == face[(idx + 1) % face.size()]) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    bool is_degenerate(std::span<const Vertex> vertices, std::span<const VertexIndex> face) {
+      if (face.size() < 3 || repeats_consecutive_vertex(face)) {
+        return true;
+      }
+      const auto normal = winding_normal(vertices, face);
+      return dot(normal, normal) < min_face_area * min_face_area;
+    }
+
+    /// A hash of the vertex cycle of a face, equal for all rotations of the cycle in either direction.
+    std::size_t cycle_hash(std::span<const VertexIndex> face) {
+      auto sum = std::size_t{};
+      for_each_half_edge(face, [&](VertexIndex from, VertexIndex to) { sum += boost::hash_value(edge_key(from, to)); });
+      auto seed = face.size();
+      boost::hash_combine(seed, sum);
+      return seed;
+    }
+
+    /// Whether two faces have the same vertex cycle, in the same (1) or opposite (-1) direction, or not (0).
+    int compare_cycles(std::span<const VertexIndex> a, std::span<const VertexIndex> b) {
+      const auto size = a.size();
+      if (b.size() != size) {
+        return 0;
+      }
+      for (std::size_t start = 0; start < size; ++start) {
+        if (b[start] != a[0]) {
+          continue;
+        }
+        auto same = true;
+        auto opposite = true;
+        for (std::size_t idx = 1; idx < size && (same || opposite); ++idx) {
+          same = same && b[(start + idx) % size] == a[idx];
+          opposite = opposite && b[(start + size - idx) % size] == a[idx];
+        }
+        if (same || opposite) {
+          return same ? 1 : -1;
+        }
+      }
+      return 0;
+    }
+
+    /// Finds the faces repeating the vertex cycle of an earlier face, which are not skipped,
+    /// and calls `func(face, earlier_face, direction)` for each with the direction from compare_cycles().
+    template <class Func>
+    void for_each_repeated_face(const FaceSpans& faces, const std::vector<bool>& skipped, const Func& func) {
+      auto cycles = std::unordered_multimap<std::size_t, FaceIndex>{};
+      cycles.reserve(faces.size());
+      for (auto face_idx = FaceIndex{0}; face_idx < faces.size(); ++face_idx) {
+        if (skipped[face_idx]) {
+          continue;
+        }
+        const auto face = faces.face(face_idx);
+        const auto hash = cycle_hash(face);
+        const auto [begin, end] = cycles.equal_range(hash);
+        const auto earlier = std::find_if(begin, end, [&](const auto& entry) {
+          return compare_cycles(faces.face(entry.second), face) != 0;
+        });
+        if (earlier == end) {
+          cycles.emplace(hash, face_idx);
+        } else {
+          func(face_idx, earlier->second, compare_cycles(faces.face(earlier->second), face));
+        }
+      }
+    }
+
+    /// Whether an opposite face is an inner wall between two solids together with the face it repeats,
+    /// rather than the back of a double-sided face: then each of its edges is shared by the faces of both solids.
+    bool is_inner_wall(const FaceSpans& faces, FaceIndex face_idx, const EdgeMap& edges) {
+      auto inner = true;
+      for_each_face_edge(faces, face_idx, [&](VertexIndex, VertexIndex, std::size_t position) {
+        inner = inner && edges.of(position).count >= 4;
+      });
+      return inner;
+    }
+
+    /// Two-colours the faces of each edge-connected component by whether they are wound like the first face
+    /// of the component, across manifold edges. Faces which are not skipped and are wound against the majority
+    /// of their component are flipped. Conflicts of non-orientable components are ignored.
+    std::vector<bool> find_flipped_faces(const FaceSpans& faces, const EdgeMap& edges,
+                                         const std::vector<bool>& skipped) {
+      auto reversed = std::vector<std::int8_t>(faces.size(), -1);
+      auto flipped = std::vector<bool>(faces.size());
+      auto component = std::vector<FaceIndex>{};
+      for (auto seed = FaceIndex{0}; seed < faces.size(); ++seed) {
+        if (skipped[seed] || reversed[seed] >= 0) {
+          continue;
+        }
+        // breadth-first over the component, which is kept in visiting order
+        component.clear();
+        component.push_back(seed);
+        reversed[seed] = 0;
+        auto reversed_count = std::size_t{0};
+        for (std::size_t next = 0; next < component.size(); ++next) {
+          const auto face_idx = component[next];
+          for_each_face_edge(faces, face_idx, [&](VertexIndex from, VertexIndex, std::size_t position) {
+            const auto& edge = edges.of(position);
+            if (edge.count != 2) {
+              return;
+            }
+            const auto& other = edge.opposite({face_idx, from});
+            if (other.face == face_idx || reversed[other.face] >= 0) {
+              return;
+            }
+            // consistently wound neighbours run along their shared edge in opposite directions
+            reversed[other.face] = static_cast<std::int8_t>(reversed[face_idx] ^ (other.from == from ? 1 : 0));
+            reversed_count += narrow_cast<std::size_t>(reversed[other.face]);
+            component.push_back(other.face);
+          });
+        }
+        const auto flipped_value = reversed_count * 2 > component.size() ? 0 : 1;
+        for (const auto face_idx : component) {
+          flipped[face_idx] = reversed[face_idx] == flipped_value;
+        }
+      }
+      return flipped;
+    }
+
+    /// Whether a vertex lies inside of the segment between two others, further along it than a given fraction.
+    /// \return The fraction of the segment at which the vertex lies.
+    std::optional<double> segment_fraction(const Vec3d& begin, const Vec3d& end, const Vec3d& point,
+                                           double min_fraction) {
+      const auto dir = Vec3d{end[0] - begin[0], end[1] - begin[1], end[2] - begin[2]};
+      const auto offset = Vec3d{point[0] - begin[0], point[1] - begin[1], point[2] - begin[2]};
+      const auto length_sq = dot(dir, dir);
+      const auto fraction = dot(offset, dir) / length_sq;
+      const auto margin = Mesh::merge_dist / std::sqrt(length_sq);
+      if (!(fraction > std::max(min_fraction, margin) && fraction < 1 - margin)) {
+        return std::nullopt;
+      }
+      const auto dist = Vec3d{offset[0] - fraction * dir[0], offset[1] - fraction * dir[1],
+                              offset[2] - fraction * dir[2]};
+      return dot(dist, dist) < double{Mesh::merge_dist} * Mesh::merge_dist ? std::optional{fraction} : std::nullopt;
+    }
+
+    /// The boundary edges of faces, and the vertices connected to each vertex by them, in compressed sparse rows.
+    struct BoundaryGraph {
+      std::vector<std::size_t> offsets;
+      std::vector<VertexIndex> neighbours;
+
+      BoundaryGraph(std::size_t vertex_count, const FaceSpans& faces, const EdgeMap& edges,
+                    const std::vector<bool>& skipped) {
+        offsets.assign(vertex_count + 1, 0);
+        const auto for_each_boundary_edge = [&](const auto& func) {
+          for (auto face_idx = FaceIndex{0}; face_idx < faces.size(); ++face_idx) {
+            if (!skipped[face_idx]) {
+              for_each_face_edge(faces, face_idx, [&](VertexIndex from, VertexIndex to, std::size_t position) {
+                if (edges.of(position).count == 1) {
+                  func(from, to);
+                }
+              });
+            }
+          }
+        };
+        for_each_boundary_edge([&](VertexIndex from, VertexIndex to) {
+          ++offsets[from + 1];
+          ++offsets[to + 1];
+        });
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        neighbours.resize(offsets.back());
+        auto fill = std::vector<std::size_t>(offsets.begin(), offsets.end() - 1);
+        for_each_boundary_edge([&](VertexIndex from, VertexIndex to) {
+          neighbours[fill[from]++] = to;
+          neighbours[fill[to]++] = from;
+        });
+      }
+
+      std::span<const VertexIndex> neighbours_of(VertexIndex vertex) const noexcept {
+        return std::span{neighbours}.subspan(offsets[vertex], offsets[vertex + 1] - offsets[vertex]);
+      }
+
+      /// The vertices inside of a boundary edge, in order from its start,
+      /// as far as they are connected to its start by boundary edges along it.
+      boost::container::small_vector<VertexIndex, 4> edge_vertices(std::span<const Vertex> vertices,
+                                                                    VertexIndex from, VertexIndex to) const {
+        auto inner = boost::container::small_vector<VertexIndex, 4>{};
+        const auto begin = position(vertices, from);
+        const auto end = position(vertices, to);
+        auto current = from;
+        auto fraction = 0.0;
+        while (true) {
+          auto next = std::optional<VertexIndex>{};
+          for (const auto neighbour : neighbours_of(current)) {
+            if (neighbour == to || neighbour == from) {
+              continue;
+            }
+            if (const auto neighbour_fraction = segment_fraction(begin, end, position(vertices, neighbour), fraction)) {
+              next = neighbour;
+              fraction = *neighbour_fraction;
+              break;
+            }
+          }
+          if (!next) {
+            return inner;
+          }
+          inner.push_back(*next);
+          current = *next;
+        }
+      }
+    };
+
+    /// The right-handed normal of a polygon with the length of its doubled area, which points outwards from faces
+    /// wound counter-clockwise seen from outside. Unlike the planes joining its corners, it is oriented by the
+    /// winding alone, as in CSG.
+    Vec3d right_hand_normal(std::span<const Vertex> vertices, std::span<const VertexIndex> face) {
+      const auto origin = position(vertices, face[0]);
+      auto normal = Vec3d{};
+      for (std::size_t idx = 1; idx + 1 < face.size(); ++idx) {
+        const auto b = position(vertices, face[idx]);
+        const auto c = position(vertices, face[idx + 1]);
+        const auto u = Vec3d{b[0] - origin[0], b[1] - origin[1], b[2] - origin[2]};
+        const auto v = Vec3d{c[0] - origin[0], c[1] - origin[1], c[2] - origin[2]};
+        normal[0] += u[1] * v[2] - u[2] * v[1];
+        normal[1] += u[2] * v[0] - u[0] * v[2];
+        normal[2] += u[0] * v[1] - u[1] * v[0];
+      }
+      return normal;
+    }
+
+    /// The volume enclosed by faces, or its negation if they are wound clockwise seen from outside.
+    double signed_volume(std::span<const Vertex> vertices, const FaceSpans& faces, const std::vector<bool>& skipped) {
+      auto volume = 0.0;
+      for (auto face_idx = FaceIndex{0}; face_idx < faces.size(); ++face_idx) {
+        if (!skipped[face_idx]) {
+          const auto face = faces.face(face_idx);
+          volume += dot(right_hand_normal(vertices, face), position(vertices, face[0]));
+        }
+      }
+      return volume / 6;
+    }
+
+    /// Whether each edge of the faces is manifold and run in opposite directions by its two faces.
+    bool is_closed_and_consistent(const EdgeMap& edges) {
+      return std::ranges::all_of(edges.edges, [](const EdgeFaces& edge) {
+        return edge.count == 2 && edge.first[0].from != edge.first[1].from;
+      });
+    }
+
+    /// Reverses the winding of a face, keeping the corner of its first 3 vertices in front, and turns its plane.
+    void flip_face(FaceList& faces, std::size_t face_idx) {
+      const auto face = faces.face(face_idx);
+      std::reverse(face.begin(), face.begin() + 3);
+      std::reverse(face.begin() + 3, face.end());
+      faces.planes[face_idx] = -faces.planes[face_idx];
+    }
+  }
+
+  std::string_view mesh_issue_name(MeshIssueKind kind) noexcept {
+    switch (kind) {
+      case MeshIssueKind::degenerate_face:
+        return "degenerate face";
+      case MeshIssueKind::winding_mismatch:
+        return "winding mismatch";
+      case MeshIssueKind::duplicate_face:
+        return "duplicate face";
+      case MeshIssueKind::opposite_face:
+        return "opposite face";
+      case MeshIssueKind::t_junction:
+        return "T-junction";
+      case MeshIssueKind::boundary_edge:
+        return "boundary edge";
+      case MeshIssueKind::non_manifold_edge:
+        return "non-manifold edge";
+      case MeshIssueKind::flipped_face:
+        return "flipped face";
+      case MeshIssueKind::inside_out:
+        return "inside out";
+    }
+    return "unknown";
+  }
+
+  class MeshRepair {
+  public:
+    static std::vector<MeshIssue> validate(const Mesh& mesh);
+    static MeshRepairReport repair(Mesh& mesh);
+
+  private:
+    static FaceSpans spans(const Mesh& mesh) noexcept {
+      return {mesh.face_vertices_, mesh.face_offsets_, mesh.face_planes_};
+    }
+
+    /// Drops repeated consecutive vertices and faces without area, and gives faces winding against their plane
+    /// the plane of their largest convex corner, which becomes their first corner.
+    static FaceList clean_faces(const Mesh& mesh);
+
+    /// Removes duplicate faces, and opposite faces together with the face they repeat.
+    static FaceList remove_repeated_faces(const FaceList& faces);
+
+    /// Inserts the vertices at T-junctions into the boundary edges they lie on.
+    static FaceList close_t_junctions(const Mesh& mesh, const FaceList& faces);
+
+    /// Flips the faces wound against their component, then all faces if they enclose a volume inside out.
+    static void orient_faces(const Mesh& mesh, FaceList& faces);
+
+    /// Replaces the faces of a mesh, moving the triangles of unchanged faces to their new place in the triangulation
+    /// cache and marking only those of changed faces as outdated.
+    static void replace_faces(Mesh& mesh, FaceList faces);
+  };
+
+  std::vector<MeshIssue> MeshRepair::validate(const Mesh& mesh) {
+    WDP_TRACE_SCOPE("validate_mesh");
+    const auto vertices = std::span{mesh.vertices_};
+    const auto faces = spans(mesh);
+    auto issues = std::vector<MeshIssue>{};
+    auto skipped = std::vector<bool>(faces.size());
+
+    // faces by themselves
+    for (auto face_idx = FaceIndex{0}; face_idx < faces.size(); ++face_idx) {
+      if (is_degenerate(vertices, faces.face(face_idx))) {
+        issues.push_back({.kind = MeshIssueKind::degenerate_face, .face = face_idx});
+        skipped[face_idx] = true;
+      }
+    }
+    for (auto face_idx = FaceIndex{0}; face_idx < faces.size(); ++face_idx) {
+      if (!skipped[face_idx] && !winds_along(winding_normal(vertices, faces.face(face_idx)), faces.planes[face_idx])) {
+        issues.push_back({.kind = MeshIssueKind::winding_mismatch, .face = face_idx});
+      }
+    }
+
+    // repeated faces, which are left out of the edge checks, together with the faces they oppose in inner walls
+    auto opposite_issues = std::vector<MeshIssue>{};
+    for_each_repeated_face(faces, skipped, [&](FaceIndex face_idx, FaceIndex earlier_idx, int direction) {
+      if (direction > 0) {
+        issues.push_back({.kind = MeshIssueKind::duplicate_face, .face = face_idx, .other_face = earlier_idx});
+      } else {
+        opposite_issues.push_back({.kind = MeshIssueKind::opposite_face, .face = face_idx, .other_face = earlier_idx});
+      }
+    });
+    for (const auto& issue : issues) {
+      if (issue.kind == MeshIssueKind::duplicate_face) {
+        skipped[issue.face] = true;
+      }
+    }
+    if (!opposite_issues.empty()) {
+      const auto all_edges = map_edges(faces, skipped);
+      for (const auto& issue : opposite_issues) {
+        skipped[issue.face] = true;
+        skipped[issue.other_face] = skipped[issue.other_face] || is_inner_wall(faces, issue.face, all_edges);
+      }
+    }
+    issues.insert(issues.end(), opposite_issues.begin(), opposite_issues.end());
+
+    // edges, each reported at its first half-edge
+    const auto edges = map_edges(faces, skipped);
+    const auto boundary = BoundaryGraph{vertices.size(), faces, edges, skipped};
+    auto edge_issues = std::array<std::vector<MeshIssue>, 3>{};  // T-junctions, boundary and non-manifold edges
+    for (auto face_idx = FaceIndex{0}; face_idx < faces.size(); ++face_idx) {
+      if (skipped[face_idx]) {
+        continue;
+      }
+      for_each_face_edge(faces, face_idx, [&](VertexIndex from, VertexIndex to, std::size_t position) {
+        const auto& edge = edges.of(position);
+        if (edge.count == 1) {
+          for (const auto vertex : boundary.edge_vertices(vertices, from, to)) {
+            edge_issues[0].push_back(
+                {.kind = MeshIssueKind::t_junction, .face = face_idx, .edge = {from, to}, .vertex = vertex});
+          }
+          edge_issues[1].push_back({.kind = MeshIssueKind::boundary_edge, .face = face_idx, .edge = {from, to}});
+        } else if (edge.count > 2 && edge.first[0].face == face_idx && edge.first[0].from == from) {
+          edge_issues[2].push_back({.kind = MeshIssueKind::non_manifold_edge, .face = face_idx, .edge = {from, to}});
+        }
+      });
+    }
+    for (const auto& kind_issues : edge_issues) {
+      issues.insert(issues.end(), kind_issues.begin(), kind_issues.end());
+    }
+
+    // orientation
+    const auto flipped = find_flipped_faces(faces, edges, skipped);
+    for (auto face_idx = FaceIndex{0}; face_idx < faces.size(); ++face_idx) {
+      if (flipped[face_idx]) {
+        issues.push_back({.kind = MeshIssueKind::flipped_face, .face = face_idx});
+      }
+    }
+    if (!edges.edges.empty() && is_closed_and_consistent(edges) && signed_volume(vertices, faces, skipped) < 0) {
+      issues.push_back({.kind = MeshIssueKind::inside_out});
+    }
+    return issues;
+  }
+
+  MeshRepairReport MeshRepair::repair(Mesh& mesh) {
+    WDP_TRACE_SCOPE("repair_mesh");
+    auto report = MeshRepairReport{};
+    report.found = validate(mesh);
+    if (report.found.empty()) {
+      return report;
+    }
+    auto faces = remove_repeated_faces(clean_faces(mesh));
+    faces = close_t_junctions(mesh, faces);
+    orient_faces(mesh, faces);
+    replace_faces(mesh, std::move(faces));
+    report.remaining = validate(mesh);
+    return report;
+  }
+
+  FaceList MeshRepair::clean_faces(const Mesh& mesh) {
+    const auto vertices = std::span{mesh.vertices_};
+    const auto faces = spans(mesh);
+    auto cleaned = FaceList{};
+    cleaned.vertices.reserve(faces.vertices.size());
+    cleaned.offsets.reserve(faces.size() + 1);
+    cleaned.planes.reserve(faces.size());
+    cleaned.sources.reserve(faces.size());
+    auto polygon = boost::container::small_vector<VertexIndex, 8>{};
+    for (auto face_idx = FaceIndex{0}; face_idx < faces.size(); ++face_idx) {
+      const auto face = faces.face(face_idx);
+      polygon.clear();
+      for (std::size_t idx = 0; idx < face.size(); ++idx) {
+        if (face[idx] != face[(idx + 1) % face.size()]) {
+          polygon.push_back(face[idx]);
+        }
+      }
+      const auto polygon_span = std::span{polygon.data(), polygon.size()};
+      if (is_degenerate(vertices, polygon_span)) {
+        continue;
+      }
+
+      const auto normal = winding_normal(vertices, polygon_span);
+      auto plane = faces.planes[face_idx];
+      if (!winds_along(normal, plane)) {
+        // take the plane at the convex corner spanning the largest triangle, which is wound like the polygon
+        auto best_corner = std::size_t{0};
+        auto best_area = 0.0;
+        for (std::size_t idx = 0; idx < polygon.size(); ++idx) {
+          const auto corner = vertices[polygon[(idx + polygon.size() - 1) % polygon.size()]].pos &
+                              vertices[polygon[idx]].pos & vertices[polygon[(idx + 1) % polygon.size()]].pos;
+          const auto area = dot(normal, corner);
+          if (area > best_area) {
+            best_corner = idx;
+            best_area = area;
+          }
+        }
+        std::ranges::rotate(polygon, polygon.begin() + narrow<std::ptrdiff_t>((best_corner + polygon.size() - 1) %
+                                                                               polygon.size()));
+        plane = mesh.corner_plane(polygon_span);
+      }
+      cleaned.add(polygon_span, plane, face_idx);
+    }
+    return cleaned;
+  }
+
+  FaceList MeshRepair::remove_repeated_faces(const FaceList& faces) {
+    auto removed = std::vector<bool>(faces.size());
+    auto opposite_faces = std::vector<std::pair<FaceIndex, FaceIndex>>{};
+    for_each_repeated_face(faces.spans(), removed, [&](FaceIndex face_idx, FaceIndex earlier_idx, int direction) {
+      if (direction > 0) {
+        removed[face_idx] = true;
+      } else {
+        opposite_faces.emplace_back(face_idx, earlier_idx);
+      }
+    });
+    if (!opposite_faces.empty()) {
+      const auto all_edges = map_edges(faces.spans(), removed);
+      for (const auto& [face_idx, earlier_idx] : opposite_faces) {
+        removed[face_idx] = true;
+        removed[earlier_idx] = removed[earlier_idx] || is_inner_wall(faces.spans(), face_idx, all_edges);
+      }
+    }
+    auto kept = FaceList{};
+    const auto spans = faces.spans();
+    for (auto face_idx = FaceIndex{0}; face_idx < faces.size(); ++face_idx) {
+      if (!removed[face_idx]) {
+        kept.add(spans.face(face_idx), faces.planes[face_idx], faces.sources[face_idx]);
+      }
+    }
+    return kept;
+  }
+
+  FaceList MeshRepair::close_t_junctions(const Mesh& mesh, const FaceList& faces) {
+    const auto vertices = std::span{mesh.vertices_};
+    const auto spans = faces.spans();
+    const auto none_skipped = std::vector<bool>(faces.size());
+    const auto edges = map_edges(spans, none_skipped);
+    const auto boundary = BoundaryGraph{vertices.size(), spans, edges, none_skipped};
+    auto closed = FaceList{};
+    closed.vertices.reserve(faces.vertices.size());
+    auto polygon = boost::container::small_vector<VertexIndex, 8>{};
+    for (auto face_idx = FaceIndex{0}; face_idx < faces.size(); ++face_idx) {
+      polygon.clear();
+      for_each_face_edge(spans, face_idx, [&](VertexIndex from, VertexIndex to, std::size_t position) {
+        polygon.push_back(from);
+        if (edges.of(position).count == 1) {
+          const auto inner = boundary.edge_vertices(vertices, from, to);
+          polygon.insert(polygon.end(), inner.begin(), inner.end());
+        }
+      });
+      closed.add(std::span{polygon.data(), polygon.size()}, faces.planes[face_idx], faces.sources[face_idx]);
+    }
+    return closed;
+  }
+
+  void MeshRepair::orient_faces(const Mesh& mesh, FaceList& faces) {
+    const auto none_skipped = std::vector<bool>(faces.size());
+    const auto edges = map_edges(faces.spans(), none_skipped);
+    const auto flipped = find_flipped_faces(faces.spans(), edges, none_skipped);
+    for (auto face_idx = FaceIndex{0}; face_idx < faces.size(); ++face_idx) {
+      if (flipped[face_idx]) {
+        flip_face(faces, face_idx);
+      }
+    }
+    if (!edges.edges.empty() && is_closed_and_consistent(edges) &&
+        signed_volume(mesh.vertices_, faces.spans(), none_skipped) < 0) {
+      for (auto face_idx = FaceIndex{0}; face_idx < faces.size(); ++face_idx) {
+        flip_face(faces, face_idx);
+      }
+    }
+  }
+
+  void MeshRepair::replace_faces(Mesh& mesh, FaceList faces) {
+    const auto old_faces = spans(mesh);
+    auto old_dirty = std::vector<bool>(old_faces.size());
+    for (const auto face_idx : mesh.dirty_faces_) {
+      old_dirty[face_idx] = true;
+    }
+    const auto same_plane = [](const kln::plane& a, const kln::plane& b) {
+      return a.x() == b.x() && a.y() == b.y() && a.z() == b.z() && a.d() == b.d();
+    };
+
+    // faces keep their order and vertices, so the triangles of a face left as it was stay valid at its new place
+    const auto new_faces = faces.spans();
+    auto triangles = std::vector<TriFace>(faces.vertices.size() - 2 * faces.size());
+    auto dirty_faces = std::vector<FaceIndex>{};
+    for (auto face_idx = FaceIndex{0}; face_idx < faces.size(); ++face_idx) {
+      const auto source = faces.sources[face_idx];
+      const auto face = new_faces.face(face_idx);
+      const auto old_offset = mesh.face_triangles_offset(source);
+      if (old_dirty[source] || old_offset + face.size() - 2 > mesh.triangles_.size() ||
+          !std::ranges::equal(face, old_faces.face(source)) ||
+          !same_plane(faces.planes[face_idx], old_faces.planes[source])) {
+        dirty_faces.push_back(face_idx);
+        continue;
+      }
+      std::copy_n(mesh.triangles_.begin() + narrow<std::ptrdiff_t>(old_offset), face.size() - 2,
+                  triangles.begin() + narrow<std::ptrdiff_t>(faces.offsets[face_idx] - 2 * face_idx));
+    }
+
+    mesh.face_vertices_ = std::move(faces.vertices);
+    mesh.face_offsets_ = std::move(faces.offsets);
+    mesh.face_planes_ = std::move(faces.planes);
+    mesh.triangles_ = std::move(triangles);
+    mesh.dirty_faces_ = std::move(dirty_faces);
+    mesh.triangle_bvh_dirty_ = true;
+  }
+
+  std::vector<MeshIssue> validate_mesh(const Mesh& mesh) { return MeshRepair::validate(mesh); }
+
+  MeshRepairReport repair_mesh(Mesh& mesh) { return MeshRepair::repair(mesh); }
+}
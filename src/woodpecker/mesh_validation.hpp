@@ -0,0 +1,87 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <woodpecker/mesh.hpp>
+
+namespace wdp {
+  /// The kinds of defects found by validate_mesh().
+  enum class MeshIssueKind : std::uint8_t {
+    degenerate_face,    ///< A face repeating a vertex at consecutive corners, or without area.
+    winding_mismatch,   ///< A face whose vertices wind against its plane, such as one taken at a reflex corner.
+    duplicate_face,     ///< A face with the vertex cycle of an earlier face, in the same winding order.
+    opposite_face,      ///< A face with the vertex cycle of an earlier face in opposite winding order.
+    t_junction,         ///< A vertex inside of a boundary edge of a face, where the faces across the edge end.
+    boundary_edge,      ///< An edge of a single face, where the mesh is open.
+    non_manifold_edge,  ///< An edge of more than two faces.
+    flipped_face,       ///< A face wound against most faces of its component, across edges run in the same direction.
+    inside_out,         ///< A closed, consistently wound mesh whose faces wind clockwise seen from outside.
+  };
+
+  constexpr auto mesh_issue_kind_count = std::size_t{9};
+
+  /// The name of an issue kind for messages, such as "boundary edge".
+  std::string_view mesh_issue_name(MeshIssueKind kind) noexcept;
+
+  /// A defect of a mesh found by validate_mesh().
+  /// Only the members which apply to the kind of issue are set, the others are zero.
+  struct MeshIssue {
+    MeshIssueKind kind{};
+    FaceIndex face{};                   ///< The face with the defect, or the first face along the edge.
+    FaceIndex other_face{};             ///< The earlier face repeated by a duplicate or opposite face.
+    std::array<VertexIndex, 2> edge{};  ///< The edge of edge defects and T-junctions, in the winding of `face`.
+    VertexIndex vertex{};               ///< The vertex inside of the edge of a T-junction.
+  };
+
+  /// The issues found and left over by repair_mesh().
+  struct MeshRepairReport {
+    std::vector<MeshIssue> found;      ///< The issues before repairing, with the face indices of that mesh.
+    std::vector<MeshIssue> remaining;  ///< The issues after repairing, such as boundary and non-manifold edges.
+  };
+
+  /// Checks a mesh for defects which the per-face checks of Mesh::add_face() can not see,
+  /// because they concern how faces fit together, before it reaches triangulation or CSG.
+  ///
+  /// Edges are matched through a hash map from vertex pairs to the faces along them, and duplicate faces through a
+  /// hash map of their vertex cycles, so that validation takes expected time linear in the size of the mesh.
+  /// Vertices are compared by index, as the mesh has welded them already.
+  /// Degenerate, duplicate and opposite faces are left out of the edge checks,
+  /// and so are the faces repeated by opposite faces in inner walls, see repair_mesh().
+  /// T-junctions are found by walking along boundary edges from the start of each boundary edge.
+  /// Whether a mesh is inside out is only checked if it is closed and consistently wound.
+  /// \return The issues found, grouped by kind in the order of MeshIssueKind.
+  std::vector<MeshIssue> validate_mesh(const Mesh& mesh);
+
+  /// Validates a mesh, and fixes the issues which can be fixed without adding vertices, in linear expected time.
+  ///
+  /// Repeated vertices at consecutive corners are dropped, and faces left without area are removed.
+  /// Faces winding against their plane get the plane of their winding, taken at their largest convex corner.
+  /// Duplicate and opposite faces are removed, and so are the faces repeated by opposite faces in inner walls
+  /// between two solids, whose edges are all shared by at least four faces.
+  /// Vertices at T-junctions are inserted into the boundary edges they lie on, closing the cracks.
+  /// Flipped faces are turned, keeping the winding of the majority of each component,
+  /// and closed meshes which are inside out are turned as a whole.
+  /// Vertices which are no longer used by any face are kept. The triangles of changed faces are marked as outdated.
+  MeshRepairReport repair_mesh(Mesh& mesh);
+}
@@ -0,0 +1,89 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "motor_batch.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#include <woodpecker/util/assert.hpp>
+#include <woodpecker/util/thread_pool.hpp>
+#include <woodpecker/util/trace.hpp>
+
+namespace wdp {
+  // the klein kernel operates on arrays of points, which a vertex is a wrapper of
+  static_assert(sizeof(Vertex) == sizeof(kln::point) && alignof(Vertex) == alignof(kln::point));
+
+  namespace {
+    /// The number of points moved at once when normalizing, small enough to stay in the L1 cache.
+    constexpr auto block_size = std::size_t{256};
+
+    /// The number of points per task in the parallel versions, large enough to amortize scheduling.
+    constexpr auto parallel_grain_size = std::size_t{64} * 1024;
+
+    kln::point* point_data(std::span<const Vertex> vertices) noexcept {
+      // the kernel takes a mutable input pointer, but only reads from it
+      return const_cast<kln::point*>(&vertices.data()->pos);
+    }
+
+    template <class Out>
+    void apply_motor_parallel(ThreadPool& pool, const kln::motor& motor, std::span<const Vertex> vertices,
+                              std::span<Out> out) {
+      WDP_TRACE_SCOPE("apply_motor");
+      WDP_ASSERT_CHEAP(vertices.size() == out.size());
+      const auto task_count = (vertices.size() + parallel_grain_size - 1) / parallel_grain_size;
+      pool.parallel_for(0, task_count, 1, [&](std::size_t task_idx) {
+        const auto begin = task_idx * parallel_grain_size;
+        const auto count = std::min(parallel_grain_size, vertices.size() - begin);
+        apply_motor(motor, vertices.subspan(begin, count), out.subspan(begin, count));
+      });
+    }
+  }
+
+  void apply_motor(const kln::motor& motor, std::span<const Vertex> vertices, std::span<kln::point> out) noexcept {
+    WDP_ASSERT_CHEAP(vertices.size() == out.size());
+    if (vertices.empty()) {
+      return;
+    }
+    motor(point_data(vertices), out.data(), vertices.size());
+  }
+
+  void apply_motor(const kln::motor& motor, std::span<const Vertex> vertices, std::span<Vec3> out) noexcept {
+    WDP_ASSERT_CHEAP(vertices.size() == out.size());
+    auto block = std::array<kln::point, block_size>{};
+    for (std::size_t begin = 0; begin < vertices.size(); begin += block_size) {
+      const auto count = std::min(block_size, vertices.size() - begin);
+      motor(point_data(vertices.subspan(begin, count)), block.data(), count);
+      for (std::size_t i = 0; i < count; ++i) {
+        // divide all lanes by the homogeneous weight in lane 0, leaving x, y, z in lanes 1 to 3
+        alignas(16) float lanes[4];
+        _mm_store_ps(lanes, _mm_div_ps(block[i].p3_, _mm_shuffle_ps(block[i].p3_, block[i].p3_, 0)));
+        std::memcpy(out[begin + i].data(), &lanes[1], sizeof(Vec3));
+      }
+    }
+  }
+
+  void apply_motor(ThreadPool& pool, const kln::motor& motor, std::span<const Vertex> vertices,
+                   std::span<kln::point> out) {
+    apply_motor_parallel(pool, motor, vertices, out);
+  }
+
+  void apply_motor(ThreadPool& pool, const kln::motor& motor, std::span<const Vertex> vertices, std::span<Vec3> out) {
+    apply_motor_parallel(pool, motor, vertices, out);
+  }
+}
@@ -0,0 +1,43 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <span>
+
+#include <woodpecker/bvh.hpp>
+#include <woodpecker/pga.hpp>
+#include <woodpecker/vertex.hpp>
+
+namespace wdp {
+  class ThreadPool;
+
+  /// Moves all vertices by a motor, using the batched SSE kernel of klein,
+  /// which computes the motor terms once and then streams the points through registers.
+  /// \param out Receives the moved positions, as many as there are vertices. May not overlap the vertices.
+  void apply_motor(const kln::motor& motor, std::span<const Vertex> vertices, std::span<kln::point> out) noexcept;
+
+  /// Like apply_motor(), but writes euclidean positions, as consumed by exporters and geometric queries.
+  /// The vertices are processed in cache-sized blocks, which are moved by the klein kernel, then normalized.
+  void apply_motor(const kln::motor& motor, std::span<const Vertex> vertices, std::span<Vec3> out) noexcept;
+
+  /// Like apply_motor(), but spreads blocks of vertices over the pool, to saturate memory bandwidth on large meshes.
+  void apply_motor(ThreadPool& pool, const kln::motor& motor, std::span<const Vertex> vertices,
+                   std::span<kln::point> out);
+  void apply_motor(ThreadPool& pool, const kln::motor& motor, std::span<const Vertex> vertices, std::span<Vec3> out);
+}
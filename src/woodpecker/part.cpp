@@ -17,6 +17,37 @@
 
 #include "part.hpp"
 
+#include <atomic>
+#include <utility>
+
 namespace wdp {
-  Part::Part(const Mesh& mesh) : mesh_(mesh) {}
+  Revision next_revision() noexcept {
+    static auto last_revision = std::atomic<Revision>{};
+    return last_revision.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+
+  Part::Part(Mesh mesh) : mesh_(std::make_shared<const Mesh>(std::move(mesh))) {}
+
+  Part::Part(SharedMesh mesh) : mesh_(std::move(mesh)) {}
+
+  Aabb Part::bounds() const {
+    const auto mesh_bounds = mesh_->bounds();
+    if (mesh_bounds.empty()) {
+      return mesh_bounds;
+    }
+    auto bounds = Aabb{};
+    for (auto corner = 0; corner < 8; ++corner) {
+      const auto& x = (corner & 1) != 0 ? mesh_bounds.max : mesh_bounds.min;
+      const auto& y = (corner & 2) != 0 ? mesh_bounds.max : mesh_bounds.min;
+      const auto& z = (corner & 4) != 0 ? mesh_bounds.max : mesh_bounds.min;
+      const auto moved = motor_(kln::point{x[0], y[1], z[2]}).normalized();
+      bounds.extend(Vec3{moved.x(), moved.y(), moved.z()});
+    }
+    return bounds;
+  }
+
+  void Part::set_mesh(SharedMesh mesh) {
+    mesh_ = std::move(mesh);
+    mesh_revision_ = next_revision();
+  }
 }
@@ -17,20 +17,63 @@
 
 #pragma once
 
+#include <cstdint>
+#include <span>
+
 #include <woodpecker/mesh.hpp>
+#include <woodpecker/mesh_pool.hpp>
+#include <woodpecker/motor_batch.hpp>
 #include <woodpecker/pga.hpp>
 
 namespace wdp {
+  /// An identifier of a part in a Scene, stable for the lifetime of the part and never reused.
+  using PartId = std::uint32_t;
+
+  /// A number identifying the state of a property, used to detect changes since it was last seen.
+  /// Each change assigns a new revision, unique within the process, so restoring an older state,
+  /// such as by undoing an edit, is detected as a change as well.
+  using Revision = std::uint64_t;
+
+  /// A new revision, distinct from all revisions returned before. Thread-safe.
+  Revision next_revision() noexcept;
+
   class Part {
   public:
-    explicit Part(const Mesh& mesh);
+    explicit Part(Mesh mesh);
+    explicit Part(SharedMesh mesh);
+
+    /// The identifier assigned when the part was added to a Scene.
+    PartId id() const noexcept { return id_; }
 
-    const auto& mesh() const noexcept { return mesh_; }
+    const Mesh& mesh() const noexcept { return *mesh_; }
+    /// The mesh of the part, which may be shared with other parts.
+    const SharedMesh& shared_mesh() const noexcept { return mesh_; }
+    void set_mesh(SharedMesh mesh);
+    Revision mesh_revision() const noexcept { return mesh_revision_; }
+
+    /// The placement of the part in world space, changed by Scene::move_part() to keep the kinematic tree in sync.
     const auto& motor() const noexcept { return motor_; }
-    void set_motor(const kln::motor& motor) noexcept { motor_ = motor; }
+    Revision motor_revision() const noexcept { return motor_revision_; }
+
+    /// Writes the vertices of the mesh, moved into world space by the motor, see apply_motor().
+    /// \param out Receives mesh().vertices().size() positions.
+    void world_positions(std::span<Vec3> out) const { apply_motor(motor_, mesh_->vertices(), out); }
+
+    /// The bounding box of the part in world space, enclosing the bounds of its mesh moved by its motor.
+    Aabb bounds() const;
 
   private:
-    Mesh mesh_;
+    friend class Scene;
+
+    PartId id_{};
+    SharedMesh mesh_;
+    Revision mesh_revision_{};
     kln::motor motor_{identity_motor};
+    Revision motor_revision_{};
+
+    void set_motor(const kln::motor& motor) noexcept {
+      motor_ = motor;
+      motor_revision_ = next_revision();
+    }
   };
 }
@@ -0,0 +1,87 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "render_mesh.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+#include <woodpecker/util/assert.hpp>
+#include <woodpecker/util/trace.hpp>
+
+namespace wdp {
+  namespace {
+    std::int8_t quantize_snorm8(float value) noexcept {
+      return static_cast<std::int8_t>(std::lround(std::clamp(value, -1.F, 1.F) * 127.F));
+    }
+
+    template <class Index>
+    void pack_render_mesh_impl(const Mesh& mesh, std::span<RenderVertex> vertices, std::span<Index> indices) {
+      WDP_TRACE_SCOPE("pack_render_mesh");
+      const auto size = render_mesh_size(mesh);
+      WDP_ASSERT_CHEAP(vertices.size() == size.vertex_count && indices.size() == size.index_count);
+      WDP_ASSERT_CHEAP(size.vertex_count <= std::size_t{1} + static_cast<Index>(-1));
+
+      const auto& triangles = mesh.triangles();
+      // the position of each mesh vertex in the current face
+      auto face_corners = std::vector<Index>(mesh.vertices().size());
+      auto vertex_iter = vertices.begin();
+      auto index_iter = indices.begin();
+      auto tri_iter = triangles.begin();
+      for (const auto& face : mesh.faces()) {
+        // the planes joining the corners of a face point inwards where it winds along its plane, see Mesh,
+        // so their sum gives the shading normal even of faces whose plane was taken at a reflex corner
+        const auto& origin = mesh.vertices()[face.vertices[0]].pos;
+        auto winding = kln::plane{0, 0, 0, 0};
+        for (auto corner = std::size_t{1}; corner + 1 < face.vertices.size(); ++corner) {
+          winding += origin & mesh.vertices()[face.vertices[corner]].pos &
+                     mesh.vertices()[face.vertices[corner + 1]].pos;
+        }
+        const auto inward = (winding.norm() > 0 ? winding : face.plane).normalized();
+        const auto normal = std::array{quantize_snorm8(-inward.x()), quantize_snorm8(-inward.y()),
+                                       quantize_snorm8(-inward.z())};
+        const auto first_corner = static_cast<Index>(vertex_iter - vertices.begin());
+        for (auto corner = std::size_t{0}; corner < face.vertices.size(); ++corner) {
+          const auto pos = mesh.vertices()[face.vertices[corner]].pos.normalized();
+          *vertex_iter++ = {{pos.x(), pos.y(), pos.z()}, {normal[0], normal[1], normal[2]}};
+          face_corners[face.vertices[corner]] = static_cast<Index>(first_corner + corner);
+        }
+        // n - 2 triangles per face, in the order of the faces
+        for (auto tri_idx = std::size_t{2}; tri_idx < face.vertices.size(); ++tri_idx, ++tri_iter) {
+          for (const auto vertex_index : *tri_iter) {
+            *index_iter++ = face_corners[vertex_index];
+          }
+        }
+      }
+    }
+  }
+
+  RenderMeshSize render_mesh_size(const Mesh& mesh) noexcept {
+    const auto corner_count = mesh.face_vertex_count();
+    return {corner_count, 3 * (corner_count - 2 * mesh.face_count())};
+  }
+
+  void pack_render_mesh(const Mesh& mesh, std::span<RenderVertex> vertices, std::span<std::uint16_t> indices) {
+    pack_render_mesh_impl(mesh, vertices, indices);
+  }
+
+  void pack_render_mesh(const Mesh& mesh, std::span<RenderVertex> vertices, std::span<std::uint32_t> indices) {
+    pack_render_mesh_impl(mesh, vertices, indices);
+  }
+}
@@ -0,0 +1,55 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include <woodpecker/mesh.hpp>
+
+namespace wdp {
+  /// A vertex in the packed render format of a mesh.
+  /// Flat shaded, so each corner of a face is a separate vertex carrying the normal of the face.
+  struct RenderVertex {
+    float position[3];        ///< The euclidean position.
+    std::int8_t normal[3];    ///< The outward unit normal, quantized to signed normalized bytes.
+    std::int8_t padding{};    ///< Keeps the vertex at 16 bytes.
+  };
+  static_assert(sizeof(RenderVertex) == 16);
+
+  /// The sizes of the packed render format of a mesh, for allocating its buffers up front.
+  struct RenderMeshSize {
+    std::size_t vertex_count;  ///< The number of RenderVertex, one for each corner of each face.
+    std::size_t index_count;   ///< The number of indices, 3 for each triangle.
+
+    /// Whether the indices fit into 16 bits.
+    bool has_short_indices() const noexcept { return vertex_count <= 0x10000; }
+  };
+
+  /// The sizes of the packed render format of the given mesh.
+  RenderMeshSize render_mesh_size(const Mesh& mesh) noexcept;
+
+  /// Writes the packed render format of a mesh into caller-provided buffers,
+  /// which can then be handed to the graphics API without another copy.
+  /// The triangles are taken from the triangulation cache of the mesh and keep its winding order.
+  /// \param vertices Receives render_mesh_size().vertex_count vertices.
+  /// \param indices Receives render_mesh_size().index_count indices, only 16 bits if has_short_indices().
+  void pack_render_mesh(const Mesh& mesh, std::span<RenderVertex> vertices, std::span<std::uint16_t> indices);
+  void pack_render_mesh(const Mesh& mesh, std::span<RenderVertex> vertices, std::span<std::uint32_t> indices);
+}
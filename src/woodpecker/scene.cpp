@@ -16,3 +16,336 @@
 // along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "scene.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <utility>
+
+#include <woodpecker/util/assert.hpp>
+#include <woodpecker/util/cast.hpp>
+#include <woodpecker/util/thread_pool.hpp>
+#include <woodpecker/util/trace.hpp>
+
+namespace wdp {
+  PartId Scene::add_part(const Part& part) {
+    const auto id = narrow<PartId>(part_nodes_.size());
+    auto node = PartNode{};
+    node.index = parts_.size();
+    node.local_motor = part.motor();
+    part_nodes_.push_back(std::move(node));
+    auto new_part = part;
+    new_part.id_ = id;
+    new_part.mesh_ = meshes_->intern(part.shared_mesh());
+    parts_.push_back(std::move(new_part));
+    rebuild_part_bvh_ = true;
+    return id;
+  }
+
+  void Scene::remove_part(PartId id) {
+    if (find_node(id) == nullptr) {
+      return;
+    }
+    // remove its joints first, which detaches its children
+    update_motors();
+    const auto joint_ids = find_node(id)->joints;
+    for (const auto joint_id : joint_ids) {
+      remove_joint(joint_id);
+    }
+    const auto index = find_node(id)->index;
+    part_nodes_.mutate(id).reset();
+
+    // move last part into the gap
+    if (index + 1 != parts_.size()) {
+      auto last_part = parts_[parts_.size() - 1];
+      mutate_node(last_part.id()).index = index;
+      parts_.mutate(index) = std::move(last_part);
+    }
+    parts_.pop_back();
+    rebuild_part_bvh_ = true;
+  }
+
+  const Part* Scene::find_part(PartId id) const {
+    const auto* node = find_node(id);
+    return node != nullptr ? &parts_[node->index] : nullptr;
+  }
+
+  Part* Scene::find_part(PartId id) {
+    const auto* node = find_node(id);
+    if (node == nullptr) {
+      return nullptr;
+    }
+    mark_part_changed(id);
+    return &parts_.mutate(node->index);
+  }
+
+  std::size_t Scene::mesh_count() const {
+    auto meshes = std::vector<const Mesh*>{};
+    meshes.reserve(parts_.size());
+    for (const auto& part : parts_) {
+      meshes.push_back(&part.mesh());
+    }
+    std::ranges::sort(meshes);
+    return static_cast<std::size_t>(std::ranges::distance(meshes.begin(), std::ranges::unique(meshes).begin()));
+  }
+
+  std::optional<SceneHit> Scene::raycast(const Ray& ray) const {
+    auto hit = std::optional<SceneHit>{};
+    const auto& bvh = part_bvh().bvh;
+    bvh.raycast(ray, std::numeric_limits<float>::infinity(), [&](std::uint32_t part_idx, float max_distance) {
+      // the motor is rigid, so distances along the ray are the same in the local space of the part
+      const auto& part = parts_[part_idx];
+      const auto inv_motor = ~part.motor();
+      const auto target = ray.at(1);
+      const auto local_origin = inv_motor(kln::point{ray.origin[0], ray.origin[1], ray.origin[2]}).normalized();
+      const auto local_target = inv_motor(kln::point{target[0], target[1], target[2]}).normalized();
+      const auto local_ray =
+          Ray{{local_origin.x(), local_origin.y(), local_origin.z()},
+              {local_target.x() - local_origin.x(), local_target.y() - local_origin.y(),
+               local_target.z() - local_origin.z()}};
+      const auto mesh_hit = part.mesh().raycast(local_ray, max_distance);
+      if (!mesh_hit) {
+        return -1.F;
+      }
+      hit = SceneHit{part.id(), mesh_hit->face, mesh_hit->distance};
+      return mesh_hit->distance;
+    });
+    return hit;
+  }
+
+  std::vector<PartId> Scene::query_parts(const Aabb& box) const {
+    const auto& hierarchy = part_bvh();
+    auto part_ids = std::vector<PartId>{};
+    hierarchy.bvh.query(box, [&](std::uint32_t part_idx) {
+      if (hierarchy.boxes[part_idx].overlaps(box)) {
+        part_ids.push_back(parts_[part_idx].id());
+      }
+    });
+    return part_ids;
+  }
+
+  std::vector<PartBounds> Scene::query_parts(const Frustum& frustum) const {
+    WDP_TRACE_SCOPE("Scene::query_parts");
+    const auto& hierarchy = part_bvh();
+    auto parts = std::vector<PartBounds>{};
+    hierarchy.bvh.query(frustum, [&](std::uint32_t part_idx) {
+      const auto& bounds = hierarchy.boxes[part_idx];
+      if (frustum.overlaps(bounds)) {
+        parts.push_back({parts_[part_idx].id(), bounds});
+      }
+    });
+    return parts;
+  }
+
+  const Scene::PartBvh& Scene::part_bvh() const {
+    if (part_bvh_ != nullptr && !rebuild_part_bvh_ && changed_parts_.empty()) {
+      return *part_bvh_;
+    }
+    WDP_TRACE_SCOPE("Scene::part_bvh");
+    // refitting degrades the hierarchy, so it is rebuilt after as many refits as parts, at an amortized cost
+    const auto rebuild = part_bvh_ == nullptr || rebuild_part_bvh_ ||
+                         part_bvh_->refit_count + changed_parts_.size() > parts_.size();
+    if (rebuild) {
+      auto new_part_bvh = std::make_shared<PartBvh>();
+      new_part_bvh->keys.reserve(parts_.size());
+      new_part_bvh->boxes.reserve(parts_.size());
+      for (const auto& part : parts_) {
+        new_part_bvh->keys.push_back({part.id(), part.mesh_revision(), part.motor_revision()});
+        new_part_bvh->boxes.push_back(part.bounds());
+      }
+      new_part_bvh->bvh = Bvh{new_part_bvh->boxes};
+      part_bvh_ = std::move(new_part_bvh);
+    } else {
+      if (part_bvh_.use_count() > 1) {
+        part_bvh_ = std::make_shared<PartBvh>(*part_bvh_);
+      }
+      auto& hierarchy = *part_bvh_;
+      auto refitted = std::vector<std::uint32_t>{};
+      for (const auto id : changed_parts_) {
+        // parts were neither added nor removed, so each part is still at the index it was built for
+        const auto index = find_node(id)->index;
+        const auto& part = parts_[index];
+        const auto key = PartBvhKey{id, part.mesh_revision(), part.motor_revision()};
+        if (hierarchy.keys[index] != key) {
+          hierarchy.keys[index] = key;
+          hierarchy.boxes[index] = part.bounds();
+          refitted.push_back(narrow<std::uint32_t>(index));
+        }
+      }
+      hierarchy.bvh.refit(hierarchy.boxes, refitted);
+      hierarchy.refit_count += refitted.size();
+    }
+    changed_parts_.clear();
+    rebuild_part_bvh_ = false;
+    return *part_bvh_;
+  }
+
+  void Scene::mark_part_changed(PartId id) {
+    // beyond as many changes as parts, rebuilding is cheaper than refitting
+    if (!rebuild_part_bvh_ && changed_parts_.size() < parts_.size()) {
+      changed_parts_.push_back(id);
+    } else {
+      rebuild_part_bvh_ = true;
+    }
+  }
+
+  JointId Scene::add_joint(Joint joint) {
+    const auto [parent_id, child_id] = joint.parts;
+    WDP_ASSERT(find_node(parent_id) != nullptr && find_node(child_id) != nullptr && parent_id != child_id);
+    update_motors();
+
+    const auto id = narrow<JointId>(joints_.size());
+    mutate_node(parent_id).joints.push_back(id);
+    mutate_node(child_id).joints.push_back(id);
+
+    // attach the child, unless it would get two parents or close a cycle
+    auto forms_tree = !find_node(child_id)->parent_joint.has_value();
+    for (auto ancestor = std::optional{parent_id}; forms_tree && ancestor;
+         ancestor = parent_of(*find_node(*ancestor))) {
+      forms_tree = *ancestor != child_id;
+    }
+    if (forms_tree) {
+      const auto& scene = std::as_const(*this);
+      auto& child_node = mutate_node(child_id);
+      child_node.parent_joint = id;
+      child_node.local_motor = ~scene.find_part(parent_id)->motor() * scene.find_part(child_id)->motor();
+      mutate_node(parent_id).children.push_back(child_id);
+    }
+
+    joints_.push_back(std::make_shared<const Joint>(std::move(joint)));
+    return id;
+  }
+
+  void Scene::remove_joint(JointId id) {
+    const auto* joint = find_joint(id);
+    if (joint == nullptr) {
+      return;
+    }
+    update_motors();
+    for (const auto part_id : joint->parts) {
+      if (find_node(part_id)->parent_joint == id) {
+        detach_from_parent(part_id);
+      }
+      auto& joint_ids = mutate_node(part_id).joints;
+      joint_ids.erase(std::ranges::remove(joint_ids, id).begin(), joint_ids.end());
+    }
+    joints_.mutate(id).reset();
+  }
+
+  const Joint* Scene::find_joint(JointId id) const { return id < joints_.size() ? joints_[id].get() : nullptr; }
+
+  std::span<const JointId> Scene::part_joints(PartId id) const {
+    const auto* node = find_node(id);
+    return node != nullptr ? std::span{node->joints.data(), node->joints.size()} : std::span<const JointId>{};
+  }
+
+  std::optional<PartId> Scene::parent_part(PartId id) const {
+    const auto* node = find_node(id);
+    return node != nullptr ? parent_of(*node) : std::nullopt;
+  }
+
+  std::span<const PartId> Scene::child_parts(PartId id) const {
+    const auto* node = find_node(id);
+    return node != nullptr ? std::span{node->children.data(), node->children.size()} : std::span<const PartId>{};
+  }
+
+  void Scene::move_part(PartId id, const kln::motor& motor) {
+    WDP_ASSERT_CHEAP(find_node(id) != nullptr, "part must be in scene");
+    const auto parent_id = parent_of(*find_node(id));
+    // relative to where the parent will be, as it may have been moved since the last update too
+    const auto local_motor = parent_id ? ~pending_world_motor(*parent_id) * motor : motor;
+    auto& node = mutate_node(id);
+    node.local_motor = local_motor;
+    if (!node.dirty) {
+      node.dirty = true;
+      dirty_parts_.push_back(id);
+    }
+  }
+
+  void Scene::update_motors() {
+    WDP_TRACE_SCOPE("Scene::update_motors");
+    auto stack = std::vector<PartId>{};
+    for (const auto dirty_id : dirty_parts_) {
+      const auto* dirty_node = find_node(dirty_id);
+      if (dirty_node == nullptr) {
+        continue;  // removed since it was moved
+      }
+      // a dirty ancestor recomputes this subtree as well
+      auto has_dirty_ancestor = false;
+      for (auto ancestor = parent_of(*dirty_node); ancestor && !has_dirty_ancestor;
+           ancestor = parent_of(*find_node(*ancestor))) {
+        has_dirty_ancestor = find_node(*ancestor)->dirty;
+      }
+      if (has_dirty_ancestor) {
+        continue;
+      }
+
+      // recompute the world motors of the subtree, top down
+      stack.push_back(dirty_id);
+      while (!stack.empty()) {
+        const auto part_id = stack.back();
+        stack.pop_back();
+        const auto& node = *find_node(part_id);
+        const auto parent_id = parent_of(node);
+        const auto motor = parent_id ? std::as_const(*this).find_part(*parent_id)->motor() * node.local_motor
+                                     : node.local_motor;
+        find_part(part_id)->set_motor(motor);
+        stack.insert(stack.end(), node.children.begin(), node.children.end());
+      }
+    }
+    for (const auto dirty_id : dirty_parts_) {
+      if (find_node(dirty_id) != nullptr) {
+        mutate_node(dirty_id).dirty = false;
+      }
+    }
+    dirty_parts_.clear();
+  }
+
+  const Scene::PartNode* Scene::find_node(PartId id) const {
+    return id < part_nodes_.size() && part_nodes_[id] ? &*part_nodes_[id] : nullptr;
+  }
+
+  Scene::PartNode& Scene::mutate_node(PartId id) {
+    WDP_ASSERT(find_node(id) != nullptr, "part must be in scene");
+    return *part_nodes_.mutate(id);
+  }
+
+  std::optional<PartId> Scene::parent_of(const PartNode& node) const {
+    if (!node.parent_joint) {
+      return std::nullopt;
+    }
+    return joints_[*node.parent_joint]->parts[0];
+  }
+
+  kln::motor Scene::pending_world_motor(PartId id) const {
+    const auto& node = *find_node(id);
+    const auto parent_id = parent_of(node);
+    return parent_id ? pending_world_motor(*parent_id) * node.local_motor : node.local_motor;
+  }
+
+  void Scene::detach_from_parent(PartId id) {
+    const auto parent_id = parent_of(*find_node(id));
+    if (!parent_id) {
+      return;
+    }
+    auto& siblings = mutate_node(*parent_id).children;
+    siblings.erase(std::ranges::remove(siblings, id).begin(), siblings.end());
+    auto& node = mutate_node(id);
+    node.parent_joint.reset();
+    node.local_motor = std::as_const(*this).find_part(id)->motor();
+  }
+
+  void Scene::triangulate(ThreadPool& pool) const {
+    WDP_TRACE_SCOPE("Scene::triangulate");
+    // the triangulation cache of a mesh must not be updated concurrently, so visit each shared mesh once
+    auto meshes = std::vector<const Mesh*>{};
+    meshes.reserve(parts_.size());
+    for (const auto& part : parts_) {
+      meshes.push_back(&part.mesh());
+    }
+    std::ranges::sort(meshes);
+    meshes.erase(std::ranges::unique(meshes).begin(), meshes.end());
+
+    pool.parallel_for(0, meshes.size(), 1, [&](std::size_t mesh_idx) { meshes[mesh_idx]->triangles(pool); });
+  }
+}
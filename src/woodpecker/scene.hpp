@@ -17,20 +17,181 @@
 
 #pragma once
 
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <utility>
 #include <vector>
 
+#include <boost/container/small_vector.hpp>
+#include <woodpecker/bvh.hpp>
 #include <woodpecker/joint.hpp>
+#include <woodpecker/mesh_pool.hpp>
 #include <woodpecker/part.hpp>
+#include <woodpecker/util/persistent_vector.hpp>
 
 namespace wdp {
+  class ThreadPool;
+
+  /// The closest intersection of a ray with the parts of a Scene.
+  struct SceneHit {
+    PartId part{};     ///< The part which was hit.
+    FaceIndex face{};  ///< The face of the part mesh which was hit.
+    float distance{};  ///< The distance along the ray, in multiples of its direction.
+  };
+
+  /// A part found by a query on a Scene, with its bounds in world space, see Part::bounds().
+  struct PartBounds {
+    PartId part{};
+    Aabb bounds;
+  };
+
+  /// The parts of a woodworking project and the joints between them.
+  /// Copies of a scene share their parts, joints and meshes until either copy changes them, see PersistentVector.
+  /// Thus copying a scene takes constant time, and a copy costs memory only for the parts changed afterwards,
+  /// which makes copies suitable as undo steps, see SceneHistory.
   class Scene {
   public:
+    /// All parts of the scene, in no particular order.
     const auto& parts() const noexcept { return parts_; }
 
-    void add_part(const Part& part) { parts_.push_back(part); }
+    /// Adds a copy of a part to the scene.
+    /// Its mesh is shared with all other parts in the scene which have a mesh of the same content.
+    /// \return The new identifier assigned to the part.
+    PartId add_part(const Part& part);
+
+    /// Removes the part with the given identifier from the scene, together with its joints.
+    /// Its children in the kinematic tree become roots, staying in place.
+    /// The order of the remaining parts may change.
+    void remove_part(PartId id);
+
+    /// The part with the given identifier, or null if there is none in the scene.
+    /// The mutable overload copies the part first if it is shared with a copy of the scene, and notes it as changed
+    /// for the part hierarchy of the queries, so the pointer must not be kept to change the part after a query.
+    const Part* find_part(PartId id) const;
+    Part* find_part(PartId id);
+
+    /// The mesh of the scene with the same content as the given one, for use with Part::set_mesh().
+    /// The meshes are pooled together with all copies of the scene.
+    SharedMesh share_mesh(Mesh mesh) { return meshes_->intern(std::move(mesh)); }
+
+    /// The number of distinct meshes referenced by the parts in the scene.
+    std::size_t mesh_count() const;
+
+    /// Adds a joint between two parts of the scene, which keeps them at their current relative placement.
+    /// If the second part has no parent in the kinematic tree yet, and is no ancestor of the first part,
+    /// then it becomes a child of the first part, following its moves.
+    /// Otherwise the joint closes a cycle in the joint graph, and does not change the tree.
+    /// \return The new identifier assigned to the joint.
+    JointId add_joint(Joint joint);
+
+    /// Removes the joint with the given identifier from the scene.
+    /// If the joint attached a child in the kinematic tree, the child becomes a root, staying in place.
+    void remove_joint(JointId id);
+
+    /// All joints in the scene as pairs of identifier and joint, in the order they were added.
+    auto joints() const {
+      return std::views::iota(JointId{0}, static_cast<JointId>(joints_.size())) |
+             std::views::filter([this](JointId id) { return joints_[id] != nullptr; }) |
+             std::views::transform([this](JointId id) { return std::pair<JointId, const Joint&>{id, *joints_[id]}; });
+    }
+
+    /// The joint with the given identifier, or null if there is none in the scene.
+    const Joint* find_joint(JointId id) const;
+
+    /// The joints connected to a part, in the order they were added.
+    std::span<const JointId> part_joints(PartId id) const;
+
+    /// The parent of a part in the kinematic tree, or nothing if the part is a root.
+    std::optional<PartId> parent_part(PartId id) const;
+
+    /// The children of a part in the kinematic tree, which follow its moves.
+    std::span<const PartId> child_parts(PartId id) const;
+
+    /// Moves a part to a placement in world space, keeping its placement relative to its parent from then on.
+    /// The part must be in the scene.
+    /// The motors of the part and of all parts depending on it in the kinematic tree are updated by update_motors().
+    void move_part(PartId id, const kln::motor& motor);
+
+    /// Updates the world motors of moved parts and their subtrees in the kinematic tree.
+    /// Parts outside of these subtrees are not visited.
+    void update_motors();
+
+    /// Casts a ray in world space against the parts of the scene.
+    /// Parts are culled by their world bounds in a bounding volume hierarchy, which is updated lazily:
+    /// refitted to the parts which were moved or given another mesh, and rebuilt when parts were added or removed,
+    /// or once as many parts were refitted as there are parts. Must not be called concurrently.
+    /// \return The closest hit, if any.
+    std::optional<SceneHit> raycast(const Ray& ray) const;
+
+    /// The identifiers of all parts whose world bounds overlap a box, in no particular order.
+    std::vector<PartId> query_parts(const Aabb& box) const;
+
+    /// All parts whose world bounds overlap a frustum, see Frustum::overlaps(), in no particular order.
+    /// Takes time proportional to the number of parts found rather than of all parts, besides refitting
+    /// the parts changed since the last query, see raycast().
+    std::vector<PartBounds> query_parts(const Frustum& frustum) const;
+
+    /// Updates the cached triangulations of all part meshes, spreading meshes and their faces over the pool.
+    /// Each shared mesh is triangulated once.
+    void triangulate(ThreadPool& pool) const;
 
   private:
-    std::vector<Part> parts_;
-    std::vector<Joint> joints_;
+    friend class SceneFileIo;
+
+    // the state of a part besides the Part itself: its place in parts_, the joint graph and the kinematic tree
+    struct PartNode {
+      std::size_t index{};  // in parts_
+      boost::container::small_vector<JointId, 4> joints;
+      std::optional<JointId> parent_joint;  // the joint attaching the part to its parent
+      boost::container::small_vector<PartId, 4> children;
+      kln::motor local_motor{identity_motor};  // relative to the parent, or in world space for a root
+      bool dirty{};                            // the world motors of the part and its subtree are outdated
+    };
+    // hierarchy over the world bounds of parts_, and the state of each part it was built for
+    struct PartBvhKey {
+      PartId id;
+      Revision mesh_revision;
+      Revision motor_revision;
+      bool operator==(const PartBvhKey&) const = default;
+    };
+    struct PartBvh {
+      Bvh bvh;
+      std::vector<PartBvhKey> keys;
+      std::vector<Aabb> boxes;     // the world bounds of each part
+      std::size_t refit_count{};  // the parts refitted since it was built
+    };
+
+    PersistentVector<Part> parts_;
+    PersistentVector<std::optional<PartNode>> part_nodes_;  // by part id, empty for removed parts
+    PersistentVector<std::shared_ptr<const Joint>> joints_;  // by joint id, null for removed joints
+    std::shared_ptr<MeshPool> meshes_{std::make_shared<MeshPool>()};
+    mutable std::shared_ptr<PartBvh> part_bvh_;  // shared by copies of the scene, copied before it is refitted
+    mutable std::vector<PartId> changed_parts_;  // parts which may have changed since the hierarchy was updated
+    mutable bool rebuild_part_bvh_{};            // parts were added or removed since
+    std::vector<PartId> dirty_parts_;
+
+    /// Refits the part hierarchy to the changed parts, or rebuilds it, see raycast().
+    const PartBvh& part_bvh() const;
+
+    /// Notes that a part may have changed for the next update of the part hierarchy.
+    void mark_part_changed(PartId id);
+
+    /// The node of a part, or null if there is none in the scene.
+    const PartNode* find_node(PartId id) const;
+
+    /// The node of a part in the scene for modification, copied first if it is shared with a copy of the scene.
+    PartNode& mutate_node(PartId id);
+
+    /// The parent of a part in the kinematic tree, or nothing if the part is a root.
+    std::optional<PartId> parent_of(const PartNode& node) const;
+
+    /// The world motor of a part after the next update_motors(), composed from the local motors of its ancestors.
+    kln::motor pending_world_motor(PartId id) const;
+
+    /// Makes a part a root of the kinematic tree, keeping its world motor.
+    void detach_from_parent(PartId id);
   };
 }
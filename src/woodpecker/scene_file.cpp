@@ -0,0 +1,486 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "scene_file.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <span>
+#include <system_error>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <fmt/format.h>
+#include <woodpecker/util/cast.hpp>
+#include <woodpecker/util/trace.hpp>
+
+namespace wdp {
+  static_assert(std::endian::native == std::endian::little, "the scene file format is little-endian");
+  // arrays of the mesh storage are copied as a whole
+  static_assert(sizeof(Vertex) == 4 * sizeof(float) && sizeof(kln::plane) == 4 * sizeof(float));
+  static_assert(sizeof(std::size_t) == sizeof(std::uint64_t));
+
+  namespace {
+    constexpr auto magic = std::array<char, 8>{'W', 'D', 'P', 'S', 'C', 'E', 'N', 'E'};
+    constexpr auto section_alignment = std::size_t{64};
+
+    struct FileHeader {
+      std::array<char, 8> magic;
+      std::uint32_t version;
+      std::uint32_t section_count;
+    };
+
+    enum class SectionType : std::uint32_t {
+      meshes = 1,         // MeshRecord
+      vertices = 2,       // kln::point as w, x, y, z
+      face_vertices = 3,  // VertexIndex
+      face_offsets = 4,   // uint64, face_count + 1 per mesh, starting at 0
+      face_planes = 5,    // kln::plane as d, x, y, z
+      parts = 6,          // PartRecord
+      joints = 7,         // JointRecord
+      kinematic_tree = 8  // TreeRecord, one per part record
+    };
+
+    struct SectionHeader {
+      SectionType type;
+      std::uint32_t record_size;
+      std::uint64_t offset;  // from the start of the file
+      std::uint64_t count;   // of records
+    };
+
+    /// A mesh, as ranges of records in the other mesh sections.
+    struct MeshRecord {
+      std::uint64_t first_vertex;
+      std::uint64_t vertex_count;
+      std::uint64_t first_face;  // in face planes, its offsets start at first_face + the mesh index
+      std::uint64_t face_count;
+      std::uint64_t first_face_vertex;
+      std::uint64_t face_vertex_count;
+    };
+
+    struct PartRecord {
+      std::uint32_t mesh;
+      std::uint32_t reserved;
+      std::array<float, 8> motor;  // scalar, e23, e31, e12, e01, e02, e03, e0123
+    };
+
+    enum class JointTypeTag : std::uint32_t { none = 0, miter = 1, butt = 2 };
+
+    struct JointRecord {
+      std::array<std::uint32_t, 2> parts;  // part record indices
+      JointTypeTag type;
+      Fastener fastener;
+    };
+
+    /// The place of a part in the kinematic tree.
+    struct TreeRecord {
+      std::uint32_t parent_joint;  // joint record index, or no_parent_joint for a root
+      std::uint32_t reserved;
+      std::array<float, 8> local_motor;  // as in PartRecord
+    };
+
+    constexpr auto no_parent_joint = std::numeric_limits<std::uint32_t>::max();
+
+    constexpr auto section_types =
+        std::array{SectionType::meshes,      SectionType::vertices, SectionType::face_vertices,
+                   SectionType::face_offsets, SectionType::face_planes, SectionType::parts,
+                   SectionType::joints,       SectionType::kinematic_tree};
+
+    std::size_t align_up(std::size_t offset) noexcept {
+      return (offset + section_alignment - 1) / section_alignment * section_alignment;
+    }
+
+    std::array<float, 8> motor_to_array(const kln::motor& motor) noexcept {
+      return {motor.scalar(), motor.e23(), motor.e31(), motor.e12(),
+              motor.e01(),    motor.e02(), motor.e03(), motor.e0123()};
+    }
+
+    kln::motor motor_from_array(const std::array<float, 8>& m) noexcept {
+      return kln::motor{m[0], m[1], m[2], m[3], m[4], m[5], m[6], m[7]};
+    }
+
+    JointRecord joint_to_record(const Joint& joint, const std::unordered_map<PartId, std::uint32_t>& part_records) {
+      auto record = JointRecord{{part_records.at(joint.parts[0]), part_records.at(joint.parts[1])},
+                                JointTypeTag::none, Fastener{}};
+      if (dynamic_cast<const MiterJointType*>(joint.type.get()) != nullptr) {
+        record.type = JointTypeTag::miter;
+      } else if (const auto* butt = dynamic_cast<const ButtJointType*>(joint.type.get())) {
+        record.type = JointTypeTag::butt;
+        record.fastener = butt->fastener;
+      }
+      return record;
+    }
+
+    std::unique_ptr<JointTypeBase> joint_type_from_record(const JointRecord& record) {
+      switch (record.type) {
+        case JointTypeTag::none:
+          return nullptr;
+        case JointTypeTag::miter:
+          return std::make_unique<MiterJointType>();
+        case JointTypeTag::butt: {
+          if (record.fastener > Fastener::glue) {
+            break;
+          }
+          auto butt = std::make_unique<ButtJointType>();
+          butt->fastener = record.fastener;
+          return butt;
+        }
+      }
+      throw SceneFileError{fmt::format("invalid joint type {}", static_cast<std::uint32_t>(record.type))};
+    }
+  }
+
+  /// Reads and writes the sections of a scene file, with access to the storage of meshes.
+  class SceneFileIo {
+  public:
+    static void save(const Scene& scene, const std::filesystem::path& path);
+    static Scene load(const std::filesystem::path& path);
+  };
+
+  void SceneFileIo::save(const Scene& scene, const std::filesystem::path& path) {
+    WDP_TRACE_SCOPE("save_scene");
+    // collect distinct meshes and lay out their storage
+    auto mesh_records = std::vector<MeshRecord>{};
+    auto meshes = std::vector<const Mesh*>{};
+    auto mesh_indices = std::unordered_map<const Mesh*, std::uint32_t>{};
+    auto part_records = std::vector<PartRecord>{};
+    auto part_indices = std::unordered_map<PartId, std::uint32_t>{};
+    auto totals = MeshRecord{};
+    for (const auto& part : scene.parts()) {
+      const auto* mesh = &part.mesh();
+      const auto [iter, inserted] = mesh_indices.try_emplace(mesh, narrow<std::uint32_t>(meshes.size()));
+      if (inserted) {
+        const auto record = MeshRecord{totals.vertex_count,      mesh->vertices_.size(),
+                                       totals.face_count,        mesh->face_planes_.size(),
+                                       totals.face_vertex_count, mesh->face_vertices_.size()};
+        totals.vertex_count += record.vertex_count;
+        totals.face_count += record.face_count;
+        totals.face_vertex_count += record.face_vertex_count;
+        mesh_records.push_back(record);
+        meshes.push_back(mesh);
+      }
+      part_indices.emplace(part.id(), narrow<std::uint32_t>(part_records.size()));
+      part_records.push_back({iter->second, 0, motor_to_array(part.motor())});
+    }
+
+    // joints in the order they were added
+    auto joint_ids = std::vector<JointId>{};
+    for (const auto& [joint_id, joint] : scene.joints()) {
+      joint_ids.push_back(joint_id);
+    }
+    std::ranges::sort(joint_ids);
+    auto joint_records = std::vector<JointRecord>{};
+    for (const auto joint_id : joint_ids) {
+      joint_records.push_back(joint_to_record(*scene.find_joint(joint_id), part_indices));
+    }
+
+    // the kinematic tree as it is, which may differ from the one rebuilt by adding the joints again in order
+    auto tree_records = std::vector<TreeRecord>{};
+    tree_records.reserve(part_records.size());
+    for (const auto& part : scene.parts()) {
+      const auto& node = *scene.find_node(part.id());
+      auto parent_joint = no_parent_joint;
+      if (node.parent_joint) {
+        const auto iter = std::ranges::lower_bound(joint_ids, *node.parent_joint);
+        parent_joint = narrow<std::uint32_t>(iter - joint_ids.begin());
+      }
+      tree_records.push_back({parent_joint, 0, motor_to_array(node.local_motor)});
+    }
+
+    // section table
+    const auto counts = std::array<std::uint64_t, section_types.size()>{
+        mesh_records.size(),     totals.vertex_count, totals.face_vertex_count, totals.face_count + meshes.size(),
+        totals.face_count,       part_records.size(), joint_records.size(),      tree_records.size()};
+    const auto record_sizes = std::array<std::uint32_t, section_types.size()>{
+        sizeof(MeshRecord), sizeof(Vertex),      sizeof(VertexIndex), sizeof(std::uint64_t),
+        sizeof(kln::plane), sizeof(PartRecord), sizeof(JointRecord), sizeof(TreeRecord)};
+    auto sections = std::array<SectionHeader, section_types.size()>{};
+    auto offset = align_up(sizeof(FileHeader) + sizeof(sections));
+    for (std::size_t i = 0; i < sections.size(); ++i) {
+      sections[i] = {section_types[i], record_sizes[i], offset, counts[i]};
+      offset = align_up(offset + counts[i] * record_sizes[i]);
+    }
+
+    // write next to the target and replace it only once complete, so that a failed save keeps the previous file
+    auto temp_path = path;
+    temp_path += ".tmp";
+    auto out = std::ofstream{temp_path, std::ios::binary | std::ios::trunc};
+    if (!out) {
+      throw SceneFileError{fmt::format("could not open {} for writing", temp_path.string())};
+    }
+    const auto discard_temp = [&] {
+      out.close();
+      auto error = std::error_code{};
+      std::filesystem::remove(temp_path, error);
+    };
+    try {
+      auto position = std::size_t{0};
+      const auto write_bytes = [&](const void* data, std::size_t size) {
+        out.write(static_cast<const char*>(data), narrow<std::streamsize>(size));
+        position += size;
+      };
+      const auto pad_to = [&](std::size_t target) {
+        static constexpr auto zeros = std::array<char, section_alignment>{};
+        write_bytes(zeros.data(), target - position);
+      };
+      const auto header = FileHeader{magic, scene_file_version, narrow<std::uint32_t>(sections.size())};
+      write_bytes(&header, sizeof(header));
+      write_bytes(sections.data(), sizeof(sections));
+
+      // each section as one write per mesh array
+      pad_to(sections[0].offset);
+      write_bytes(mesh_records.data(), mesh_records.size() * sizeof(MeshRecord));
+      pad_to(sections[1].offset);
+      for (const auto* mesh : meshes) {
+        write_bytes(mesh->vertices_.data(), mesh->vertices_.size() * sizeof(Vertex));
+      }
+      pad_to(sections[2].offset);
+      for (const auto* mesh : meshes) {
+        write_bytes(mesh->face_vertices_.data(), mesh->face_vertices_.size() * sizeof(VertexIndex));
+      }
+      pad_to(sections[3].offset);
+      for (const auto* mesh : meshes) {
+        write_bytes(mesh->face_offsets_.data(), mesh->face_offsets_.size() * sizeof(std::uint64_t));
+      }
+      pad_to(sections[4].offset);
+      for (const auto* mesh : meshes) {
+        write_bytes(mesh->face_planes_.data(), mesh->face_planes_.size() * sizeof(kln::plane));
+      }
+      pad_to(sections[5].offset);
+      write_bytes(part_records.data(), part_records.size() * sizeof(PartRecord));
+      pad_to(sections[6].offset);
+      write_bytes(joint_records.data(), joint_records.size() * sizeof(JointRecord));
+      pad_to(sections[7].offset);
+      write_bytes(tree_records.data(), tree_records.size() * sizeof(TreeRecord));
+
+      out.close();
+    } catch (...) {
+      discard_temp();
+      throw;
+    }
+    auto error = std::error_code{};
+    if (out) {
+      std::filesystem::rename(temp_path, path, error);
+    }
+    if (!out || error) {
+      discard_temp();
+      throw SceneFileError{fmt::format("could not write {}", path.string())};
+    }
+  }
+
+  Scene SceneFileIo::load(const std::filesystem::path& path) {
+    WDP_TRACE_SCOPE("load_scene");
+    namespace bip = boost::interprocess;
+    auto region = bip::mapped_region{};
+    try {
+      const auto mapping = bip::file_mapping{path.string().c_str(), bip::read_only};
+      region = bip::mapped_region{mapping, bip::read_only};
+    } catch (const bip::interprocess_exception& e) {
+      throw SceneFileError{fmt::format("could not map {}: {}", path.string(), e.what())};
+    }
+    const auto file = std::span{static_cast<const std::byte*>(region.get_address()), region.get_size()};
+
+    // header
+    auto header = FileHeader{};
+    if (file.size() < sizeof(header)) {
+      throw SceneFileError{fmt::format("{} is not a scene file", path.string())};
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (header.magic != magic) {
+      throw SceneFileError{fmt::format("{} is not a scene file", path.string())};
+    }
+    if (header.version == 0 || header.version > scene_file_version) {
+      throw SceneFileError{fmt::format("{} has unsupported version {}", path.string(), header.version)};
+    }
+    if (file.size() < sizeof(header) + header.section_count * sizeof(SectionHeader)) {
+      throw SceneFileError{fmt::format("{} is truncated", path.string())};
+    }
+
+    // section table, unknown sections are skipped
+    auto section_bytes = std::unordered_map<SectionType, std::span<const std::byte>>{};
+    auto section_counts = std::unordered_map<SectionType, std::size_t>{};
+    for (std::uint32_t i = 0; i < header.section_count; ++i) {
+      auto section = SectionHeader{};
+      std::memcpy(&section, file.data() + sizeof(header) + i * sizeof(section), sizeof(section));
+      const auto size = section.count * section.record_size;
+      if (section.offset > file.size() || size / std::max(section.record_size, 1U) != section.count ||
+          size > file.size() - section.offset) {
+        throw SceneFileError{fmt::format("{} has a section out of bounds", path.string())};
+      }
+      section_bytes[section.type] = file.subspan(section.offset, size);
+      section_counts[section.type] = section.count;
+    }
+    const auto section = [&]<class Record>(SectionType type, std::type_identity<Record>) {
+      const auto iter = section_bytes.find(type);
+      if (iter == section_bytes.end()) {
+        return std::span<const std::byte>{};
+      }
+      if (iter->second.size() != section_counts[type] * sizeof(Record)) {
+        throw SceneFileError{fmt::format("{} has a section with an unexpected record size", path.string())};
+      }
+      return iter->second;
+    };
+    const auto mesh_bytes = section(SectionType::meshes, std::type_identity<MeshRecord>{});
+    const auto vertex_bytes = section(SectionType::vertices, std::type_identity<Vertex>{});
+    const auto face_vertex_bytes = section(SectionType::face_vertices, std::type_identity<VertexIndex>{});
+    const auto face_offset_bytes = section(SectionType::face_offsets, std::type_identity<std::uint64_t>{});
+    const auto face_plane_bytes = section(SectionType::face_planes, std::type_identity<kln::plane>{});
+    const auto part_bytes = section(SectionType::parts, std::type_identity<PartRecord>{});
+    const auto joint_bytes = section(SectionType::joints, std::type_identity<JointRecord>{});
+    const auto tree_bytes = section(SectionType::kinematic_tree, std::type_identity<TreeRecord>{});
+
+    // copies a range of records from a section into a vector, checking that it is in bounds
+    const auto copy_records = [&]<class T>(std::vector<T>& to, std::span<const std::byte> from, std::uint64_t first,
+                                           std::uint64_t count) {
+      const auto record_count = from.size() / sizeof(T);
+      if (first > record_count || count > record_count - first) {
+        throw SceneFileError{fmt::format("{} has a mesh out of bounds", path.string())};
+      }
+      to.resize(count);
+      std::memcpy(to.data(), from.data() + first * sizeof(T), count * sizeof(T));
+    };
+
+    auto scene = Scene{};
+
+    // meshes
+    auto meshes = std::vector<SharedMesh>{};
+    meshes.reserve(mesh_bytes.size() / sizeof(MeshRecord));
+    for (std::size_t mesh_idx = 0; mesh_idx < mesh_bytes.size() / sizeof(MeshRecord); ++mesh_idx) {
+      auto record = MeshRecord{};
+      std::memcpy(&record, mesh_bytes.data() + mesh_idx * sizeof(record), sizeof(record));
+      auto mesh = Mesh{};
+      copy_records(mesh.vertices_, vertex_bytes, record.first_vertex, record.vertex_count);
+      copy_records(mesh.face_vertices_, face_vertex_bytes, record.first_face_vertex, record.face_vertex_count);
+      copy_records(mesh.face_offsets_, face_offset_bytes, record.first_face + mesh_idx, record.face_count + 1);
+      copy_records(mesh.face_planes_, face_plane_bytes, record.first_face, record.face_count);
+
+      // the offsets must be valid, as faces are accessed without checks
+      const auto& offsets = mesh.face_offsets_;
+      const auto valid_offsets = offsets.front() == 0 && offsets.back() == mesh.face_vertices_.size() &&
+                                 std::ranges::adjacent_find(offsets, [](std::size_t begin, std::size_t end) {
+                                   return end < begin + 3;
+                                 }) == offsets.end();
+      const auto valid_indices = std::ranges::all_of(
+          mesh.face_vertices_, [&](VertexIndex vertex_index) { return vertex_index < mesh.vertices_.size(); });
+      // as on import, welding and the geometry of faces require finite vertices and planes with a normal
+      const auto valid_vertices = std::ranges::all_of(mesh.vertices_, [](const Vertex& vertex) {
+        return std::isfinite(vertex.pos.x()) && std::isfinite(vertex.pos.y()) && std::isfinite(vertex.pos.z());
+      });
+      const auto valid_planes = std::ranges::all_of(mesh.face_planes_, [](const kln::plane& plane) {
+        return std::isfinite(plane.x()) && std::isfinite(plane.y()) && std::isfinite(plane.z()) &&
+               std::isfinite(plane.d()) && (plane.x() != 0 || plane.y() != 0 || plane.z() != 0);
+      });
+      if (!valid_offsets || !valid_indices || !valid_vertices || !valid_planes) {
+        throw SceneFileError{fmt::format("{} has an invalid mesh", path.string())};
+      }
+      for (FaceIndex face_idx = 0; face_idx < mesh.face_count(); ++face_idx) {
+        mesh.mark_face_dirty(face_idx);
+      }
+      meshes.push_back(scene.share_mesh(std::move(mesh)));
+    }
+
+    // parts
+    auto part_ids = std::vector<PartId>{};
+    part_ids.reserve(part_bytes.size() / sizeof(PartRecord));
+    for (std::size_t part_idx = 0; part_idx < part_bytes.size() / sizeof(PartRecord); ++part_idx) {
+      auto record = PartRecord{};
+      std::memcpy(&record, part_bytes.data() + part_idx * sizeof(record), sizeof(record));
+      if (record.mesh >= meshes.size()) {
+        throw SceneFileError{fmt::format("{} has a part without mesh", path.string())};
+      }
+      part_ids.push_back(scene.add_part(Part{meshes[record.mesh]}));
+      scene.move_part(part_ids.back(), motor_from_array(record.motor));
+    }
+
+    // joints
+    auto joint_records = std::vector<JointRecord>(joint_bytes.size() / sizeof(JointRecord));
+    std::memcpy(joint_records.data(), joint_bytes.data(), joint_bytes.size());
+    for (const auto& record : joint_records) {
+      if (record.parts[0] >= part_ids.size() || record.parts[1] >= part_ids.size() ||
+          record.parts[0] == record.parts[1]) {
+        throw SceneFileError{fmt::format("{} has a joint with invalid parts", path.string())};
+      }
+    }
+    for (const auto& record : joint_records) {
+      const auto joint_id = narrow<JointId>(scene.joints_.size());
+      for (const auto part_idx : record.parts) {
+        scene.mutate_node(part_ids[part_idx]).joints.push_back(joint_id);
+      }
+      scene.joints_.push_back(std::make_shared<const Joint>(
+          Joint{joint_type_from_record(record), {part_ids[record.parts[0]], part_ids[record.parts[1]]}}));
+    }
+
+    // kinematic tree, where a joint attaches the second of its parts as a child of the first
+    if (!section_bytes.contains(SectionType::kinematic_tree) ||
+        tree_bytes.size() / sizeof(TreeRecord) != part_ids.size()) {
+      throw SceneFileError{fmt::format("{} has an invalid kinematic tree", path.string())};
+    }
+    for (std::size_t part_idx = 0; part_idx < part_ids.size(); ++part_idx) {
+      auto record = TreeRecord{};
+      std::memcpy(&record, tree_bytes.data() + part_idx * sizeof(record), sizeof(record));
+      if (record.parent_joint != no_parent_joint &&
+          (record.parent_joint >= joint_records.size() || joint_records[record.parent_joint].parts[1] != part_idx)) {
+        throw SceneFileError{fmt::format("{} has an invalid kinematic tree", path.string())};
+      }
+      auto& node = scene.mutate_node(part_ids[part_idx]);
+      node.local_motor = motor_from_array(record.local_motor);
+      if (record.parent_joint != no_parent_joint) {
+        node.parent_joint = JointId{record.parent_joint};
+      }
+    }
+    // children in the order they were attached, as by adding their joints
+    for (JointId joint_id = 0; joint_id < joint_records.size(); ++joint_id) {
+      const auto [parent_idx, child_idx] = joint_records[joint_id].parts;
+      if (scene.find_node(part_ids[child_idx])->parent_joint == joint_id) {
+        scene.mutate_node(part_ids[parent_idx]).children.push_back(part_ids[child_idx]);
+      }
+    }
+    // each part has at most one parent, so the tree has a cycle unless all parts are reached from the roots
+    auto reached = std::vector<PartId>{};
+    for (const auto part_id : part_ids) {
+      if (!scene.find_node(part_id)->parent_joint) {
+        reached.push_back(part_id);
+      }
+    }
+    for (std::size_t i = 0; i < reached.size(); ++i) {
+      const auto& children = scene.find_node(reached[i])->children;
+      reached.insert(reached.end(), children.begin(), children.end());
+    }
+    if (reached.size() != part_ids.size()) {
+      throw SceneFileError{fmt::format("{} has an invalid kinematic tree", path.string())};
+    }
+
+    // all parts were moved, so the world motors follow from the local ones, as saved motors may predate moves
+    // not yet applied by update_motors()
+    scene.update_motors();
+    return scene;
+  }
+
+  void save_scene(const Scene& scene, const std::filesystem::path& path) { SceneFileIo::save(scene, path); }
+
+  Scene load_scene(const std::filesystem::path& path) { return SceneFileIo::load(path); }
+}
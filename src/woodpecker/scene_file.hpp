@@ -0,0 +1,55 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+
+#include <woodpecker/scene.hpp>
+
+namespace wdp {
+  /// The version of the scene file format written by save_scene().
+  inline constexpr auto scene_file_version = std::uint32_t{1};
+
+  /// An error reading or writing a scene file.
+  class SceneFileError : public std::runtime_error {
+  public:
+    explicit SceneFileError(const std::string& message) : runtime_error(message) {}
+  };
+
+  /// Writes a scene to a file in the binary scene format.
+  ///
+  /// The format is little-endian. A header with a magic string and the version is followed by a table of sections,
+  /// each of which is a contiguous array of fixed-size records, starting at a 64-byte aligned offset:
+  /// the meshes, their vertices, face vertex indices, face offsets and face planes, the parts, the joints,
+  /// and the kinematic tree as the parent joint and local motor of each part.
+  /// Each mesh shared by several parts is stored once.
+  /// Vertices and planes are stored in the memory layout of klein, so that a mapped file is copied into the
+  /// storage of a Mesh with a single memcpy per array, without parsing individual elements.
+  /// Readers skip sections of unknown types, so later versions may add sections.
+  /// The file is written next to the target first and then renamed over it, so a failed save keeps the previous file.
+  /// \throws SceneFileError If the file could not be written.
+  void save_scene(const Scene& scene, const std::filesystem::path& path);
+
+  /// Reads a scene from a file written by save_scene(), by mapping it into memory.
+  /// Parts and joints get new identifiers in the order they were saved, the kinematic tree is restored as it was.
+  /// \throws SceneFileError If the file could not be read, or is not a valid scene file of a supported version.
+  Scene load_scene(const std::filesystem::path& path);
+}
@@ -0,0 +1,56 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "scene_history.hpp"
+
+#include <utility>
+
+namespace wdp {
+  void SceneHistory::record(const Scene& scene) {
+    if (max_steps_ == 0) {
+      return;
+    }
+    if (undo_steps_.size() == max_steps_) {
+      undo_steps_.pop_front();
+    }
+    undo_steps_.push_back(scene);
+    redo_steps_.clear();
+  }
+
+  void SceneHistory::undo(Scene& scene) {
+    if (undo_steps_.empty()) {
+      return;
+    }
+    redo_steps_.push_back(std::move(scene));
+    scene = std::move(undo_steps_.back());
+    undo_steps_.pop_back();
+  }
+
+  void SceneHistory::redo(Scene& scene) {
+    if (redo_steps_.empty()) {
+      return;
+    }
+    undo_steps_.push_back(std::move(scene));
+    scene = std::move(redo_steps_.back());
+    redo_steps_.pop_back();
+  }
+
+  void SceneHistory::clear() {
+    undo_steps_.clear();
+    redo_steps_.clear();
+  }
+}
@@ -0,0 +1,56 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+#include <woodpecker/scene.hpp>
+
+namespace wdp {
+  /// Undo and redo for a Scene, keeping a copy of the scene per step.
+  /// The copies share everything but the parts and joints changed in between, see Scene,
+  /// so recording a step takes constant time, and undoing or redoing one only swaps whole scenes.
+  class SceneHistory {
+  public:
+    /// \param max_steps The number of undo steps kept, the oldest ones are dropped beyond.
+    explicit SceneHistory(std::size_t max_steps = 1000) : max_steps_{max_steps} {}
+
+    /// Records the state of a scene before an edit, to be restored by undo(). Drops all redo steps.
+    void record(const Scene& scene);
+
+    bool can_undo() const noexcept { return !undo_steps_.empty(); }
+    bool can_redo() const noexcept { return !redo_steps_.empty(); }
+
+    /// Restores a scene to the last recorded state, keeping its current state for redo().
+    /// Does nothing if there is no undo step.
+    void undo(Scene& scene);
+
+    /// Restores a scene to the state before the last undo(), keeping its current state for undo().
+    /// Does nothing if there is no redo step.
+    void redo(Scene& scene);
+
+    /// Drops all undo and redo steps.
+    void clear();
+
+  private:
+    std::size_t max_steps_;
+    std::deque<Scene> undo_steps_;  // oldest first
+    std::vector<Scene> redo_steps_;
+  };
+}
@@ -0,0 +1,427 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "triangulation.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <memory_resource>
+#include <optional>
+#include <set>
+#include <utility>
+
+#include <woodpecker/util/arena.hpp>
+#include <woodpecker/util/assert.hpp>
+
+namespace wdp {
+  namespace {
+    struct Vec2d {
+      double x{};
+      double y{};
+    };
+
+    /// The orientation of the triangle a, b, c: positive if counter-clockwise, negative if clockwise.
+    double orient(const Vec2d& a, const Vec2d& b, const Vec2d& c) noexcept {
+      return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    }
+
+    /// The order of the sweep: higher points first, ties broken by smaller x.
+    bool is_above(const Vec2d& p, const Vec2d& q) noexcept { return p.y > q.y || (p.y == q.y && p.x < q.x); }
+
+    enum class VertexType { start, end, split, merge, regular };
+
+    /// Triangulates a counter-clockwise simple polygon, see triangulate_monotone.
+    /// All temporaries are allocated from the scratch resource.
+    class MonotoneTriangulator {
+    public:
+      MonotoneTriangulator(std::span<const Vec2d> points, std::pmr::memory_resource* scratch)
+          : points_{points}, size_{points.size()}, scratch_{scratch}, neighbours_{scratch} {}
+
+      /// Writes the n - 2 triangles of the polygon.
+      /// \return Whether the polygon was triangulated, fails for polygons which are not simple.
+      bool run(std::span<PolygonTriangle> triangles) {
+        triangles_ = triangles;
+        triangle_count_ = 0;
+        if (!add_diagonals()) {
+          return false;
+        }
+        if (!for_each_monotone_piece([&](std::span<const unsigned> piece) { triangulate_piece(piece); })) {
+          return false;
+        }
+        return triangle_count_ == triangles_.size();
+      }
+
+    private:
+      /// An edge from vertex i to vertex i + 1, stored in the sweep status if the polygon lies to its right.
+      struct Edge {
+        unsigned index;  // of the first vertex
+        unsigned upper;
+        unsigned lower;
+      };
+
+      /// Orders edges crossing the sweep line from left to right.
+      /// Tests the upper end point which was swept last against the line through the other edge,
+      /// so the order is independent of the current sweep position.
+      struct EdgeLess {
+        std::span<const Vec2d> pts;
+
+        bool operator()(const Edge& a, const Edge& b) const noexcept {
+          if (is_above(pts[b.upper], pts[a.upper])) {
+            return orient(pts[b.upper], pts[b.lower], pts[a.upper]) < 0;  // a starts left of b
+          }
+          if (a.upper != b.upper) {
+            return orient(pts[a.upper], pts[a.lower], pts[b.upper]) > 0;  // b starts right of a
+          }
+          return orient(pts[a.upper], pts[a.lower], pts[b.lower]) > 0;  // b leaves to the right of a
+        }
+      };
+
+      using Status = std::pmr::set<Edge, EdgeLess>;
+
+      std::span<const Vec2d> points_;
+      std::size_t size_;
+      std::pmr::memory_resource* scratch_;
+      std::pmr::vector<std::pmr::vector<unsigned>> neighbours_;  // per vertex, boundary and diagonal neighbours
+      std::span<PolygonTriangle> triangles_;
+      std::size_t triangle_count_{};  // may exceed the output range for polygons which are not simple
+
+      unsigned prev(unsigned v) const noexcept { return v == 0 ? static_cast<unsigned>(size_ - 1) : v - 1; }
+      unsigned next(unsigned v) const noexcept { return v + 1 == size_ ? 0 : v + 1; }
+
+      Edge edge(unsigned v) const noexcept {
+        const auto w = next(v);
+        return is_above(points_[v], points_[w]) ? Edge{v, v, w} : Edge{v, w, v};
+      }
+
+      VertexType vertex_type(unsigned v) const noexcept {
+        const auto prev_above = is_above(points_[prev(v)], points_[v]);
+        const auto next_above = is_above(points_[next(v)], points_[v]);
+        const auto is_convex = orient(points_[prev(v)], points_[v], points_[next(v)]) > 0;
+        if (!prev_above && !next_above) {
+          return is_convex ? VertexType::start : VertexType::split;
+        }
+        if (prev_above && next_above) {
+          return is_convex ? VertexType::end : VertexType::merge;
+        }
+        return VertexType::regular;
+      }
+
+      /// Sweeps the polygon from top to bottom, inserting diagonals which remove split and merge vertices.
+      bool add_diagonals() {
+        neighbours_.clear();
+        neighbours_.resize(size_);
+        for (auto v = 0U; v < size_; ++v) {
+          neighbours_[v].push_back(prev(v));
+          neighbours_[v].push_back(next(v));
+        }
+
+        auto order = std::pmr::vector<unsigned>(size_, scratch_);
+        for (auto v = 0U; v < size_; ++v) {
+          order[v] = v;
+        }
+        std::ranges::sort(order, [&](unsigned a, unsigned b) { return is_above(points_[a], points_[b]); });
+
+        auto types = std::pmr::vector<VertexType>(size_, scratch_);
+        for (auto v = 0U; v < size_; ++v) {
+          types[v] = vertex_type(v);
+        }
+
+        auto status = Status{EdgeLess{points_}, scratch_};
+        auto status_iters = std::pmr::vector<Status::iterator>(size_, status.end(), scratch_);
+        auto helpers = std::pmr::vector<unsigned>(size_, scratch_);
+
+        const auto insert_edge = [&](unsigned v) {
+          status_iters[v] = status.insert(edge(v)).first;
+          helpers[v] = v;
+        };
+        const auto erase_edge = [&](unsigned e) {
+          if (status_iters[e] == status.end()) {
+            return false;
+          }
+          status.erase(status_iters[e]);
+          status_iters[e] = status.end();
+          return true;
+        };
+        const auto edge_left_of = [&](unsigned v) -> std::optional<unsigned> {
+          const auto iter = status.lower_bound(Edge{v, v, v});
+          if (iter == status.begin()) {
+            return std::nullopt;
+          }
+          return std::prev(iter)->index;
+        };
+        const auto connect_merge_helper = [&](unsigned v, unsigned e) {
+          if (types[helpers[e]] == VertexType::merge) {
+            add_diagonal(v, helpers[e]);
+          }
+        };
+
+        for (const auto v : order) {
+          const auto e_prev = prev(v);
+          switch (types[v]) {
+            case VertexType::start:
+              insert_edge(v);
+              break;
+            case VertexType::end:
+              if (status_iters[e_prev] == status.end()) {
+                return false;
+              }
+              connect_merge_helper(v, e_prev);
+              erase_edge(e_prev);
+              break;
+            case VertexType::split: {
+              const auto e_left = edge_left_of(v);
+              if (!e_left) {
+                return false;
+              }
+              add_diagonal(v, helpers[*e_left]);
+              helpers[*e_left] = v;
+              insert_edge(v);
+              break;
+            }
+            case VertexType::merge: {
+              if (status_iters[e_prev] == status.end()) {
+                return false;
+              }
+              connect_merge_helper(v, e_prev);
+              erase_edge(e_prev);
+              const auto e_left = edge_left_of(v);
+              if (!e_left) {
+                return false;
+              }
+              connect_merge_helper(v, *e_left);
+              helpers[*e_left] = v;
+              break;
+            }
+            case VertexType::regular:
+              if (is_above(points_[prev(v)], points_[v])) {
+                // polygon lies to the right, continue the left boundary
+                if (status_iters[e_prev] == status.end()) {
+                  return false;
+                }
+                connect_merge_helper(v, e_prev);
+                erase_edge(e_prev);
+                insert_edge(v);
+              } else {
+                const auto e_left = edge_left_of(v);
+                if (!e_left) {
+                  return false;
+                }
+                connect_merge_helper(v, *e_left);
+                helpers[*e_left] = v;
+              }
+              break;
+          }
+        }
+        return true;
+      }
+
+      void add_diagonal(unsigned a, unsigned b) {
+        neighbours_[a].push_back(b);
+        neighbours_[b].push_back(a);
+      }
+
+      /// Traces the faces of the polygon subdivided by the diagonals, each a monotone polygon.
+      template <class Visitor>
+      bool for_each_monotone_piece(const Visitor& visit) {
+        // sort neighbours counter-clockwise around each vertex
+        for (auto v = 0U; v < size_; ++v) {
+          const auto& center = points_[v];
+          const auto half = [&](unsigned w) {
+            const auto dy = points_[w].y - center.y;
+            return dy < 0 || (dy == 0 && points_[w].x < center.x);
+          };
+          std::ranges::sort(neighbours_[v], [&](unsigned a, unsigned b) {
+            if (half(a) != half(b)) {
+              return half(b);
+            }
+            return orient(center, points_[a], points_[b]) > 0;
+          });
+        }
+
+        // the half-edge from v to its k-th neighbour, marked once part of a traced face
+        auto used = std::pmr::vector<std::pmr::vector<bool>>(size_, scratch_);
+        for (auto v = 0U; v < size_; ++v) {
+          used[v].assign(neighbours_[v].size(), false);
+        }
+        const auto slot_of = [&](unsigned v, unsigned w) -> std::optional<std::size_t> {
+          const auto iter = std::ranges::find(neighbours_[v], w);
+          if (iter == neighbours_[v].end()) {
+            return std::nullopt;
+          }
+          return static_cast<std::size_t>(iter - neighbours_[v].begin());
+        };
+
+        auto piece = std::pmr::vector<unsigned>{scratch_};
+        const auto max_piece_size = size_ + 2 * (size_ - 3);
+        for (auto v = 0U; v < size_; ++v) {
+          for (auto k = std::size_t{0}; k < neighbours_[v].size(); ++k) {
+            // start at unused half-edges inside the polygon: boundary edges to the next vertex, or diagonals
+            if (used[v][k] || neighbours_[v][k] == prev(v)) {
+              continue;
+            }
+            piece.clear();
+            auto from = v;
+            auto slot = k;
+            while (!used[from][slot]) {
+              used[from][slot] = true;
+              piece.push_back(from);
+              if (piece.size() > max_piece_size) {
+                return false;
+              }
+              // continue with the neighbour clockwise from where we came from
+              const auto to = neighbours_[from][slot];
+              const auto back_slot = slot_of(to, from);
+              if (!back_slot) {
+                return false;
+              }
+              const auto degree = neighbours_[to].size();
+              slot = (*back_slot + degree - 1) % degree;
+              from = to;
+            }
+            if (from != v || piece.size() < 3) {
+              return false;
+            }
+            visit(piece);
+          }
+        }
+        return true;
+      }
+
+      void add_triangle(unsigned a, unsigned b, unsigned c) {
+        if (orient(points_[a], points_[b], points_[c]) < 0) {
+          std::swap(b, c);
+        }
+        if (triangle_count_ < triangles_.size()) {
+          triangles_[triangle_count_] = {a, b, c};
+        }
+        ++triangle_count_;
+      }
+
+      /// Triangulates a y-monotone polygon by sweeping its two chains with a stack.
+      void triangulate_piece(std::span<const unsigned> piece) {
+        const auto piece_size = piece.size();
+        const auto top_iter =
+            std::ranges::min_element(piece, [&](unsigned a, unsigned b) { return is_above(points_[a], points_[b]); });
+        const auto bottom_iter =
+            std::ranges::max_element(piece, [&](unsigned a, unsigned b) { return is_above(points_[a], points_[b]); });
+        const auto top = static_cast<std::size_t>(top_iter - piece.begin());
+        const auto bottom = static_cast<std::size_t>(bottom_iter - piece.begin());
+
+        // merge the left chain (counter-clockwise from the top) and the right chain into sweep order
+        struct ChainVertex {
+          unsigned vertex;
+          bool is_left;
+        };
+        auto sorted = std::pmr::vector<ChainVertex>{scratch_};
+        sorted.reserve(piece_size);
+        auto left = top;
+        auto right = (top + piece_size - 1) % piece_size;
+        sorted.push_back({piece[top], true});
+        while (sorted.size() < piece_size) {
+          const auto next_left = piece[(left + 1) % piece_size];
+          const auto take_left =
+              left != bottom && (right == bottom || is_above(points_[next_left], points_[piece[right]]));
+          if (take_left) {
+            left = (left + 1) % piece_size;
+            sorted.push_back({piece[left], true});
+          } else {
+            sorted.push_back({piece[right], false});
+            right = (right + piece_size - 1) % piece_size;
+          }
+        }
+
+        auto stack = std::pmr::vector<ChainVertex>{{sorted[0], sorted[1]}, scratch_};
+        for (auto j = std::size_t{2}; j + 1 < piece_size; ++j) {
+          const auto current = sorted[j];
+          if (current.is_left != stack.back().is_left) {
+            // opposite chain: connect to all vertices on the stack
+            for (auto i = std::size_t{0}; i + 1 < stack.size(); ++i) {
+              add_triangle(current.vertex, stack[i].vertex, stack[i + 1].vertex);
+            }
+            stack = {sorted[j - 1], current};
+          } else {
+            // same chain: connect as long as the diagonal lies inside the polygon
+            auto last = stack.back();
+            stack.pop_back();
+            while (!stack.empty()) {
+              const auto turn = orient(points_[stack.back().vertex], points_[current.vertex], points_[last.vertex]);
+              const auto is_inside = current.is_left ? turn < 0 : turn > 0;
+              if (!is_inside) {
+                break;
+              }
+              add_triangle(current.vertex, last.vertex, stack.back().vertex);
+              last = stack.back();
+              stack.pop_back();
+            }
+            stack.push_back(last);
+            stack.push_back(current);
+          }
+        }
+
+        // connect the bottom vertex to all remaining vertices
+        const auto last = sorted.back();
+        for (auto i = std::size_t{0}; i + 1 < stack.size(); ++i) {
+          add_triangle(last.vertex, stack[i].vertex, stack[i + 1].vertex);
+        }
+      }
+    };
+  }
+
+  std::vector<PolygonTriangle> triangulate_monotone(std::span<const Vec2> polygon) {
+    WDP_ASSERT_CHEAP(polygon.size() >= 3);
+    auto triangles = std::vector<PolygonTriangle>(polygon.size() - 2);
+    auto arena = ScratchArena{};
+    triangulate_monotone(polygon, triangles, arena.resource());
+    return triangles;
+  }
+
+  void triangulate_monotone(std::span<const Vec2> polygon, std::span<PolygonTriangle> triangles,
+                            std::pmr::memory_resource* scratch) {
+    WDP_ASSERT_CHEAP(polygon.size() >= 3);
+    WDP_ASSERT_CHEAP(triangles.size() + 2 == polygon.size());
+    const auto size = static_cast<unsigned>(polygon.size());
+    if (size == 3) {
+      triangles[0] = {0, 1, 2};
+      return;
+    }
+
+    // work on a counter-clockwise polygon, mirroring clockwise ones
+    auto signed_area = 0.0;
+    for (auto v = 0U; v < size; ++v) {
+      const auto& a = polygon[v];
+      const auto& b = polygon[(v + 1) % size];
+      signed_area += static_cast<double>(a.x) * b.y - static_cast<double>(b.x) * a.y;
+    }
+    const auto mirror = signed_area < 0 ? -1.0 : 1.0;
+    auto points = std::pmr::vector<Vec2d>{scratch};
+    points.reserve(size);
+    for (const auto& p : polygon) {
+      points.push_back({mirror * p.x, p.y});
+    }
+
+    // triangles are counter-clockwise in the mirrored polygon, thus in the winding order of the input
+    if (MonotoneTriangulator{points, scratch}.run(triangles)) {
+      return;
+    }
+
+    // not a simple polygon, fall back to a fan around the first vertex
+    for (auto v = 1U; v + 1 < size; ++v) {
+      triangles[v - 1] = {0, v, v + 1};
+    }
+  }
+}
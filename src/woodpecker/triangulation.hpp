@@ -0,0 +1,52 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <array>
+#include <memory_resource>
+#include <span>
+#include <vector>
+
+namespace wdp {
+  /// A position in a 2D plane.
+  struct Vec2 {
+    float x{};
+    float y{};
+  };
+
+  /// A triangle of 3 indices into the vertex list of a polygon.
+  using PolygonTriangle = std::array<unsigned, 3>;
+
+  /// The algorithm used to triangulate a polygon.
+  enum class TriangulationMethod {
+    monotone,     ///< Decomposition into monotone polygons using a plane sweep, in O(n log n).
+    ear_clipping  ///< Ear clipping in O(n^3), kept as a simple reference implementation.
+  };
+
+  /// Triangulates a simple polygon by decomposing it into y-monotone polygons in a plane sweep,
+  /// then triangulating each monotone polygon in linear time.
+  /// \param polygon 3 or more vertices of a simple polygon in either winding order.
+  /// \return Exactly n - 2 triangles with the same winding order as the polygon.
+  ///         If the polygon is not simple, a fan triangulation is returned instead.
+  std::vector<PolygonTriangle> triangulate_monotone(std::span<const Vec2> polygon);
+
+  /// Like triangulate_monotone(polygon), but writes the triangles into a range of exactly n - 2 triangles
+  /// and allocates all temporaries from a scratch memory resource, such as a ScratchArena.
+  void triangulate_monotone(std::span<const Vec2> polygon, std::span<PolygonTriangle> triangles,
+                            std::pmr::memory_resource* scratch);
+}
@@ -0,0 +1,62 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "arena.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <utility>
+
+namespace wdp {
+  namespace {
+    constexpr auto initial_block_size = std::size_t{64} << 10;
+    /// Blocks do not grow beyond this size, so a single huge operation does not pin its memory to a thread.
+    constexpr auto max_block_size = std::size_t{16} << 20;
+  }
+
+  thread_local std::vector<ScratchArena::Block> ScratchArena::block_cache_;
+
+  ScratchArena::ScratchArena() : block_{take_block()}, arena_{block_.data.get(), block_.size, &overflow_} {}
+
+  ScratchArena::~ScratchArena() {
+    arena_.release();
+    // grow the block to hold everything allocated, so the next operation of the same size stays within it
+    if (overflow_.allocated_size() > 0 && block_.size < max_block_size) {
+      const auto size = std::min(std::bit_ceil(block_.size + overflow_.allocated_size()), max_block_size);
+      block_ = {std::make_unique_for_overwrite<std::byte[]>(size), size};
+    }
+    block_cache_.push_back(std::move(block_));
+  }
+
+  ScratchArena::Block ScratchArena::take_block() {
+    if (block_cache_.empty()) {
+      return {std::make_unique_for_overwrite<std::byte[]>(initial_block_size), initial_block_size};
+    }
+    auto block = std::move(block_cache_.back());
+    block_cache_.pop_back();
+    return block;
+  }
+
+  void* ScratchArena::OverflowResource::do_allocate(std::size_t bytes, std::size_t alignment) {
+    allocated_size_ += bytes;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+
+  void ScratchArena::OverflowResource::do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment) {
+    std::pmr::new_delete_resource()->deallocate(ptr, bytes, alignment);
+  }
+}
@@ -0,0 +1,72 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+namespace wdp {
+  /// A monotonic arena for the temporaries of a single operation, all freed at once when it goes out of scope.
+  /// The arena allocates from a block which is cached per thread and reused by the next arena on that thread.
+  /// Allocations which do not fit into the block fall back to the heap, and the block grows to the size
+  /// needed before it is cached, so repeated operations of similar size stop touching the heap.
+  /// Arenas may be nested, each takes its own block. An arena must be destroyed on the thread which created it.
+  class ScratchArena {
+  public:
+    ScratchArena();
+
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+
+    /// Frees all allocations and returns the block to the cache of the thread.
+    ~ScratchArena();
+
+    /// The memory resource allocating from the arena, for use with std::pmr containers.
+    std::pmr::memory_resource* resource() noexcept { return &arena_; }
+
+  private:
+    struct Block {
+      std::unique_ptr<std::byte[]> data;
+      std::size_t size{};
+    };
+
+    /// Allocates from the heap, counting the bytes which did not fit into the block.
+    class OverflowResource : public std::pmr::memory_resource {
+    public:
+      std::size_t allocated_size() const noexcept { return allocated_size_; }
+
+    private:
+      std::size_t allocated_size_{};
+
+      void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+      void do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment) override;
+      bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+    };
+
+    Block block_;
+    OverflowResource overflow_;
+    std::pmr::monotonic_buffer_resource arena_;
+
+    /// The blocks of the calling thread which are not used by an arena, freed when the thread exits.
+    static thread_local std::vector<Block> block_cache_;
+
+    /// Takes a cached block of the calling thread, or allocates a new one.
+    static Block take_block();
+  };
+}
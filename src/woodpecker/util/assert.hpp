@@ -86,5 +86,60 @@ namespace wdp {
   };
 }
 
-#define WDP_ASSERT(expr__, ...) \
+// Contracts come in tiers by the cost of checking them. The WOODPECKER_CONTRACT_LEVEL CMake option selects
+// through WDP_CONTRACT_LEVEL up to which tier they are checked, and the contracts of higher tiers compile to nothing.
+//
+// - WDP_ASSERT_CHEAP: constant time checks of arguments, such as sizes. Only disabled by the off level.
+// - WDP_ASSERT: checks of invariants, which cost little compared to the operation they guard. The default level.
+// - WDP_ASSERT_AUDIT: checks which cost as much as the operation itself or more, such as geometric properties
+//   of every vertex. For tests and CI, where they can be enabled by the audit level.
+//
+// Below the audit level, WDP_CONTRACT_AUDIT_SAMPLING set to n > 0 still checks every n-th call of each audit
+// contract on each thread, to catch violations in the field at a fraction of the cost.
+
+#define WDP_CONTRACT_LEVEL_OFF 0
+#define WDP_CONTRACT_LEVEL_CHEAP 1
+#define WDP_CONTRACT_LEVEL_NORMAL 2
+#define WDP_CONTRACT_LEVEL_AUDIT 3
+
+#ifndef WDP_CONTRACT_LEVEL
+#define WDP_CONTRACT_LEVEL WDP_CONTRACT_LEVEL_NORMAL
+#endif
+
+#ifndef WDP_CONTRACT_AUDIT_SAMPLING
+#define WDP_CONTRACT_AUDIT_SAMPLING 0
+#endif
+
+#define WDP_ASSERT_CHECK(expr__, ...) \
   ::wdp::Assertion{#expr__, WDP_CURRENT_SOURCE_LOCATION, __VA_ARGS__}([&]() noexcept { return expr__; })
+
+// the expression of a disabled contract is not evaluated, but still compiled, so its names count as used
+#define WDP_ASSERT_IGNORE(expr__, ...) static_cast<void>(sizeof(static_cast<bool>(expr__)))
+
+#define WDP_ASSERT_SAMPLED(expr__, ...)                                                     \
+  do {                                                                                      \
+    thread_local auto wdp_contract_calls__ = 0U;                                            \
+    if (wdp_contract_calls__++ % static_cast<unsigned>(WDP_CONTRACT_AUDIT_SAMPLING) == 0) { \
+      WDP_ASSERT_CHECK(expr__, __VA_ARGS__);                                                \
+    }                                                                                       \
+  } while (false)
+
+#if WDP_CONTRACT_LEVEL >= WDP_CONTRACT_LEVEL_CHEAP
+#define WDP_ASSERT_CHEAP(expr__, ...) WDP_ASSERT_CHECK(expr__, __VA_ARGS__)
+#else
+#define WDP_ASSERT_CHEAP(expr__, ...) WDP_ASSERT_IGNORE(expr__, __VA_ARGS__)
+#endif
+
+#if WDP_CONTRACT_LEVEL >= WDP_CONTRACT_LEVEL_NORMAL
+#define WDP_ASSERT(expr__, ...) WDP_ASSERT_CHECK(expr__, __VA_ARGS__)
+#else
+#define WDP_ASSERT(expr__, ...) WDP_ASSERT_IGNORE(expr__, __VA_ARGS__)
+#endif
+
+#if WDP_CONTRACT_LEVEL >= WDP_CONTRACT_LEVEL_AUDIT
+#define WDP_ASSERT_AUDIT(expr__, ...) WDP_ASSERT_CHECK(expr__, __VA_ARGS__)
+#elif WDP_CONTRACT_AUDIT_SAMPLING > 0
+#define WDP_ASSERT_AUDIT(expr__, ...) WDP_ASSERT_SAMPLED(expr__, __VA_ARGS__)
+#else
+#define WDP_ASSERT_AUDIT(expr__, ...) WDP_ASSERT_IGNORE(expr__, __VA_ARGS__)
+#endif
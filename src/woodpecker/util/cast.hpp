@@ -21,6 +21,8 @@
 #include <type_traits>
 #include <utility>
 
+#include <woodpecker/util/assert.hpp>
+
 namespace wdp {
   class NarrowOutOfRange : public std::logic_error {
   public:
@@ -40,4 +42,15 @@ namespace wdp {
     }
     throw NarrowOutOfRange{};
   }
+
+  /// Like narrow(), but for values which are in range by construction, such as indices into containers
+  /// whose size was checked with narrow() before. Checked as an audit contract only, so hot index paths
+  /// pay for neither the check nor the exception in production builds.
+  template <class To, class From>
+  To narrow_cast(From from) noexcept {
+    static_assert(std::is_arithmetic_v<To> && std::is_arithmetic_v<From>, "To and From must be arithmetic types");
+    const auto to_value = static_cast<To>(from);
+    WDP_ASSERT_AUDIT(static_cast<From>(to_value) == from, "narrowing conversion was out of range");
+    return to_value;
+  }
 }
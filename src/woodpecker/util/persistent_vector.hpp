@@ -0,0 +1,179 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <boost/container/static_vector.hpp>
+#include <woodpecker/util/assert.hpp>
+
+namespace wdp {
+  /// A vector with structural sharing: copies share all elements, and are independent values nonetheless.
+  /// The elements are stored in the leaves of a trie with 32 children per node. Copying the vector copies
+  /// the pointer to the root only, and modifying an element copies the nodes on its path which are shared
+  /// with other vectors, so a copy costs memory only for the leaves modified afterwards.
+  /// Nodes which are not shared are modified in place.
+  /// A vector must not be copied while another thread modifies any vector sharing nodes with it.
+  template <class T>
+  class PersistentVector {
+    static constexpr auto bits = 5U;
+    static constexpr auto width = std::size_t{1} << bits;
+    static constexpr auto mask = width - 1;
+
+    struct Node {
+      std::vector<std::shared_ptr<Node>> children;       // of inner nodes
+      boost::container::static_vector<T, width> values;  // of leaves
+    };
+
+  public:
+    class Iterator {
+    public:
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = T;
+      using difference_type = std::ptrdiff_t;
+      using pointer = const T*;
+      using reference = const T&;
+
+      Iterator() = default;
+
+      reference operator*() const noexcept { return leaf_->values[index_ & mask]; }
+      pointer operator->() const noexcept { return &**this; }
+
+      Iterator& operator++() noexcept {
+        ++index_;
+        if ((index_ & mask) == 0 && index_ < vector_->size()) {
+          leaf_ = vector_->leaf(index_);
+        }
+        return *this;
+      }
+      Iterator operator++(int) noexcept {
+        auto copy = *this;
+        ++*this;
+        return copy;
+      }
+
+      bool operator==(const Iterator& other) const noexcept { return index_ == other.index_; }
+
+    private:
+      friend class PersistentVector;
+
+      const PersistentVector* vector_{};
+      std::size_t index_{};
+      const Node* leaf_{};  // the leaf of the current element, cached while iterating through it
+
+      Iterator(const PersistentVector* vector, std::size_t index)
+          : vector_{vector}, index_{index}, leaf_{index < vector->size() ? vector->leaf(index) : nullptr} {}
+    };
+
+    std::size_t size() const noexcept { return size_; }
+    bool empty() const noexcept { return size_ == 0; }
+
+    const T& operator[](std::size_t index) const noexcept {
+      WDP_ASSERT_CHEAP(index < size_);
+      return leaf(index)->values[index & mask];
+    }
+
+    /// The element at an index for modification, first copying the nodes on its path which are shared.
+    T& mutate(std::size_t index) {
+      WDP_ASSERT_CHEAP(index < size_);
+      auto* node = &own(root_);
+      for (auto shift = shift_; shift > 0; shift -= bits) {
+        node = &own(node->children[(index >> shift) & mask]);
+      }
+      return node->values[index & mask];
+    }
+
+    void push_back(T value) {
+      if (!root_) {
+        root_ = std::make_shared<Node>();
+      } else if (size_ == width << shift_) {
+        // full, add a level above the root
+        auto new_root = std::make_shared<Node>();
+        new_root->children.push_back(std::move(root_));
+        root_ = std::move(new_root);
+        shift_ += bits;
+      }
+      auto* node = &own(root_);
+      for (auto shift = shift_; shift > 0; shift -= bits) {
+        const auto slot = (size_ >> shift) & mask;
+        if (slot == node->children.size()) {
+          node->children.push_back(std::make_shared<Node>());
+        }
+        node = &own(node->children[slot]);
+      }
+      node->values.push_back(std::move(value));
+      ++size_;
+    }
+
+    void pop_back() {
+      WDP_ASSERT_CHEAP(size_ > 0);
+      --size_;
+      if (size_ == 0) {
+        root_.reset();
+        shift_ = 0;
+        return;
+      }
+      pop_back(own(root_), shift_);
+      // remove levels above a root with a single child
+      while (shift_ > 0 && root_->children.size() == 1) {
+        root_ = root_->children.front();
+        shift_ -= bits;
+      }
+    }
+
+    Iterator begin() const noexcept { return Iterator{this, 0}; }
+    Iterator end() const noexcept { return Iterator{this, size_}; }
+
+  private:
+    std::shared_ptr<Node> root_;
+    std::size_t size_{};
+    unsigned shift_{};  // the bits of an index resolved by the inner nodes, zero if the root is a leaf
+
+    const Node* leaf(std::size_t index) const noexcept {
+      const auto* node = root_.get();
+      for (auto shift = shift_; shift > 0; shift -= bits) {
+        node = node->children[(index >> shift) & mask].get();
+      }
+      return node;
+    }
+
+    /// A node which is not shared with other vectors, copying it if it is.
+    static Node& own(std::shared_ptr<Node>& node) {
+      if (node.use_count() > 1) {
+        node = std::make_shared<Node>(*node);
+      }
+      return *node;
+    }
+
+    /// Removes the element at index size_ below a node, and the nodes left empty.
+    void pop_back(Node& node, unsigned shift) {
+      if (shift == 0) {
+        node.values.pop_back();
+        return;
+      }
+      auto& child = own(node.children.back());
+      pop_back(child, shift - bits);
+      if (child.children.empty() && child.values.empty()) {
+        node.children.pop_back();
+      }
+    }
+  };
+}
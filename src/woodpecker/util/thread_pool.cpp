@@ -0,0 +1,123 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "thread_pool.hpp"
+
+namespace wdp {
+  namespace {
+    /// The index of the queue owned by the current thread in its pool, if it is a worker.
+    thread_local std::optional<std::size_t> current_worker_index;
+    thread_local const ThreadPool* current_worker_pool = nullptr;
+  }
+
+  ThreadPool::ThreadPool(std::size_t thread_count) {
+    thread_count = std::max(thread_count, std::size_t{1});
+    for (auto i = std::size_t{0}; i < thread_count; ++i) {
+      queues_.push_back(std::make_unique<Queue>());
+    }
+    workers_.reserve(thread_count - 1);
+    for (auto i = std::size_t{0}; i + 1 < thread_count; ++i) {
+      workers_.emplace_back([this, i] { run_worker(i); });
+    }
+  }
+
+  ThreadPool::~ThreadPool() {
+    {
+      const auto lock = std::scoped_lock{wake_mutex_};
+      stopping_ = true;
+    }
+    wake_.notify_all();
+    workers_.clear();  // joins
+  }
+
+  ThreadPool& ThreadPool::global() {
+    static auto pool = ThreadPool{};
+    return pool;
+  }
+
+  void ThreadPool::push(Task task) {
+    // workers push to their own queue, other threads distribute round robin
+    const auto queue_index = (current_worker_pool == this && current_worker_index)
+                                 ? *current_worker_index
+                                 : next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+    // count the task before it can be popped, so that the count never drops below zero
+    {
+      const auto lock = std::scoped_lock{wake_mutex_};
+      queued_count_.fetch_add(1, std::memory_order_release);
+    }
+    {
+      auto& queue = *queues_[queue_index];
+      const auto lock = std::scoped_lock{queue.mutex};
+      queue.tasks.push_back(std::move(task));
+    }
+    wake_.notify_one();
+  }
+
+  std::optional<ThreadPool::Task> ThreadPool::pop(std::size_t queue_index) {
+    // own queue first, newest task, which is likely still hot in cache
+    {
+      auto& queue = *queues_[queue_index];
+      const auto lock = std::scoped_lock{queue.mutex};
+      if (!queue.tasks.empty()) {
+        auto task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        queued_count_.fetch_sub(1, std::memory_order_acq_rel);
+        return task;
+      }
+    }
+    // steal oldest task from the others
+    for (auto offset = std::size_t{1}; offset < queues_.size(); ++offset) {
+      auto& queue = *queues_[(queue_index + offset) % queues_.size()];
+      const auto lock = std::scoped_lock{queue.mutex};
+      if (!queue.tasks.empty()) {
+        auto task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        queued_count_.fetch_sub(1, std::memory_order_acq_rel);
+        return task;
+      }
+    }
+    return std::nullopt;
+  }
+
+  void ThreadPool::wait_helping(const LoopState& state) {
+    const auto queue_index = (current_worker_pool == this && current_worker_index) ? *current_worker_index
+                                                                                    : queues_.size() - 1;
+    while (state.remaining.load(std::memory_order_acquire) > 0) {
+      if (auto task = pop(queue_index)) {
+        (*task)();
+      } else {
+        std::this_thread::yield();  // remaining tasks are running on other threads
+      }
+    }
+  }
+
+  void ThreadPool::run_worker(std::size_t worker_index) {
+    current_worker_index = worker_index;
+    current_worker_pool = this;
+    while (true) {
+      if (auto task = pop(worker_index)) {
+        (*task)();
+        continue;
+      }
+      auto lock = std::unique_lock{wake_mutex_};
+      wake_.wait(lock, [&] { return stopping_ || queued_count_.load(std::memory_order_acquire) > 0; });
+      if (stopping_ && queued_count_.load(std::memory_order_acquire) == 0) {
+        return;
+      }
+    }
+  }
+}
@@ -0,0 +1,129 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace wdp {
+  /// A pool of worker threads, each with its own task queue.
+  /// Workers take tasks from the back of their own queue, and steal from the front of the others when idle.
+  /// Threads waiting for their tasks to finish help executing tasks, so parallel loops may be nested.
+  class ThreadPool {
+  public:
+    /// Starts the worker threads.
+    /// \param thread_count The number of threads, including the calling thread which helps while waiting.
+    explicit ThreadPool(std::size_t thread_count = std::max(std::thread::hardware_concurrency(), 1U));
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /// Stops the worker threads after the queued tasks are done.
+    ~ThreadPool();
+
+    /// The number of threads working on tasks, including the calling thread.
+    std::size_t thread_count() const noexcept { return queues_.size(); }
+
+    /// Calls `func(i)` for each `i` in `[begin, end)`, in chunks of at most `grain_size` indices per task.
+    /// Blocks until all calls have returned. The first exception thrown by `func` is rethrown.
+    template <class Func>
+    void parallel_for(std::size_t begin, std::size_t end, std::size_t grain_size, const Func& func) {
+      if (begin >= end) {
+        return;
+      }
+      grain_size = std::max(grain_size, std::size_t{1});
+      if (end - begin <= grain_size) {
+        for (auto i = begin; i < end; ++i) {
+          func(i);
+        }
+        return;
+      }
+
+      auto state = LoopState{};
+      state.remaining = (end - begin + grain_size - 1) / grain_size;
+      for (auto chunk_begin = begin; chunk_begin < end; chunk_begin += grain_size) {
+        const auto chunk_end = std::min(chunk_begin + grain_size, end);
+        push([&state, &func, chunk_begin, chunk_end] {
+          try {
+            if (!state.failed.load(std::memory_order_relaxed)) {
+              for (auto i = chunk_begin; i < chunk_end; ++i) {
+                func(i);
+              }
+            }
+          } catch (...) {
+            state.fail(std::current_exception());
+          }
+          state.remaining.fetch_sub(1, std::memory_order_acq_rel);
+        });
+      }
+      wait_helping(state);
+      if (state.exception) {
+        std::rethrow_exception(state.exception);
+      }
+    }
+
+    /// The pool shared by the whole process, created on first use.
+    static ThreadPool& global();
+
+  private:
+    using Task = std::function<void()>;
+
+    struct Queue {
+      std::mutex mutex;
+      std::deque<Task> tasks;
+    };
+
+    struct LoopState {
+      std::atomic<std::size_t> remaining{};
+      std::atomic<bool> failed{};
+      std::mutex exception_mutex;
+      std::exception_ptr exception;
+
+      void fail(std::exception_ptr ex) {
+        const auto lock = std::scoped_lock{exception_mutex};
+        if (!exception) {
+          exception = std::move(ex);
+        }
+        failed = true;
+      }
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues_;  // one per worker, the last one for outside threads
+    std::vector<std::jthread> workers_;
+    std::atomic<std::size_t> next_queue_{};
+    std::atomic<std::size_t> queued_count_{};
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    bool stopping_{};
+
+    void push(Task task);
+    std::optional<Task> pop(std::size_t queue_index);
+    void wait_helping(const LoopState& state);
+    void run_worker(std::size_t worker_index);
+  };
+}
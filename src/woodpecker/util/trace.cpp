@@ -0,0 +1,191 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+#include "trace.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+
+#include <fmt/format.h>
+#include <fmt/ostream.h>
+
+namespace wdp::trace {
+  namespace {
+    constexpr auto ring_capacity = std::size_t{1} << 15;
+
+    /// A slot of a ring buffer, with atomic fields, as a reader may copy it while the owning thread overwrites it.
+    struct Slot {
+      std::atomic<const char*> name{};
+      std::atomic<std::int64_t> begin_ns{};
+      std::atomic<std::int64_t> end_ns{};
+    };
+
+    /// The events of one thread, written only by that thread.
+    /// Readers detect slots overwritten while copying them by the writing sequence, as in a seqlock.
+    struct RingBuffer {
+      std::uint32_t thread_id{};
+      std::atomic<std::uint64_t> head{};     // the number of events ever recorded
+      std::atomic<std::uint64_t> writing{};  // the number of events whose recording has begun
+      std::array<Slot, ring_capacity> slots;
+    };
+
+    /// The ring buffers of all threads which ever recorded an event.
+    /// Buffers outlive their threads, so the events of finished threads can still be collected.
+    struct Registry {
+      std::mutex mutex;
+      std::vector<std::shared_ptr<RingBuffer>> buffers;
+
+      static Registry& instance() {
+        static auto registry = Registry{};
+        return registry;
+      }
+    };
+
+    RingBuffer& thread_buffer() {
+      thread_local const auto buffer = [] {
+        auto& registry = Registry::instance();
+        const auto lock = std::scoped_lock{registry.mutex};
+        auto new_buffer = std::make_shared<RingBuffer>();
+        new_buffer->thread_id = static_cast<std::uint32_t>(registry.buffers.size());
+        registry.buffers.push_back(new_buffer);
+        return new_buffer;
+      }();
+      return *buffer;
+    }
+
+    /// Copies the events of a ring buffer which ended at or after a time,
+    /// dropping those which may have been overwritten while copying.
+    void copy_events(const RingBuffer& buffer, std::int64_t since_ns, std::vector<Event>& events) {
+      const auto head = buffer.head.load(std::memory_order_acquire);
+      const auto first_size = events.size();
+      // events are recorded as they end, so those which ended since are the newest ones
+      auto first_copied = head;
+      while (first_copied > head - std::min<std::uint64_t>(head, ring_capacity) &&
+             buffer.slots[(first_copied - 1) % ring_capacity].end_ns.load(std::memory_order_relaxed) >= since_ns) {
+        --first_copied;
+      }
+      for (auto idx = first_copied; idx < head; ++idx) {
+        const auto& slot = buffer.slots[idx % ring_capacity];
+        events.push_back({slot.name.load(std::memory_order_relaxed), slot.begin_ns.load(std::memory_order_relaxed),
+                          slot.end_ns.load(std::memory_order_relaxed), buffer.thread_id});
+      }
+
+      // any slot copied from a recording which began while copying is seen by the writing sequence after the fence,
+      // which pairs with the one in record()
+      std::atomic_thread_fence(std::memory_order_acquire);
+      const auto writing = buffer.writing.load(std::memory_order_relaxed);
+      const auto first_valid = writing - std::min<std::uint64_t>(writing, ring_capacity);
+      if (first_valid > first_copied) {
+        const auto overwritten = std::min<std::uint64_t>(first_valid - first_copied, head - first_copied);
+        events.erase(events.begin() + static_cast<std::ptrdiff_t>(first_size),
+                     events.begin() + static_cast<std::ptrdiff_t>(first_size + overwritten));
+      }
+    }
+
+    /// The ring buffers of all threads which ever recorded an event.
+    std::vector<std::shared_ptr<RingBuffer>> all_buffers() {
+      auto& registry = Registry::instance();
+      const auto lock = std::scoped_lock{registry.mutex};
+      return registry.buffers;
+    }
+
+    /// Writes a string as a JSON string literal.
+    void write_json_string(std::ostream& out, std::string_view str) {
+      out.put('"');
+      for (const auto chr : str) {
+        if (chr == '"' || chr == '\\') {
+          out.put('\\').put(chr);
+        } else if (static_cast<unsigned char>(chr) < 0x20) {
+          fmt::print(out, "\\u{:04x}", static_cast<unsigned>(chr));
+        } else {
+          out.put(chr);
+        }
+      }
+      out.put('"');
+    }
+  }
+
+  std::int64_t now_ns() noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  void record(const char* name, std::int64_t begin_ns, std::int64_t end_ns) noexcept {
+    auto& buffer = thread_buffer();
+    const auto head = buffer.head.load(std::memory_order_relaxed);
+    // announce the overwrite before any store to the slot can become visible
+    buffer.writing.store(head + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    auto& slot = buffer.slots[head % ring_capacity];
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.begin_ns.store(begin_ns, std::memory_order_relaxed);
+    slot.end_ns.store(end_ns, std::memory_order_relaxed);
+    buffer.head.store(head + 1, std::memory_order_release);
+  }
+
+  std::vector<Event> collect_events() {
+    auto events = std::vector<Event>{};
+    for (const auto& buffer : all_buffers()) {
+      copy_events(*buffer, std::numeric_limits<std::int64_t>::min(), events);
+    }
+    std::ranges::stable_sort(events, {}, &Event::begin_ns);
+    return events;
+  }
+
+  std::vector<ScopeTotal> summarize_events(std::int64_t since_ns) {
+    auto totals = std::vector<ScopeTotal>{};
+    auto name_totals = std::unordered_map<std::string_view, std::size_t>{};
+    auto events = std::vector<Event>{};
+    for (const auto& buffer : all_buffers()) {
+      copy_events(*buffer, since_ns, events);
+    }
+    for (const auto& event : events) {
+      const auto [it, inserted] = name_totals.try_emplace(event.name, totals.size());
+      if (inserted) {
+        totals.push_back({event.name});
+      }
+      auto& total = totals[it->second];
+      total.duration_ns += event.end_ns - event.begin_ns;
+      ++total.count;
+    }
+    std::ranges::sort(totals, std::ranges::greater{}, &ScopeTotal::duration_ns);
+    return totals;
+  }
+
+  void write_chrome_trace(std::ostream& out) {
+    const auto events = collect_events();
+    const auto origin_ns = events.empty() ? 0 : events.front().begin_ns;
+
+    // complete events with timestamps in microseconds, relative to the first event
+    out << R"({"displayTimeUnit":"ms","traceEvents":[)";
+    auto first = true;
+    for (const auto& event : events) {
+      out << (first ? "\n" : ",\n") << R"({"ph":"X","pid":1,"tid":)" << event.thread_id << R"(,"name":)";
+      write_json_string(out, event.name);
+      fmt::print(out, R"(,"ts":{:.3f},"dur":{:.3f}}})", static_cast<double>(event.begin_ns - origin_ns) / 1e3,
+                 static_cast<double>(event.end_ns - event.begin_ns) / 1e3);
+      first = false;
+    }
+    out << "\n]}\n";
+  }
+}
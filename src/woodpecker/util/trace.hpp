@@ -0,0 +1,95 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string_view>
+#include <vector>
+
+#ifndef WDP_ENABLE_TRACING
+#define WDP_ENABLE_TRACING 0
+#endif
+
+namespace wdp::trace {
+  /// Whether scopes are recorded, as set by the WOODPECKER_ENABLE_TRACING CMake option.
+  /// When disabled, WDP_TRACE_SCOPE expands to nothing and no event is ever recorded.
+  inline constexpr bool enabled = WDP_ENABLE_TRACING != 0;
+
+  /// A timed scope which ended on some thread.
+  struct Event {
+    std::string_view name;
+    std::int64_t begin_ns{};  ///< On the clock of now_ns().
+    std::int64_t end_ns{};
+    std::uint32_t thread_id{};  ///< Numbered in the order in which threads recorded their first event.
+  };
+
+  /// The total time spent in all scopes of the same name.
+  struct ScopeTotal {
+    std::string_view name;
+    std::int64_t duration_ns{};
+    std::size_t count{};
+  };
+
+  /// The current time of a monotonic clock in nanoseconds.
+  std::int64_t now_ns() noexcept;
+
+  /// Appends an event to the ring buffer of the calling thread, overwriting its oldest event when full.
+  /// The buffer is lock-free, so recording never waits for other threads or for a reader.
+  /// \param name A string with static storage duration, such as a literal.
+  /// \param end_ns Not before the end of the previous event of the thread, as events are kept in the order they end.
+  void record(const char* name, std::int64_t begin_ns, std::int64_t end_ns) noexcept;
+
+  /// Copies the events in the ring buffers of all threads, sorted by their begin.
+  /// Can be called while other threads record events, which may then be missing from the copy.
+  std::vector<Event> collect_events();
+
+  /// Sums the durations of the events which ended at or after the given time, by name.
+  /// Takes time proportional to the number of these events rather than of all events in the ring buffers,
+  /// so it is cheap enough to summarize each frame.
+  /// \return The totals in descending order of duration.
+  std::vector<ScopeTotal> summarize_events(std::int64_t since_ns);
+
+  /// Writes all events in the JSON trace event format, which is read by chrome://tracing and Perfetto.
+  void write_chrome_trace(std::ostream& out);
+
+  /// Records the time between its construction and destruction as an event, see WDP_TRACE_SCOPE.
+  class Scope {
+  public:
+    explicit Scope(const char* name) noexcept : name_{name}, begin_ns_{now_ns()} {}
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+    ~Scope() { record(name_, begin_ns_, now_ns()); }
+
+  private:
+    const char* name_;
+    std::int64_t begin_ns_;
+  };
+}
+
+#define WDP_TRACE_CONCAT_IMPL(a__, b__) a__##b__
+#define WDP_TRACE_CONCAT(a__, b__) WDP_TRACE_CONCAT_IMPL(a__, b__)
+
+#if WDP_ENABLE_TRACING
+/// Traces the rest of the enclosing block under a name, which must be a string literal.
+#define WDP_TRACE_SCOPE(name__) const ::wdp::trace::Scope WDP_TRACE_CONCAT(wdp_trace_scope_, __LINE__){name__}
+#else
+#define WDP_TRACE_SCOPE(name__) static_cast<void>(0)
+#endif
@@ -0,0 +1,47 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "vertex_grid.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace wdp {
+  void VertexGrid::insert(const kln::point& pos, VertexIndex index) {
+    cells_[cell_of(pos)].push_back(index);
+    ++size_;
+  }
+
+  std::size_t VertexGrid::CellKeyHash::operator()(const CellKey& key) const noexcept {
+    // combine the coordinates with large odd multipliers, as in spatial hashing literature
+    const auto hash = static_cast<std::uint64_t>(key[0]) * 73856093U ^ static_cast<std::uint64_t>(key[1]) * 19349663U ^
+                      static_cast<std::uint64_t>(key[2]) * 83492791U;
+    return std::hash<std::uint64_t>{}(hash);
+  }
+
+  VertexGrid::CellKey VertexGrid::cell_of(const kln::point& pos) const noexcept {
+    const auto cell_coord = [&](float coord) {
+      // clamped before the conversion, which is undefined for NaN and values out of range,
+      // and far enough within the range for the neighbour cells, see for_each_near_cell()
+      constexpr auto limit = static_cast<float>(std::int64_t{1} << 62);
+      const auto cell = std::floor(coord * inv_cell_size_);
+      return static_cast<std::int64_t>(cell > -limit ? std::min(cell, limit) : -limit);
+    };
+    return {cell_coord(pos.x()), cell_coord(pos.y()), cell_coord(pos.z())};
+  }
+}
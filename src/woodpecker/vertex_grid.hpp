@@ -0,0 +1,109 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+
+#include <boost/container/small_vector.hpp>
+#include <woodpecker/vertex.hpp>
+
+namespace wdp {
+  /// A uniform grid hashing vertex indices by the cell their position falls into.
+  /// A lookup visits the 2x2x2 block of cells closest to the query position, which covers
+  /// every position within half a cell size, so welding stays correct across cell borders.
+  class VertexGrid {
+  public:
+    /// The integer coordinates of a cell.
+    using CellKey = std::array<std::int64_t, 3>;
+
+    /// \param cell_size The edge length of a cell, must be at least twice the search radius.
+    explicit VertexGrid(float cell_size) noexcept : inv_cell_size_{1 / cell_size} {}
+
+    /// Inserts the index of a vertex at a normalized position.
+    void insert(const kln::point& pos, VertexIndex index);
+
+    /// Removes all vertex indices from the grid.
+    void clear() noexcept {
+      cells_.clear();
+      size_ = 0;
+    }
+
+    /// The number of vertex indices inserted into the grid.
+    std::size_t size() const noexcept { return size_; }
+
+    /// Finds a vertex near a normalized position.
+    /// \param is_match Predicate deciding whether the vertex at the given index is close enough.
+    /// \return The smallest index which satisfies the predicate, if any.
+    template <class Predicate>
+    std::optional<VertexIndex> find(const kln::point& pos, const Predicate& is_match) const {
+      auto found = std::optional<VertexIndex>{};
+      for_each_near_cell(pos, [&](const CellKey& key) {
+        const auto iter = cells_.find(key);
+        if (iter == cells_.end()) {
+          return;
+        }
+        for (const auto index : iter->second) {
+          if ((!found || index < *found) && is_match(index)) {
+            found = index;
+          }
+        }
+      });
+      return found;
+    }
+
+    /// The cell a normalized position falls into.
+    /// Coordinates beyond the range of cells, infinite or NaN fall into cells at its border.
+    CellKey cell_of(const kln::point& pos) const noexcept;
+
+    /// Calls the visitor with the keys of the 2x2x2 block of cells closest to a normalized position.
+    template <class Visitor>
+    void for_each_near_cell(const kln::point& pos, const Visitor& visit) const {
+      // per axis, step towards the neighbour cell the position is closer to
+      const auto cell = cell_of(pos);
+      const auto scaled = std::array{pos.x() * inv_cell_size_, pos.y() * inv_cell_size_, pos.z() * inv_cell_size_};
+      auto step = CellKey{};
+      for (auto axis = std::size_t{0}; axis < 3; ++axis) {
+        const auto frac = static_cast<double>(scaled[axis]) - static_cast<double>(cell[axis]);
+        step[axis] = frac < 0.5 ? -1 : 1;
+      }
+      for (auto corner = 0; corner < 8; ++corner) {
+        auto key = cell;
+        for (auto axis = std::size_t{0}; axis < 3; ++axis) {
+          if ((corner >> axis) & 1) {
+            key[axis] += step[axis];
+          }
+        }
+        visit(key);
+      }
+    }
+
+    /// Hashes cell keys for unordered containers.
+    struct CellKeyHash {
+      std::size_t operator()(const CellKey& key) const noexcept;
+    };
+
+  private:
+    float inv_cell_size_;
+    std::unordered_map<CellKey, boost::container::small_vector<VertexIndex, 1>, CellKeyHash> cells_;
+    std::size_t size_{};
+  };
+}
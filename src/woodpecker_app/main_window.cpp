@@ -17,19 +17,35 @@
 
 #include "main_window.hpp"
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <fstream>
+#include <span>
+#include <utility>
+
 #include <QAction>
 #include <QApplication>
 #include <QDockWidget>
+#include <QFileDialog>
 #include <QLabel>
 #include <QMenuBar>
+#include <QMessageBox>
 #include <QStatusBar>
+#include <QTimer>
+#include <QtMath>
 #include <Qt3DExtras/QForwardRenderer>
 #include <Qt3DExtras/QGoochMaterial>
 #include <Qt3DExtras/QOrbitCameraController>
 #include <Qt3DExtras/QPlaneMesh>
 #include <Qt3DRender/QCamera>
-#include <Qt3DRender/QGeometryRenderer>
 #include <woodpecker/config.hpp>
+#include <woodpecker/mesh_export.hpp>
+#include <woodpecker/mesh_import.hpp>
+#include <woodpecker/mesh_validation.hpp>
+#include <woodpecker/scene_file.hpp>
+#include <woodpecker/util/thread_pool.hpp>
+#include <woodpecker/util/trace.hpp>
 
 #include "matcap_material.hpp"
 #include "util/qt.hpp"
@@ -41,40 +57,23 @@ using namespace Qt3DCore;
 namespace {
   using namespace wdp;
 
+  const auto scene_file_filter = QStringLiteral("Woodpecker scene (*.wdp)");
+  const auto mesh_file_filter = QStringLiteral("Mesh (*.stl *.obj *.ply)");
+  const auto stl_file_filter = QStringLiteral("STL (*.stl)");
+  const auto three_mf_file_filter = QStringLiteral("3MF (*.3mf)");
+  const auto trace_file_filter = QStringLiteral("Chrome trace (*.json)");
+
+  /// The number of the longest traced scopes shown in the status bar.
+  constexpr auto shown_scope_count = std::size_t{4};
+
   Scene load_example() {
     auto scene = Scene{};
     auto mesh = Mesh::create_cuboid(1, 1, 1);
-    auto part = Part{mesh};
-    part.set_motor(kln::motor{kln::translator{2, 0, 1, 0}});
-    scene.add_part(part);
+    const auto part_id = scene.add_part(Part{mesh});
+    scene.move_part(part_id, kln::motor{kln::translator{2, 0, 1, 0}});
+    scene.update_motors();
     return scene;
   }
-
-  QGeometryRenderer* wdp_mesh_to_qt_geo(const Mesh& mesh) {
-    // vertices
-    auto* vertex_buffer = new QBuffer{};
-    vertex_buffer->setData(app::qbyte_array_from_vector(mesh.vertices()));
-    auto* vertex_attr = new QAttribute{vertex_buffer, QAttribute::defaultPositionAttributeName(), QAttribute::Float, 4,
-                                       narrow<uint>(mesh.vertices().size())};
-    vertex_attr->setAttributeType(QAttribute::VertexAttribute);
-
-    // indices
-    const auto triangle_indices = mesh.triangulate();
-    auto* index_buffer = new QBuffer{};
-    index_buffer->setData(app::qbyte_array_from_vector(triangle_indices));
-    auto* index_attr = new QAttribute{index_buffer, QAttribute::defaultPositionAttributeName(), QAttribute::UnsignedInt,
-                                      1, narrow<uint>(triangle_indices.size() * 3)};
-    index_attr->setAttributeType(QAttribute::IndexAttribute);
-
-    // geometry and renderer
-    auto* geometry = new QGeometry{};
-    geometry->addAttribute(vertex_attr);
-    geometry->addAttribute(index_attr);
-    auto* geometry_renderer = new QGeometryRenderer{};
-    geometry_renderer->setGeometry(geometry);
-
-    return geometry_renderer;
-  }
 }
 
 namespace wdp::app {
@@ -99,12 +98,16 @@ namespace wdp::app {
     scene_root_ = new QEntity{view_root_};
     setup_ground_plane();
     part_material_ = new MatCapMaterial{};
+    part_material_->setParent(view_root_);  // outlives the scene entities
+    scene_sync_.emplace(scene_root_, part_material_);
 
     // setup camera
     view_->camera()->setPosition({-4, 2, -4});
     view_->camera()->setViewCenter({0, 0, 0});
     auto* camera_ctrl = new QOrbitCameraController{view_root_};
     camera_ctrl->setCamera(view_->camera());
+    connect(view_->camera(), &QCamera::viewMatrixChanged, this, &MainWindow::schedule_camera_update);
+    connect(view_->camera(), &QCamera::projectionMatrixChanged, this, &MainWindow::schedule_camera_update);
 
     // load example scene
     scene_ = load_example();
@@ -114,16 +117,46 @@ namespace wdp::app {
   void MainWindow::setup_menu_bar() {
     auto* file = menuBar()->addMenu("File");
     file->addAction("New...");
-    file->addAction("Open...");
+    auto* open_act = file->addAction("Open...");
+    open_act->setShortcut(QKeySequence::Open);
+    connect(open_act, &QAction::triggered, this, &MainWindow::open_file);
+    auto* import_act = file->addAction("Import mesh...");
+    connect(import_act, &QAction::triggered, this, &MainWindow::import_file);
     file->addSeparator();
-    file->addAction("Save");
-    file->addAction("Save as...");
+    auto* save_act = file->addAction("Save");
+    save_act->setShortcut(QKeySequence::Save);
+    connect(save_act, &QAction::triggered, this, &MainWindow::save_file);
+    auto* save_as_act = file->addAction("Save as...");
+    save_as_act->setShortcut(QKeySequence::SaveAs);
+    connect(save_as_act, &QAction::triggered, this, &MainWindow::save_file_as);
+    auto* export_act = file->addAction("Export...");
+    connect(export_act, &QAction::triggered, this, &MainWindow::export_file);
     file->addSeparator();
     auto* exit_act = file->addAction("Exit");
     connect(exit_act, &QAction::triggered, QApplication::instance(), &QApplication::quit, Qt::QueuedConnection);
+
+    auto* edit = menuBar()->addMenu("Edit");
+    undo_act_ = edit->addAction("Undo");
+    undo_act_->setShortcut(QKeySequence::Undo);
+    connect(undo_act_, &QAction::triggered, this, &MainWindow::undo);
+    redo_act_ = edit->addAction("Redo");
+    redo_act_->setShortcut(QKeySequence::Redo);
+    connect(redo_act_, &QAction::triggered, this, &MainWindow::redo);
+
+    if constexpr (trace::enabled) {
+      auto* debug = menuBar()->addMenu("Debug");
+      auto* save_trace_act = debug->addAction("Save trace...");
+      connect(save_trace_act, &QAction::triggered, this, &MainWindow::save_trace);
+    }
   }
 
-  void MainWindow::setup_status_bar() { statusBar()->addWidget(new QLabel{"Ready"}); }
+  void MainWindow::setup_status_bar() {
+    statusBar()->addWidget(new QLabel{"Ready"});
+    if constexpr (trace::enabled) {
+      frame_timings_label_ = new QLabel{};
+      statusBar()->addPermanentWidget(frame_timings_label_);
+    }
+  }
 
   void MainWindow::setup_side_bar() {
     auto* outline = new QDockWidget{"Outline", this};
@@ -147,25 +180,168 @@ namespace wdp::app {
   }
 
   void MainWindow::update_view() {
-    // clear scene
+    WDP_TRACE_SCOPE("MainWindow::update_view");
+    const auto begin_ns = trace::now_ns();
+
+    // move the subtrees of moved parts
+    scene_.update_motors();
+
+    // triangulate all parts up front, in parallel
+    scene_.triangulate(ThreadPool::global());
+
+    // only touch the entities of parts which changed since the last update
+    scene_sync_->sync(scene_, camera_view());
+
+    undo_act_->setEnabled(history_.can_undo());
+    redo_act_->setEnabled(history_.can_redo());
+
+    if constexpr (trace::enabled) {
+      show_frame_timings(begin_ns);
+    }
+  }
+
+  void MainWindow::schedule_camera_update() {
+    // the camera controller changes several camera properties per frame, which are applied at once
+    if (camera_update_pending_) {
+      return;
+    }
+    camera_update_pending_ = true;
+    QTimer::singleShot(0, this, [this] {
+      camera_update_pending_ = false;
+      WDP_TRACE_SCOPE("MainWindow::update_camera");
+      scene_sync_->sync(scene_, camera_view());
+    });
+  }
+
+  CameraView MainWindow::camera_view() const {
+    const auto* camera = view_->camera();
+    const auto view_projection = camera->projectionMatrix() * camera->viewMatrix();
+    auto matrix = std::array<float, 16>{};
+    std::copy_n(view_projection.constData(), matrix.size(), matrix.begin());
+    const auto eye = camera->position();
+    const auto tan_half_fov = std::tan(qDegreesToRadians(camera->fieldOfView()) / 2);
+    return {.frustum = Frustum::from_matrix(matrix),
+            .eye = {eye.x(), eye.y(), eye.z()},
+            .pixels_per_unit = static_cast<float>(view_->height()) / (2 * tan_half_fov)};
+  }
+
+  void MainWindow::show_frame_timings(std::int64_t begin_ns) {
+    const auto to_ms = [](std::int64_t duration_ns) { return static_cast<double>(duration_ns) / 1e6; };
+    auto text = QStringLiteral("update %1 ms").arg(to_ms(trace::now_ns() - begin_ns), 0, 'f', 2);
+    const auto totals = trace::summarize_events(begin_ns);
+    for (const auto& total : std::span{totals}.first(std::min(totals.size(), shown_scope_count))) {
+      text += QStringLiteral(" | %1 %2 ms").arg(qstring_from_sv(total.name)).arg(to_ms(total.duration_ns), 0, 'f', 2);
+    }
+    frame_timings_label_->setText(text);
+  }
+
+  void MainWindow::set_scene(Scene scene) {
+    scene_ = std::move(scene);
+    history_.clear();
+
+    // part identifiers start over in the new scene, so its entities are built from scratch
     delete scene_root_;
     scene_root_ = new QEntity{view_root_};
+    scene_sync_.emplace(scene_root_, part_material_);
+    update_view();
+  }
+
+  bool MainWindow::write_file(const QString& path) {
+    try {
+      save_scene(scene_, fs_path_from_qstring(path));
+      return true;
+    } catch (const SceneFileError& e) {
+      QMessageBox::critical(this, "Save", QString::fromUtf8(e.what()));
+      return false;
+    }
+  }
+
+  void MainWindow::open_file() {
+    const auto path = QFileDialog::getOpenFileName(this, "Open", {}, scene_file_filter);
+    if (path.isEmpty()) {
+      return;
+    }
+    try {
+      set_scene(load_scene(fs_path_from_qstring(path)));
+      file_path_ = path;
+    } catch (const SceneFileError& e) {
+      QMessageBox::critical(this, "Open", QString::fromUtf8(e.what()));
+    }
+  }
+
+  void MainWindow::import_file() {
+    const auto path = QFileDialog::getOpenFileName(this, "Import mesh", {}, mesh_file_filter);
+    if (path.isEmpty()) {
+      return;
+    }
+    try {
+      auto mesh = import_mesh(fs_path_from_qstring(path), ThreadPool::global());
+      const auto repair_report = repair_mesh(mesh);
+      history_.record(scene_);
+      scene_.add_part(Part{std::move(mesh)});
+      update_view();
+      if (!repair_report.found.empty()) {
+        statusBar()->showMessage(QStringLiteral("Repaired %1 mesh issues, %2 left")
+                                     .arg(repair_report.found.size())
+                                     .arg(repair_report.remaining.size()));
+      }
+    } catch (const MeshImportError& e) {
+      QMessageBox::critical(this, "Import mesh", QString::fromUtf8(e.what()));
+    }
+  }
+
+  void MainWindow::undo() {
+    history_.undo(scene_);
+    update_view();
+  }
+
+  void MainWindow::redo() {
+    history_.redo(scene_);
+    update_view();
+  }
 
-    // add entity for each scene part
-    for (const auto& part : scene_.parts()) {
-      // mesh
-      auto* geo_render = wdp_mesh_to_qt_geo(part.mesh());
-
-      // transform
-      auto* transform = new Qt3DCore::QTransform();
-      const auto tfm_matrix = qmatrix_from_kln_motor(part.motor());
-      transform->setMatrix(tfm_matrix);
-
-      // build entity
-      auto* entity = new QEntity{scene_root_};
-      entity->addComponent(geo_render);
-      entity->addComponent(part_material_);
-      entity->addComponent(transform);
+  void MainWindow::save_file() {
+    if (file_path_.isEmpty()) {
+      save_file_as();
+      return;
+    }
+    write_file(file_path_);
+  }
+
+  void MainWindow::save_file_as() {
+    const auto path = QFileDialog::getSaveFileName(this, "Save as", file_path_, scene_file_filter);
+    if (!path.isEmpty() && write_file(path)) {
+      file_path_ = path;
+    }
+  }
+
+  void MainWindow::export_file() {
+    auto filter = stl_file_filter;
+    const auto path = QFileDialog::getSaveFileName(this, "Export", {}, stl_file_filter + ";;" + three_mf_file_filter,
+                                                   &filter);
+    if (path.isEmpty()) {
+      return;
+    }
+    try {
+      if (filter == three_mf_file_filter) {
+        export_3mf(scene_, fs_path_from_qstring(path), ThreadPool::global());
+      } else {
+        export_stl(scene_, fs_path_from_qstring(path), ThreadPool::global());
+      }
+    } catch (const MeshExportError& e) {
+      QMessageBox::critical(this, "Export", QString::fromUtf8(e.what()));
+    }
+  }
+
+  void MainWindow::save_trace() {
+    const auto path = QFileDialog::getSaveFileName(this, "Save trace", {}, trace_file_filter);
+    if (path.isEmpty()) {
+      return;
+    }
+    auto out = std::ofstream{fs_path_from_qstring(path)};
+    trace::write_chrome_trace(out);
+    if (!out) {
+      QMessageBox::critical(this, "Save trace", QStringLiteral("could not write %1").arg(path));
     }
   }
 }
@@ -17,11 +17,21 @@
 
 #pragma once
 
+#include <cstdint>
+#include <optional>
+
+#include <QAction>
+#include <QLabel>
 #include <QMainWindow>
+#include <QString>
 #include <Qt3DCore/QEntity>
 #include <Qt3DExtras/Qt3DWindow>
 #include <Qt3DRender/QMaterial>
+#include <woodpecker/lod.hpp>
 #include <woodpecker/scene.hpp>
+#include <woodpecker/scene_history.hpp>
+
+#include "scene_sync.hpp"
 
 namespace wdp::app {
   class MainWindow : public QMainWindow {
@@ -38,14 +48,43 @@ namespace wdp::app {
     Qt3DCore::QEntity* view_root_;
     Qt3DCore::QEntity* scene_root_;
     Qt3DRender::QMaterial* part_material_;
+    std::optional<SceneSync> scene_sync_;
     Scene scene_;
+    SceneHistory history_;
+    QAction* undo_act_{};
+    QAction* redo_act_{};
+    QString file_path_;  // of the current scene, empty if it was not saved yet
+    QLabel* frame_timings_label_{};  // only with tracing enabled
+    bool camera_update_pending_{};
 
     void setup_menu_bar();
     void setup_status_bar();
     void setup_side_bar();
     void setup_ground_plane();
 
+    /// Replaces the scene, rebuilding its entities.
+    void set_scene(Scene scene);
+
+    /// Saves the scene, showing an error message on failure.
+    /// \return Whether the scene was saved.
+    bool write_file(const QString& path);
+
+    /// The view of the camera, for culling parts and choosing their levels of detail.
+    CameraView camera_view() const;
+
+    /// Shows the time taken by the scopes traced since the begin of a view update in the status bar.
+    void show_frame_timings(std::int64_t begin_ns);
+
     // slots
     void update_view();
+    void schedule_camera_update();
+    void open_file();
+    void import_file();
+    void undo();
+    void redo();
+    void save_file();
+    void save_file_as();
+    void export_file();
+    void save_trace();
   };
 }
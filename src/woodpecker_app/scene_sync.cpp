@@ -0,0 +1,202 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "scene_sync.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <vector>
+
+#include <Qt3DCore/QGeometry>
+#include <woodpecker/render_mesh.hpp>
+#include <woodpecker/util/cast.hpp>
+#include <woodpecker/util/trace.hpp>
+
+#include "util/qt.hpp"
+
+using namespace Qt3DCore;
+using namespace Qt3DRender;
+
+namespace wdp::app {
+  namespace {
+    constexpr auto matrix_size = 16 * sizeof(float);
+
+    QGeometryRenderer* wdp_mesh_to_qt_geo(const Mesh& mesh, QNode* parent) {
+      WDP_TRACE_SCOPE("wdp_mesh_to_qt_geo");
+      // pack vertices and indices straight into byte arrays, which the buffers share instead of copying
+      const auto size = render_mesh_size(mesh);
+      auto vertex_data = QByteArray{narrow<qsizetype>(size.vertex_count * sizeof(RenderVertex)), Qt::Uninitialized};
+      const auto vertices = std::span{reinterpret_cast<RenderVertex*>(vertex_data.data()), size.vertex_count};
+      auto index_data = QByteArray{};
+      if (size.has_short_indices()) {
+        index_data.resize(narrow<qsizetype>(size.index_count * sizeof(std::uint16_t)));
+        pack_render_mesh(mesh, vertices,
+                         std::span{reinterpret_cast<std::uint16_t*>(index_data.data()), size.index_count});
+      } else {
+        index_data.resize(narrow<qsizetype>(size.index_count * sizeof(std::uint32_t)));
+        pack_render_mesh(mesh, vertices,
+                         std::span{reinterpret_cast<std::uint32_t*>(index_data.data()), size.index_count});
+      }
+
+      auto* geometry = new QGeometry{parent};
+
+      // interleaved vertices
+      const auto vertex_count = narrow<uint>(size.vertex_count);
+      constexpr auto vertex_stride = static_cast<uint>(sizeof(RenderVertex));
+      auto* vertex_buffer = new QBuffer{geometry};
+      vertex_buffer->setData(vertex_data);
+      auto* position_attr = new QAttribute{vertex_buffer, QAttribute::defaultPositionAttributeName(), QAttribute::Float,
+                                           3, vertex_count, offsetof(RenderVertex, position), vertex_stride};
+      position_attr->setAttributeType(QAttribute::VertexAttribute);
+      geometry->addAttribute(position_attr);
+      auto* normal_attr = new QAttribute{vertex_buffer, QAttribute::defaultNormalAttributeName(), QAttribute::Byte, 3,
+                                         vertex_count, offsetof(RenderVertex, normal), vertex_stride};
+      normal_attr->setAttributeType(QAttribute::VertexAttribute);
+      geometry->addAttribute(normal_attr);
+
+      // indices
+      auto* index_buffer = new QBuffer{geometry};
+      index_buffer->setData(index_data);
+      const auto index_type = size.has_short_indices() ? QAttribute::UnsignedShort : QAttribute::UnsignedInt;
+      auto* index_attr = new QAttribute{index_buffer, index_type, 1, narrow<uint>(size.index_count)};
+      index_attr->setAttributeType(QAttribute::IndexAttribute);
+      geometry->addAttribute(index_attr);
+
+      auto* geometry_renderer = new QGeometryRenderer{parent};
+      geometry_renderer->setGeometry(geometry);
+      return geometry_renderer;
+    }
+  }
+
+  SceneSync::SceneSync(QEntity* root, QMaterial* material) : root_{root}, material_{material} {
+    // the material is shared by all mesh entities, so it must not be owned by (and deleted with) one of them
+    if (material_->parent() == nullptr) {
+      material_->setParent(root_);
+    }
+  }
+
+  void SceneSync::sync(const Scene& scene, const CameraView& view, const DetailThresholds& thresholds) {
+    WDP_TRACE_SCOPE("SceneSync::sync");
+
+    // group the visible parts by mesh and drawn level of detail
+    auto mesh_parts = std::unordered_map<const Mesh*, std::array<std::vector<const Part*>, detail_level_count>>{};
+    for (const auto& visible : visible_parts(scene, view, thresholds)) {
+      const auto* part = scene.find_part(visible.part);
+      const auto* mesh = &part->mesh();
+      auto iter = mesh_entities_.find(mesh);
+      if (iter == mesh_entities_.end()) {
+        iter = mesh_entities_.emplace(mesh, MeshEntity{.mesh = part->shared_mesh()}).first;
+      }
+      const auto level = drawn_level(iter->second, visible.level);
+      mesh_parts[mesh][static_cast<std::size_t>(level)].push_back(part);
+    }
+
+    // upload the instances of levels whose parts changed, and delete meshes which are no longer in the scene
+    for (auto iter = mesh_entities_.begin(); iter != mesh_entities_.end();) {
+      auto& mesh_entity = iter->second;
+      const auto parts_iter = mesh_parts.find(iter->first);
+      if (parts_iter == mesh_parts.end() && mesh_entity.mesh.use_count() == 1) {
+        for (auto& level_entity : mesh_entity.levels) {
+          if (level_entity) {
+            delete level_entity->entity;  // deletes its child components as well
+          }
+        }
+        iter = mesh_entities_.erase(iter);
+        continue;
+      }
+
+      for (std::size_t level = 0; level < detail_level_count; ++level) {
+        auto& level_entity = mesh_entity.levels[level];
+        if (!level_entity) {
+          continue;
+        }
+        const auto no_parts = std::vector<const Part*>{};
+        const auto& parts = parts_iter != mesh_parts.end() ? parts_iter->second[level] : no_parts;
+        const auto is_instance = [](const Part* part, const auto& instance) {
+          return part->id() == instance.first && part->motor_revision() == instance.second;
+        };
+        if (std::ranges::equal(parts, level_entity->instances, is_instance)) {
+          continue;
+        }
+
+        auto instance_data = QByteArray{narrow<qsizetype>(parts.size() * matrix_size), Qt::Uninitialized};
+        level_entity->instances.clear();
+        for (std::size_t i = 0; i < parts.size(); ++i) {
+          const auto matrix = qmatrix_from_kln_motor(parts[i]->motor());
+          std::memcpy(instance_data.data() + i * matrix_size, matrix.constData(), matrix_size);
+          level_entity->instances.emplace_back(parts[i]->id(), parts[i]->motor_revision());
+        }
+        level_entity->instance_buffer->setData(instance_data);
+        level_entity->instance_attr->setCount(narrow<uint>(parts.size()));
+        level_entity->renderer->setInstanceCount(narrow<int>(parts.size()));
+      }
+      ++iter;
+    }
+  }
+
+  DetailLevel SceneSync::drawn_level(MeshEntity& mesh_entity, DetailLevel level) {
+    const auto index = static_cast<std::size_t>(level);
+    if (const auto drawn = mesh_entity.drawn_levels[index]) {
+      return *drawn;
+    }
+
+    if (level == DetailLevel::full) {
+      mesh_entity.levels[index] = create_level_entity(*mesh_entity.mesh);
+      mesh_entity.index_counts[index] = render_mesh_size(*mesh_entity.mesh).index_count;
+      mesh_entity.drawn_levels[index] = level;
+      return level;
+    }
+
+    // a coarser level is only worth its own entity if it draws fewer triangles than the next finer one
+    const auto finer = drawn_level(mesh_entity, static_cast<DetailLevel>(index - 1));
+    const auto finer_index_count = mesh_entity.index_counts[static_cast<std::size_t>(finer)];
+    const auto detail_mesh = make_detail_mesh(*mesh_entity.mesh, level);
+    const auto index_count = render_mesh_size(detail_mesh).index_count;
+    if (detail_mesh.face_count() == 0 || index_count >= finer_index_count) {
+      mesh_entity.drawn_levels[index] = finer;
+      return finer;
+    }
+    mesh_entity.levels[index] = create_level_entity(detail_mesh);
+    mesh_entity.index_counts[index] = index_count;
+    mesh_entity.drawn_levels[index] = level;
+    return level;
+  }
+
+  SceneSync::LevelEntity SceneSync::create_level_entity(const Mesh& mesh) {
+    WDP_TRACE_SCOPE("SceneSync::create_level_entity");
+    auto level_entity = LevelEntity{};
+    level_entity.entity = new QEntity{root_};
+    level_entity.renderer = wdp_mesh_to_qt_geo(mesh, level_entity.entity);
+    level_entity.renderer->setInstanceCount(0);
+
+    // per-instance model matrices, column-major as in QMatrix4x4
+    level_entity.instance_buffer = new QBuffer{level_entity.entity};
+    level_entity.instance_attr = new QAttribute{level_entity.instance_buffer, instance_model_attribute_name,
+                                                QAttribute::Float, 16, 0, 0, narrow<uint>(matrix_size)};
+    level_entity.instance_attr->setAttributeType(QAttribute::VertexAttribute);
+    level_entity.instance_attr->setDivisor(1);
+    level_entity.renderer->geometry()->addAttribute(level_entity.instance_attr);
+
+    // build entity
+    level_entity.entity->addComponent(level_entity.renderer);
+    level_entity.entity->addComponent(material_);
+    return level_entity;
+  }
+}
@@ -0,0 +1,79 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <Qt3DCore/QAttribute>
+#include <Qt3DCore/QBuffer>
+#include <Qt3DCore/QEntity>
+#include <Qt3DRender/QGeometryRenderer>
+#include <Qt3DRender/QMaterial>
+#include <woodpecker/lod.hpp>
+#include <woodpecker/scene.hpp>
+
+namespace wdp::app {
+  /// Mirrors the parts of a Scene in view of a camera as Qt3D entities below a root entity.
+  /// There is one entity per distinct mesh and level of detail, drawing all parts sharing them in a single instanced
+  /// draw call, with the part motors as per-instance model matrices. Parts outside of the view frustum or too small
+  /// on screen are not drawn, see visible_parts().
+  /// A sync only touches what changed since the previous one: the geometry of a mesh at a level of detail is built
+  /// and uploaded once, on first use, and only instance buffers whose parts changed are uploaded again.
+  class SceneSync {
+  public:
+    /// The name of the per-instance model matrix attribute, which the vertex shader of the material must read.
+    static constexpr auto instance_model_attribute_name = "instanceModel";
+
+    SceneSync(Qt3DCore::QEntity* root, Qt3DRender::QMaterial* material);
+
+    /// Applies the changes of the scene and the camera since the previous sync.
+    void sync(const Scene& scene, const CameraView& view, const DetailThresholds& thresholds = {});
+
+  private:
+    /// The instances of a mesh at one level of detail.
+    struct LevelEntity {
+      Qt3DCore::QEntity* entity{};
+      Qt3DRender::QGeometryRenderer* renderer{};
+      Qt3DCore::QBuffer* instance_buffer{};
+      Qt3DCore::QAttribute* instance_attr{};
+      std::vector<std::pair<PartId, Revision>> instances;  // uploaded, with the motor revisions of the parts
+    };
+
+    struct MeshEntity {
+      SharedMesh mesh;  // keeps the mesh, and so its address as the key, alive while it is drawn
+      std::array<std::optional<LevelEntity>, detail_level_count> levels;  // created on first use
+      // the level drawn in place of each level, which is a finer one where coarsening would not save faces
+      std::array<std::optional<DetailLevel>, detail_level_count> drawn_levels;
+      std::array<std::size_t, detail_level_count> index_counts{};  // of the render meshes of the drawn levels
+    };
+
+    Qt3DCore::QEntity* root_;
+    Qt3DRender::QMaterial* material_;
+    std::unordered_map<const Mesh*, MeshEntity> mesh_entities_;
+
+    /// The level drawn in place of a level, creating its entity if it is first used.
+    DetailLevel drawn_level(MeshEntity& mesh_entity, DetailLevel level);
+    LevelEntity create_level_entity(const Mesh& mesh);
+  };
+}
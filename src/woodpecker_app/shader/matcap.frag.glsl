@@ -1,8 +1,13 @@
 #version 150 core
 
+in vec3 viewNormal;
+
 out vec3 fragColor;
 
 void main() {
     // TODO: hardcoded wood color
-    fragColor = vec3(0.83, 0.75, 0.68); // CSS: #d4c0af
+    const vec3 woodColor = vec3(0.83, 0.75, 0.68); // CSS: #d4c0af
+    // lit from the camera like a matcap, so faces turning away from the viewer get darker
+    vec3 normal = normalize(viewNormal);
+    fragColor = woodColor * (0.4 + 0.6 * max(normal.z, 0.0));
 }
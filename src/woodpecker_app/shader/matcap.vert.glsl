@@ -0,0 +1,16 @@
+#version 150 core
+
+in vec3 vertexPosition;
+in vec3 vertexNormal;
+in mat4 instanceModel; // per instance, see wdp::app::SceneSync
+
+out vec3 viewNormal;
+
+uniform mat4 viewMatrix;
+uniform mat4 modelViewProjection;
+
+void main() {
+    // the part motors and the camera are rigid, so their rotation parts transform normals as well
+    viewNormal = mat3(viewMatrix) * mat3(instanceModel) * vertexNormal;
+    gl_Position = modelViewProjection * instanceModel * vec4(vertexPosition, 1.0);
+}
@@ -25,6 +25,8 @@ namespace wdp::app {
     return QString::fromUtf8(sv.data(), sv_size);
   }
 
+  std::filesystem::path fs_path_from_qstring(const QString& str) { return std::filesystem::path{str.toStdU16String()}; }
+
   QMatrix4x4 qmatrix_from_kln_motor(const kln::motor& m) {
     const auto kln_mat = m.as_mat4x4();
     auto qmat = QMatrix4x4{};
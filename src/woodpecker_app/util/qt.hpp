@@ -17,6 +17,7 @@
 
 #pragma once
 
+#include <filesystem>
 #include <span>
 #include <string_view>
 #include <vector>
@@ -30,6 +31,8 @@
 namespace wdp::app {
   QString qstring_from_sv(std::string_view sv);
 
+  std::filesystem::path fs_path_from_qstring(const QString& str);
+
   template <class Element>
   QByteArray qbyte_array_from_vector(const std::vector<Element>& vec) {
     const auto span = std::span{vec};
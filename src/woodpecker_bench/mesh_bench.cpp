@@ -0,0 +1,111 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <woodpecker/mesh.hpp>
+
+#include "workloads.hpp"
+
+namespace wdp::bench {
+  namespace {
+    void create_cuboid(benchmark::State& state) {
+      for (auto _ : state) {
+        benchmark::DoNotOptimize(Mesh::create_cuboid(1, 2, 3));
+      }
+    }
+    BENCHMARK(create_cuboid);
+
+    /// Adds each vertex of a grid twice, so half of the lookups find an existing vertex to merge with.
+    void add_vertex(benchmark::State& state) {
+      const auto vertex_count = static_cast<std::size_t>(state.range(0));
+      auto vertices = std::vector<Vertex>{};
+      vertices.reserve(vertex_count);
+      for (auto idx = std::size_t{0}; idx < vertex_count; ++idx) {
+        vertices.push_back({kln::point{static_cast<float>(idx % 64), static_cast<float>(idx / 64 % 64),
+                                       static_cast<float>(idx / (64 * 64))}});
+      }
+      for (auto _ : state) {
+        auto mesh = Mesh{};
+        for (const auto& vtx : vertices) {
+          benchmark::DoNotOptimize(mesh.add_vertex(vtx));
+          benchmark::DoNotOptimize(mesh.add_vertex(vtx));
+        }
+      }
+      state.SetItemsProcessed(state.iterations() * 2 * state.range(0));
+    }
+    BENCHMARK(add_vertex)->RangeMultiplier(8)->Range(64, 1 << 18);
+
+    void add_face_polygon(benchmark::State& state) {
+      const auto vertices = regular_polygon(static_cast<std::size_t>(state.range(0)));
+      for (auto _ : state) {
+        auto mesh = Mesh{};
+        benchmark::DoNotOptimize(mesh.add_face(vertices));
+      }
+      state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK(add_face_polygon)->RangeMultiplier(8)->Range(4, 1 << 15);
+
+    void add_face_cuboids(benchmark::State& state) {
+      const auto faces = cuboid_grid_faces(static_cast<std::size_t>(state.range(0)));
+      for (auto _ : state) {
+        auto mesh = Mesh{};
+        for (const auto& face : faces) {
+          benchmark::DoNotOptimize(mesh.add_face(face));
+        }
+      }
+      state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(faces.size()));
+    }
+    BENCHMARK(add_face_cuboids)->RangeMultiplier(8)->Range(8, 1 << 14);
+
+    void triangulate_polygon(benchmark::State& state, std::vector<Vertex> (*polygon)(std::size_t),
+                             TriangulationMethod method) {
+      const auto mesh = polygon_mesh(polygon(static_cast<std::size_t>(state.range(0))));
+      for (auto _ : state) {
+        benchmark::DoNotOptimize(mesh.triangulate(method));
+      }
+      state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(mesh.vertices().size()));
+    }
+    BENCHMARK_CAPTURE(triangulate_polygon, regular_monotone, &regular_polygon, TriangulationMethod::monotone)
+        ->RangeMultiplier(8)
+        ->Range(8, 1 << 15);
+    BENCHMARK_CAPTURE(triangulate_polygon, star_monotone, &star_polygon, TriangulationMethod::monotone)
+        ->RangeMultiplier(8)
+        ->Range(8, 1 << 15);
+    BENCHMARK_CAPTURE(triangulate_polygon, degenerate_monotone, &degenerate_polygon, TriangulationMethod::monotone)
+        ->RangeMultiplier(8)
+        ->Range(8, 1 << 15);
+    // ear clipping takes cubic time, so it is only measured on small polygons
+    BENCHMARK_CAPTURE(triangulate_polygon, regular_ear_clipping, &regular_polygon, TriangulationMethod::ear_clipping)
+        ->RangeMultiplier(8)
+        ->Range(8, 512);
+    BENCHMARK_CAPTURE(triangulate_polygon, star_ear_clipping, &star_polygon, TriangulationMethod::ear_clipping)
+        ->RangeMultiplier(8)
+        ->Range(8, 256);
+
+    void triangulate_cuboids(benchmark::State& state) {
+      const auto mesh = cuboid_grid(static_cast<std::size_t>(state.range(0)));
+      for (auto _ : state) {
+        benchmark::DoNotOptimize(mesh.triangulate());
+      }
+      state.SetItemsProcessed(state.iterations() * mesh.face_count());
+    }
+    BENCHMARK(triangulate_cuboids)->RangeMultiplier(8)->Range(8, 1 << 14);
+  }
+}
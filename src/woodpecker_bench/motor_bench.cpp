@@ -0,0 +1,63 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+#include <cstddef>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <woodpecker/motor_batch.hpp>
+#include <woodpecker/util/thread_pool.hpp>
+
+#include "workloads.hpp"
+
+namespace wdp::bench {
+  namespace {
+    const auto bench_motor = kln::motor{kln::rotor{0.5F, 1, 2, 3}} * kln::motor{kln::translator{4, 1, -1, 2}};
+
+    void apply_motor_points(benchmark::State& state) {
+      const auto vertices = regular_polygon(static_cast<std::size_t>(state.range(0)));
+      auto out = std::vector<kln::point>(vertices.size());
+      for (auto _ : state) {
+        apply_motor(bench_motor, vertices, out);
+        benchmark::ClobberMemory();
+      }
+      state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK(apply_motor_points)->RangeMultiplier(8)->Range(64, 1 << 21);
+
+    void apply_motor_positions(benchmark::State& state) {
+      const auto vertices = regular_polygon(static_cast<std::size_t>(state.range(0)));
+      auto out = std::vector<Vec3>(vertices.size());
+      for (auto _ : state) {
+        apply_motor(bench_motor, vertices, out);
+        benchmark::ClobberMemory();
+      }
+      state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK(apply_motor_positions)->RangeMultiplier(8)->Range(64, 1 << 21);
+
+    void apply_motor_positions_parallel(benchmark::State& state) {
+      const auto vertices = regular_polygon(static_cast<std::size_t>(state.range(0)));
+      auto out = std::vector<Vec3>(vertices.size());
+      for (auto _ : state) {
+        apply_motor(ThreadPool::global(), bench_motor, vertices, out);
+        benchmark::ClobberMemory();
+      }
+      state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK(apply_motor_positions_parallel)->RangeMultiplier(8)->Range(1 << 12, 1 << 21)->UseRealTime();
+  }
+}
@@ -0,0 +1,63 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+#include <cstdint>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <woodpecker/render_mesh.hpp>
+
+#include "workloads.hpp"
+
+namespace wdp::bench {
+  namespace {
+    /// Packs a mesh whose triangles are already cached, as when a part is uploaded after an edit.
+    template <class Index>
+    void pack_render(benchmark::State& state, const Mesh& mesh) {
+      mesh.triangles();
+      const auto size = render_mesh_size(mesh);
+      auto vertices = std::vector<RenderVertex>(size.vertex_count);
+      auto indices = std::vector<Index>(size.index_count);
+      for (auto _ : state) {
+        pack_render_mesh(mesh, vertices, indices);
+        benchmark::ClobberMemory();
+      }
+      state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(size.vertex_count));
+      state.SetBytesProcessed(state.iterations() * static_cast<std::int64_t>(size.vertex_count * sizeof(RenderVertex) +
+                                                                             size.index_count * sizeof(Index)));
+    }
+
+    void pack_render_cuboids(benchmark::State& state) {
+      const auto mesh = cuboid_grid(static_cast<std::size_t>(state.range(0)));
+      if (render_mesh_size(mesh).has_short_indices()) {
+        pack_render<std::uint16_t>(state, mesh);
+      } else {
+        pack_render<std::uint32_t>(state, mesh);
+      }
+    }
+    BENCHMARK(pack_render_cuboids)->RangeMultiplier(8)->Range(8, 1 << 14);
+
+    void pack_render_polygon(benchmark::State& state) {
+      const auto mesh = polygon_mesh(regular_polygon(static_cast<std::size_t>(state.range(0))));
+      if (render_mesh_size(mesh).has_short_indices()) {
+        pack_render<std::uint16_t>(state, mesh);
+      } else {
+        pack_render<std::uint32_t>(state, mesh);
+      }
+    }
+    BENCHMARK(pack_render_polygon)->RangeMultiplier(8)->Range(8, 1 << 15);
+  }
+}
@@ -0,0 +1,100 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+#include "workloads.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <woodpecker/mesh_builder.hpp>
+
+namespace wdp::bench {
+  namespace {
+    Vertex xz_vertex(double x, double z) { return {kln::point{static_cast<float>(x), 0, static_cast<float>(z)}}; }
+
+    std::vector<Vertex> circle_polygon(std::size_t vertex_count, double outer_radius, double inner_radius) {
+      auto vertices = std::vector<Vertex>{};
+      vertices.reserve(vertex_count);
+      for (auto idx = std::size_t{0}; idx < vertex_count; ++idx) {
+        // negative angles are counter-clockwise in the xz-plane viewed from y-up
+        const auto angle = -2 * static_cast<double>(kln::pi) * static_cast<double>(idx) / vertex_count;
+        const auto radius = idx % 2 == 0 ? outer_radius : inner_radius;
+        vertices.push_back(xz_vertex(radius * std::cos(angle), radius * std::sin(angle)));
+      }
+      return vertices;
+    }
+  }
+
+  std::vector<Vertex> regular_polygon(std::size_t vertex_count) { return circle_polygon(vertex_count, 1, 1); }
+
+  std::vector<Vertex> star_polygon(std::size_t point_count) { return circle_polygon(2 * point_count, 1, 0.5); }
+
+  std::vector<Vertex> degenerate_polygon(std::size_t vertex_count) {
+    const auto side_count = vertex_count / 4;
+    const auto corners = std::vector<Vertex>{xz_vertex(-1, -1), xz_vertex(-1, 1), xz_vertex(1, 1), xz_vertex(1, -1)};
+    auto vertices = std::vector<Vertex>{};
+    vertices.reserve(4 * side_count);
+    for (auto side = std::size_t{0}; side < 4; ++side) {
+      const auto from = corners[side].pos;
+      const auto to = corners[(side + 1) % 4].pos;
+      for (auto idx = std::size_t{0}; idx < side_count; ++idx) {
+        const auto t = static_cast<double>(idx) / side_count;
+        vertices.push_back(xz_vertex(from.x() + t * (to.x() - from.x()), from.z() + t * (to.z() - from.z())));
+      }
+    }
+    // start at the vertex before a corner, as the plane of a face is spanned by its first 3 vertices
+    std::ranges::rotate(vertices, vertices.end() - 1);
+    return vertices;
+  }
+
+  Mesh polygon_mesh(const std::vector<Vertex>& vertices) {
+    auto mesh = Mesh{};
+    mesh.add_face(vertices);
+    return mesh;
+  }
+
+  std::vector<std::vector<Vertex>> cuboid_grid_faces(std::size_t cuboid_count) {
+    const auto cuboid = Mesh::create_cuboid(1, 1, 1);
+    const auto grid_size = static_cast<std::size_t>(std::ceil(std::sqrt(static_cast<double>(cuboid_count))));
+    auto faces = std::vector<std::vector<Vertex>>{};
+    faces.reserve(cuboid_count * cuboid.face_count());
+    for (auto cuboid_idx = std::size_t{0}; cuboid_idx < cuboid_count; ++cuboid_idx) {
+      const auto offset_x = 2 * static_cast<float>(cuboid_idx % grid_size);
+      const auto offset_z = 2 * static_cast<float>(cuboid_idx / grid_size);
+      for (auto face_idx = FaceIndex{0}; face_idx < cuboid.face_count(); ++face_idx) {
+        auto& face = faces.emplace_back();
+        for (const auto vtx_idx : cuboid.face(face_idx).vertices) {
+          const auto pos = cuboid.vertices()[vtx_idx].pos.normalized();
+          face.push_back({kln::point{pos.x() + offset_x, pos.y(), pos.z() + offset_z}});
+        }
+      }
+    }
+    return faces;
+  }
+
+  Mesh cuboid_grid(std::size_t cuboid_count) {
+    auto builder = MeshBuilder{};
+    for (const auto& face : cuboid_grid_faces(cuboid_count)) {
+      const auto first_idx = builder.add_vertices(face);
+      auto face_vertices = std::vector<VertexIndex>(face.size());
+      for (auto idx = std::size_t{0}; idx < face.size(); ++idx) {
+        face_vertices[idx] = first_idx + static_cast<VertexIndex>(idx);
+      }
+      builder.add_face(face_vertices);
+    }
+    return builder.build();
+  }
+}
@@ -0,0 +1,45 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <woodpecker/mesh.hpp>
+
+namespace wdp::bench {
+  /// A convex regular polygon in the xz-plane, its vertices counter-clockwise when viewed from y-up.
+  std::vector<Vertex> regular_polygon(std::size_t vertex_count);
+
+  /// A concave star polygon in the xz-plane, alternating between an outer and an inner radius.
+  /// \param point_count The number of points of the star, which has twice as many vertices.
+  std::vector<Vertex> star_polygon(std::size_t point_count);
+
+  /// A square in the xz-plane, each side subdivided by collinear vertices,
+  /// which are degenerate corners for triangulation. The first 3 vertices span the plane.
+  /// \param vertex_count The total number of vertices, rounded down to a multiple of 4.
+  std::vector<Vertex> degenerate_polygon(std::size_t vertex_count);
+
+  /// A mesh with a single face of the given vertices.
+  Mesh polygon_mesh(const std::vector<Vertex>& vertices);
+
+  /// The faces of unit cuboids, laid out next to each other in a square grid on the xz-plane.
+  std::vector<std::vector<Vertex>> cuboid_grid_faces(std::size_t cuboid_count);
+
+  /// A mesh of unit cuboids, see cuboid_grid_faces(), built in bulk.
+  Mesh cuboid_grid(std::size_t cuboid_count);
+}
@@ -0,0 +1,203 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "batch.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#include <fmt/format.h>
+#include <woodpecker/mesh_export.hpp>
+#include <woodpecker/mesh_import.hpp>
+#include <woodpecker/scene_file.hpp>
+#include <woodpecker/util/thread_pool.hpp>
+#include <woodpecker/util/trace.hpp>
+
+namespace wdp::cli {
+  namespace {
+    const auto scene_file_extension = std::filesystem::path{".wdp"};
+
+    Scene load_input(const std::filesystem::path& input, ThreadPool& pool) {
+      if (input.extension() == scene_file_extension) {
+        return load_scene(input);
+      }
+      if (const auto format = mesh_file_format(input)) {
+        auto scene = Scene{};
+        scene.add_part(Part{scene.share_mesh(import_mesh(input, *format, pool))});
+        return scene;
+      }
+      throw std::runtime_error{fmt::format("{} has an unknown file extension", input.string())};
+    }
+
+    void export_scene(const Scene& scene, const std::filesystem::path& output, ExportFormat format,
+                      ThreadPool& pool) {
+      switch (format) {
+        case ExportFormat::none:
+          break;
+        case ExportFormat::scene:
+          save_scene(scene, output);
+          break;
+        case ExportFormat::stl:
+          export_stl(scene, output, pool);
+          break;
+        case ExportFormat::three_mf:
+          export_3mf(scene, output, pool);
+          break;
+      }
+    }
+
+    /// Validates each distinct mesh of a scene once, or repairs it if asked to, counting the issues by kind.
+    void check_meshes(Scene& scene, bool repair, FileReport& report) {
+      auto part_ids = std::vector<PartId>{};
+      for (const auto& part : scene.parts()) {
+        part_ids.push_back(part.id());
+      }
+      auto checked_meshes = std::unordered_map<const Mesh*, SharedMesh>{};
+      for (const auto id : part_ids) {
+        const auto shared_mesh = std::as_const(scene).find_part(id)->shared_mesh();
+        const auto [iter, inserted] = checked_meshes.try_emplace(shared_mesh.get(), shared_mesh);
+        if (inserted) {
+          auto issues = std::vector<MeshIssue>{};
+          if (repair) {
+            auto mesh = *shared_mesh;
+            auto repair_report = repair_mesh(mesh);
+            if (!repair_report.found.empty()) {
+              const auto found_count = repair_report.found.size();
+              const auto remaining_count = repair_report.remaining.size();
+              report.repaired_issue_count += found_count > remaining_count ? found_count - remaining_count : 0;
+              iter->second = scene.share_mesh(std::move(mesh));
+            }
+            issues = std::move(repair_report.remaining);
+          } else {
+            issues = validate_mesh(*shared_mesh);
+          }
+          for (const auto& issue : issues) {
+            ++report.issue_counts[static_cast<std::size_t>(issue.kind)];
+          }
+        }
+        if (iter->second != shared_mesh) {
+          scene.find_part(id)->set_mesh(iter->second);
+        }
+      }
+    }
+
+    bool is_finite(const kln::point& point) {
+      return std::isfinite(point.x()) && std::isfinite(point.y()) && std::isfinite(point.z());
+    }
+
+    /// Processes a file as described by process_file(), filling in the report.
+    /// \throws std::exception If the file could not be processed.
+    void process_scene(const std::filesystem::path& input, const BatchOptions& options, ThreadPool& pool,
+                       FileReport& report) {
+      auto scene = load_input(input, pool);
+      report.part_count = scene.parts().size();
+      if (const auto problem = validate_scene(scene); !problem.empty()) {
+        throw std::runtime_error{fmt::format("{}: {}", input.string(), problem)};
+      }
+      check_meshes(scene, options.repair, report);
+      if (options.strict && std::ranges::any_of(report.issue_counts, [](std::size_t count) { return count > 0; })) {
+        throw std::runtime_error{fmt::format("{}: meshes have issues left", input.string())};
+      }
+
+      scene.triangulate(pool);
+      auto counted_meshes = std::unordered_set<const Mesh*>{};
+      for (const auto& part : scene.parts()) {
+        if (counted_meshes.insert(&part.mesh()).second) {
+          report.triangle_count += part.mesh().triangles().size();
+        }
+      }
+
+      const auto output = output_path(input, options);
+      if (!output.empty()) {
+        if (std::filesystem::weakly_canonical(output) == std::filesystem::weakly_canonical(input)) {
+          throw std::runtime_error{fmt::format("exporting {} would overwrite it", input.string())};
+        }
+        export_scene(scene, output, options.format, pool);
+        report.output = output;
+      }
+    }
+  }
+
+  std::filesystem::path output_path(const std::filesystem::path& input, const BatchOptions& options) {
+    auto extension = std::filesystem::path{};
+    switch (options.format) {
+      case ExportFormat::none:
+        return {};
+      case ExportFormat::scene:
+        extension = scene_file_extension;
+        break;
+      case ExportFormat::stl:
+        extension = ".stl";
+        break;
+      case ExportFormat::three_mf:
+        extension = ".3mf";
+        break;
+    }
+    const auto& dir = options.output_dir.empty() ? input.parent_path() : options.output_dir;
+    return dir / input.filename().replace_extension(extension);
+  }
+
+  std::string validate_scene(const Scene& scene) {
+    auto checked_meshes = std::unordered_set<const Mesh*>{};
+    for (const auto& part : scene.parts()) {
+      const auto& mesh = part.mesh();
+      if (!checked_meshes.insert(&mesh).second) {
+        continue;
+      }
+      if (mesh.face_count() == 0) {
+        return fmt::format("part {} has an empty mesh", part.id());
+      }
+      for (const auto& vertex : mesh.vertices()) {
+        if (!is_finite(vertex.pos)) {
+          return fmt::format("part {} has a mesh with a non-finite vertex position", part.id());
+        }
+      }
+    }
+    return {};
+  }
+
+  FileReport process_file(const std::filesystem::path& input, const BatchOptions& options, ThreadPool& pool) {
+    WDP_TRACE_SCOPE("process_file");
+    const auto begin_ns = trace::now_ns();
+    auto report = FileReport{};
+    report.input = input;
+    try {
+      process_scene(input, options, pool, report);
+    } catch (const std::exception& ex) {
+      report.error = ex.what();
+    }
+    report.duration_ns = trace::now_ns() - begin_ns;
+    return report;
+  }
+
+  std::vector<FileReport> process_files(std::span<const std::filesystem::path> inputs, const BatchOptions& options,
+                                        ThreadPool& pool, const std::function<void(const FileReport&)>& on_done) {
+    // one task per file, as the files are independent; each file splits its own work into further tasks,
+    // which threads waiting on them help executing, so that a few large files still keep all threads busy
+    auto reports = std::vector<FileReport>(inputs.size());
+    pool.parallel_for(0, inputs.size(), 1, [&](std::size_t i) {
+      reports[i] = process_file(inputs[i], options, pool);
+      on_done(reports[i]);
+    });
+    return reports;
+  }
+}
@@ -0,0 +1,82 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <woodpecker/mesh_validation.hpp>
+#include <woodpecker/scene.hpp>
+
+namespace wdp {
+  class ThreadPool;
+}
+
+namespace wdp::cli {
+  /// The file formats to which processed files are exported.
+  enum class ExportFormat {
+    none,      ///< Nothing is exported, files are only loaded, validated and triangulated.
+    scene,     ///< The binary scene format, see save_scene().
+    stl,       ///< Binary STL, see export_stl().
+    three_mf,  ///< 3MF, see export_3mf().
+  };
+
+  struct BatchOptions {
+    ExportFormat format{ExportFormat::none};
+    std::filesystem::path output_dir;  ///< The directory of exported files, next to their input file if empty.
+    bool repair{};                     ///< Whether to repair the meshes before exporting them, see repair_mesh().
+    bool strict{};                     ///< Whether files whose meshes have issues left fail.
+  };
+
+  /// The outcome of processing a single input file.
+  struct FileReport {
+    std::filesystem::path input;
+    std::filesystem::path output;  ///< The exported file, empty if nothing was exported.
+    std::size_t part_count{};
+    std::size_t triangle_count{};                                   ///< Of the distinct meshes of the scene.
+    std::size_t repaired_issue_count{};                             ///< The issues found less those left by repairs.
+    std::array<std::size_t, mesh_issue_kind_count> issue_counts{};  ///< The issues left in the meshes, by kind.
+    std::string error;  ///< Why processing failed, naming the file, or empty on success.
+    std::int64_t duration_ns{};
+
+    bool ok() const noexcept { return error.empty(); }
+  };
+
+  /// The path to which an input file is exported, or an empty path if nothing is exported.
+  std::filesystem::path output_path(const std::filesystem::path& input, const BatchOptions& options);
+
+  /// The first problem which makes a scene unfit for export, or an empty string if there is none.
+  /// Each distinct mesh is checked once. Mesh issues found by validate_mesh() are reported separately.
+  std::string validate_scene(const Scene& scene);
+
+  /// Loads a scene file, or imports a mesh file as a scene of a single part, then validates, optionally repairs,
+  /// triangulates and optionally exports it. The work on the file itself runs in parallel on the pool.
+  /// Errors are reported instead of thrown, so that one broken file does not stop a batch.
+  FileReport process_file(const std::filesystem::path& input, const BatchOptions& options, ThreadPool& pool);
+
+  /// Processes files in parallel on the pool, see process_file().
+  /// \param on_done Called for each file as soon as it is processed, possibly concurrently from several threads.
+  /// \return The reports in the order of the inputs.
+  std::vector<FileReport> process_files(std::span<const std::filesystem::path> inputs, const BatchOptions& options,
+                                        ThreadPool& pool, const std::function<void(const FileReport&)>& on_done);
+}
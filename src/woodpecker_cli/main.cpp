@@ -0,0 +1,243 @@
+// Copyright © 2021 Jesse Stricker
+//
+// This file is part of Woodpecker.
+//
+// Woodpecker is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Woodpecker is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Woodpecker.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+#include <woodpecker/config.hpp>
+#include <woodpecker/util/thread_pool.hpp>
+#include <woodpecker/util/trace.hpp>
+
+#include "batch.hpp"
+
+namespace wdp::cli {
+  namespace {
+    constexpr auto usage = std::string_view{R"(usage: woodpecker_cli [options] <file>...
+
+Loads scene files (.wdp) and mesh files (.stl, .obj, .ply), validates, triangulates and optionally
+repairs and exports them. The files are processed in parallel on all cores.
+
+options:
+  -f, --format <format>   export to scene, stl or 3mf files; nothing is exported without it
+  -o, --output-dir <dir>  write exported files into this directory instead of next to their input
+  -j, --jobs <count>      the number of threads, all cores by default
+  -r, --repair            repair mesh issues, such as flipped faces and T-junctions
+  -s, --strict            fail files whose meshes have issues left, such as open edges
+  -q, --quiet             only report files which failed
+  --trace <file>          write the traced scopes as a Chrome trace, if built with tracing
+  -h, --help              show this help
+  --version               show the version
+)"};
+
+    /// The exit code if all files were processed, some failed, or the arguments are invalid.
+    enum ExitCode : int { exit_success = 0, exit_failed_files = 1, exit_usage = 2 };
+
+    class UsageError : public std::runtime_error {
+    public:
+      explicit UsageError(const std::string& message) : runtime_error(message) {}
+    };
+
+    struct Arguments {
+      BatchOptions batch;
+      std::vector<std::filesystem::path> inputs;
+      std::size_t jobs{std::max(std::thread::hardware_concurrency(), 1U)};
+      bool quiet{};
+      std::filesystem::path trace_path;
+    };
+
+    ExportFormat parse_format(std::string_view name) {
+      if (name == "scene") {
+        return ExportFormat::scene;
+      }
+      if (name == "stl") {
+        return ExportFormat::stl;
+      }
+      if (name == "3mf") {
+        return ExportFormat::three_mf;
+      }
+      throw UsageError{fmt::format("unknown export format '{}'", name)};
+    }
+
+    std::size_t parse_jobs(std::string_view str) {
+      auto jobs = std::size_t{};
+      const auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), jobs);
+      if (ec != std::errc{} || end != str.data() + str.size() || jobs == 0) {
+        throw UsageError{fmt::format("invalid number of jobs '{}'", str)};
+      }
+      return jobs;
+    }
+
+    /// Parses the command line, or returns nothing if it asked for help or the version, which were shown.
+    /// \throws UsageError If the arguments are invalid.
+    std::optional<Arguments> parse_arguments(std::span<char* const> args) {
+      auto arguments = Arguments{};
+      for (std::size_t i = 1; i < args.size(); ++i) {
+        const auto arg = std::string_view{args[i]};
+        const auto value = [&] {
+          if (i + 1 == args.size()) {
+            throw UsageError{fmt::format("missing value of option '{}'", arg)};
+          }
+          return std::string_view{args[++i]};
+        };
+
+        if (arg == "-h" || arg == "--help") {
+          fmt::print("{}", usage);
+          return std::nullopt;
+        }
+        if (arg == "--version") {
+          fmt::print("{} {}\n", project_name, project_version);
+          return std::nullopt;
+        }
+        if (arg == "-f" || arg == "--format") {
+          arguments.batch.format = parse_format(value());
+        } else if (arg == "-o" || arg == "--output-dir") {
+          arguments.batch.output_dir = value();
+        } else if (arg == "-j" || arg == "--jobs") {
+          arguments.jobs = parse_jobs(value());
+        } else if (arg == "-r" || arg == "--repair") {
+          arguments.batch.repair = true;
+        } else if (arg == "-s" || arg == "--strict") {
+          arguments.batch.strict = true;
+        } else if (arg == "-q" || arg == "--quiet") {
+          arguments.quiet = true;
+        } else if (arg == "--trace") {
+          arguments.trace_path = value();
+        } else if (arg.starts_with('-')) {
+          throw UsageError{fmt::format("unknown option '{}'", arg)};
+        } else {
+          arguments.inputs.emplace_back(arg);
+        }
+      }
+
+      if (arguments.inputs.empty()) {
+        throw UsageError{"no input files"};
+      }
+      if (!arguments.batch.output_dir.empty() && arguments.batch.format == ExportFormat::none) {
+        throw UsageError{"an output directory requires an export format"};
+      }
+      if (!arguments.trace_path.empty() && !trace::enabled) {
+        throw UsageError{"tracing is not enabled in this build"};
+      }
+
+      // exporting files of the same name from several directories into one would overwrite all but one
+      auto outputs = std::map<std::filesystem::path, const std::filesystem::path*>{};
+      for (const auto& input : arguments.inputs) {
+        const auto output = output_path(input, arguments.batch);
+        if (output.empty()) {
+          break;
+        }
+        const auto [iter, inserted] = outputs.emplace(output.lexically_normal(), &input);
+        if (!inserted) {
+          throw UsageError{fmt::format("'{}' and '{}' would both be exported to '{}'", iter->second->string(),
+                                       input.string(), output.string())};
+        }
+      }
+      return arguments;
+    }
+
+    /// The issues left in the meshes of a file, such as "2 boundary edge, 1 T-junction", or an empty string.
+    std::string issue_summary(const FileReport& report) {
+      auto summary = std::string{};
+      for (std::size_t kind = 0; kind < mesh_issue_kind_count; ++kind) {
+        if (report.issue_counts[kind] > 0) {
+          summary += fmt::format("{}{} {}", summary.empty() ? "" : ", ", report.issue_counts[kind],
+                                 mesh_issue_name(static_cast<MeshIssueKind>(kind)));
+        }
+      }
+      return summary;
+    }
+
+    void log_report(const FileReport& report) {
+      const auto duration_ms = static_cast<double>(report.duration_ns) / 1e6;
+      if (!report.ok()) {
+        spdlog::error("{}", report.error);
+      } else if (report.output.empty()) {
+        spdlog::info("{}: {} parts, {} triangles in {:.1f} ms", report.input.string(), report.part_count,
+                     report.triangle_count, duration_ms);
+      } else {
+        spdlog::info("{}: {} parts, {} triangles, exported to {} in {:.1f} ms", report.input.string(),
+                     report.part_count, report.triangle_count, report.output.string(), duration_ms);
+      }
+      if (report.repaired_issue_count > 0) {
+        spdlog::info("{}: repaired {} mesh issues", report.input.string(), report.repaired_issue_count);
+      }
+      if (const auto summary = issue_summary(report); !summary.empty()) {
+        spdlog::warn("{}: mesh issues: {}", report.input.string(), summary);
+      }
+    }
+  }
+
+  int main(int argc, char* argv[]) {
+    auto arguments = std::optional<Arguments>{};
+    try {
+      arguments = parse_arguments(std::span{argv, static_cast<std::size_t>(argc)});
+    } catch (const UsageError& ex) {
+      fmt::print(stderr, "woodpecker_cli: {}\n\n{}", ex.what(), usage);
+      return exit_usage;
+    }
+    if (!arguments) {
+      return exit_success;
+    }
+    if (arguments->quiet) {
+      spdlog::set_level(spdlog::level::warn);
+    }
+    if (!arguments->batch.output_dir.empty()) {
+      std::filesystem::create_directories(arguments->batch.output_dir);
+    }
+
+    const auto begin_ns = trace::now_ns();
+    auto pool = ThreadPool{arguments->jobs};
+    const auto reports = process_files(arguments->inputs, arguments->batch, pool, log_report);
+    const auto failed_count = std::ranges::count_if(reports, [](const FileReport& report) { return !report.ok(); });
+    spdlog::info("processed {} files on {} threads in {:.1f} ms, {} failed", reports.size(), pool.thread_count(),
+                 static_cast<double>(trace::now_ns() - begin_ns) / 1e6, failed_count);
+
+    if (!arguments->trace_path.empty()) {
+      auto out = std::ofstream{arguments->trace_path};
+      trace::write_chrome_trace(out);
+      if (!out) {
+        spdlog::error("could not write trace to {}", arguments->trace_path.string());
+      }
+    }
+    return failed_count == 0 ? exit_success : exit_failed_files;
+  }
+}
+
+int main(int argc, char* argv[]) {
+  try {
+    return wdp::cli::main(argc, argv);
+  } catch (const std::exception& ex) {
+    spdlog::critical("unhandled exception: {}", ex.what());
+    return 1;
+  } catch (...) {
+    spdlog::critical("unhandled exception of unknown type");
+    return 1;
+  }
+}